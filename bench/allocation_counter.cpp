@@ -0,0 +1,53 @@
+#include "allocation_counter.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+using namespace rpflib::bench;
+
+static std::atomic<uint64_t> g_Allocations = 0;
+static std::atomic<uint64_t> g_AllocatedBytes = 0;
+
+AllocationCount rpflib::bench::GetAllocationCount()
+{
+    return {g_Allocations.load(std::memory_order_relaxed), g_AllocatedBytes.load(std::memory_order_relaxed)};
+}
+
+// the nothrow forms forward to these by default, the array and sized forms are replaced as well so every form pairs
+// with the same allocator
+void* operator new(std::size_t size)
+{
+    g_Allocations.fetch_add(1, std::memory_order_relaxed);
+    g_AllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+
+    void* memory = std::malloc(size == 0 ? 1 : size);
+    if (memory == nullptr)
+        throw std::bad_alloc();
+
+    return memory;
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+    operator delete(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+    operator delete(memory);
+}
+
+void operator delete[](void* memory, std::size_t) noexcept
+{
+    operator delete(memory);
+}
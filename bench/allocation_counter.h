@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+
+namespace rpflib::bench
+{
+    struct AllocationCount
+    {
+        uint64_t m_Allocations = 0;
+        uint64_t m_AllocatedBytes = 0;
+    };
+
+    // Totals of every global operator new call since the process started.
+    AllocationCount GetAllocationCount();
+}
@@ -0,0 +1,91 @@
+#include "archive_generator.h"
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <random>
+
+using namespace rpflib;
+using namespace rpflib::bench;
+
+static const char* const ENTRY_EXTENSIONS[] = {".ymap", ".ytyp", ".meta", ".xml", ".ydr", ".ytd", ".awc"};
+
+static double GetUnitValue(std::mt19937_64& random)
+{
+    return (random() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+std::vector<GeneratedEntry> ArchiveGenerator::GenerateEntries() const
+{
+    std::mt19937_64 random(m_Shape.m_Seed);
+
+    std::vector<GeneratedEntry> entries;
+    entries.reserve(m_Shape.m_EntryCount);
+
+    double minSizeLog = std::log((double)std::max<uint64_t>(m_Shape.m_MinEntrySize, 1));
+    double maxSizeLog = std::log((double)std::max(m_Shape.m_MaxEntrySize, m_Shape.m_MinEntrySize));
+
+    for (uint32_t i = 0; i < m_Shape.m_EntryCount; i++)
+    {
+        GeneratedEntry& entry = entries.emplace_back();
+
+        uint32_t depth = m_Shape.m_MaxDepth == 0 ? 0 : (uint32_t)(random() % (m_Shape.m_MaxDepth + 1));
+        for (uint32_t level = 0; level < depth; level++)
+            entry.m_Path += "/dir" + std::to_string(level) + "_" + std::to_string(random() % std::max<uint32_t>(m_Shape.m_DirectoriesPerLevel, 1));
+
+        bool isResource = GetUnitValue(random) < m_Shape.m_ResourceRatio;
+        bool isCompressible = GetUnitValue(random) < m_Shape.m_CompressibleRatio;
+        uint64_t size = (uint64_t)std::exp(minSizeLog + (maxSizeLog - minSizeLog) * GetUnitValue(random));
+
+        const char* extension = isResource ? ".ydr" : ENTRY_EXTENSIONS[random() % std::size(ENTRY_EXTENSIONS)];
+        entry.m_Path += "/entry_" + std::to_string(i) + extension;
+
+        entry.m_Data = GenerateData(random(), size, isCompressible);
+        if (isResource && entry.m_Data.size() >= 16)
+        {
+            // RSC7 header: magic, version, virtual and physical flags
+            uint32_t resourceHeader[4] = {RPF7Archive::RESOURCE_IDENT, 165, 0x00000001, 0x00000000};
+            std::memcpy(entry.m_Data.data(), resourceHeader, sizeof(resourceHeader));
+        }
+    }
+
+    return entries;
+}
+
+uint64_t ArchiveGenerator::WriteArchive(const std::filesystem::path& archivePath, std::vector<GeneratedEntry> entries, const RPF7WriteOptions& options) const
+{
+    std::unique_ptr<RPF7Archive> archive = RPF7Archive::CreateArchive(archivePath, m_Shape.m_NameShift, options);
+    for (GeneratedEntry& entry : entries)
+        archive->AddEntry(entry.m_Path, std::move(entry.m_Data));
+
+    archive->CloseArchive();
+
+    std::error_code errorCode;
+    uint64_t archiveSize = std::filesystem::file_size(archivePath, errorCode);
+    return errorCode ? 0 : archiveSize;
+}
+
+RPF7Archive::EntryDataBuffer ArchiveGenerator::GenerateData(uint64_t seed, uint64_t size, bool isCompressible)
+{
+    std::mt19937_64 random(seed);
+    RPF7Archive::EntryDataBuffer data(size);
+
+    if (!isCompressible)
+    {
+        for (uint64_t i = 0; i < size; i++)
+            data[i] = (uint8_t)random();
+
+        return data;
+    }
+
+    // short words repeated with small variations, which deflate shrinks to roughly a quarter
+    static const char* const WORDS[] = {"entity", "archetype", "lodDist", "flags", "position", "rotation", "0.000000", "CMapData", "\n", "  "};
+    uint64_t position = 0;
+    while (position < size)
+    {
+        const char* word = WORDS[random() % std::size(WORDS)];
+        for (const char* c = word; *c != '\0' && position < size; c++)
+            data[position++] = (uint8_t)*c;
+    }
+
+    return data;
+}
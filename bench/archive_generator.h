@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <rpflib/archives/rpf7.h>
+
+namespace rpflib::bench
+{
+    struct ArchiveShape
+    {
+        uint32_t m_EntryCount = 10000;
+        // directory levels below the root an entry can be placed in
+        uint32_t m_MaxDepth = 4;
+        uint32_t m_DirectoriesPerLevel = 8;
+        // entry sizes are spread log-uniformly between the two bounds
+        uint64_t m_MinEntrySize = 64;
+        uint64_t m_MaxEntrySize = 256 * 1024;
+        // share of entries filled with repetitive data, the rest is random
+        double m_CompressibleRatio = 0.75;
+        // share of entries written with an RSC7 resource header
+        double m_ResourceRatio = 0.1;
+        int m_NameShift = 0;
+        uint64_t m_Seed = 1;
+    };
+
+    struct GeneratedEntry
+    {
+        std::string m_Path;
+        RPF7Archive::EntryDataBuffer m_Data;
+    };
+
+    // Produces the same entries for the same shape on every platform, only raw std::mt19937_64 output is used.
+    class ArchiveGenerator
+    {
+    public:
+        explicit ArchiveGenerator(const ArchiveShape& shape) : m_Shape(shape) { }
+
+        [[nodiscard]] std::vector<GeneratedEntry> GenerateEntries() const;
+        // Writes the entries into a new archive, returns the archive size in bytes.
+        uint64_t WriteArchive(const std::filesystem::path& archivePath, std::vector<GeneratedEntry> entries, const RPF7WriteOptions& options = {}) const;
+
+        [[nodiscard]] static RPF7Archive::EntryDataBuffer GenerateData(uint64_t seed, uint64_t size, bool isCompressible);
+
+    private:
+        ArchiveShape m_Shape;
+    };
+}
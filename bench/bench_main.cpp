@@ -0,0 +1,389 @@
+#include "allocation_counter.h"
+#include "archive_generator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace rpflib;
+using namespace rpflib::bench;
+
+struct BenchOptions
+{
+    ArchiveShape m_Shape;
+    uint32_t m_Iterations = 3;
+    uint32_t m_LookupCount = 100000;
+    uint32_t m_ThreadCount = 0;
+    std::filesystem::path m_WorkDirectory = std::filesystem::temp_directory_path() / "rpflib_bench";
+    std::filesystem::path m_OutputPath;
+};
+
+struct BenchResult
+{
+    std::string m_Name;
+    uint32_t m_Iterations = 0;
+    uint64_t m_Operations = 0;
+    uint64_t m_Bytes = 0;
+    // best iteration, which is the least disturbed by the rest of the system
+    double m_Seconds = 0.0;
+    AllocationCount m_AllocationCount;
+};
+
+// Runs the benchmark body the given number of times and keeps the fastest run. The body returns the number of
+// processed bytes and adds to operations.
+static BenchResult RunBench(const std::string& name, uint32_t iterations, const std::function<uint64_t(uint64_t& operations)>& body)
+{
+    BenchResult result;
+    result.m_Name = name;
+    result.m_Iterations = std::max<uint32_t>(iterations, 1);
+    result.m_Seconds = -1.0;
+
+    for (uint32_t i = 0; i < result.m_Iterations; i++)
+    {
+        uint64_t operations = 0;
+        AllocationCount allocationsBefore = GetAllocationCount();
+        auto startTime = std::chrono::steady_clock::now();
+
+        uint64_t bytes = body(operations);
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        AllocationCount allocationsAfter = GetAllocationCount();
+
+        if (result.m_Seconds >= 0.0 && seconds >= result.m_Seconds)
+            continue;
+
+        result.m_Seconds = seconds;
+        result.m_Operations = operations;
+        result.m_Bytes = bytes;
+        result.m_AllocationCount.m_Allocations = allocationsAfter.m_Allocations - allocationsBefore.m_Allocations;
+        result.m_AllocationCount.m_AllocatedBytes = allocationsAfter.m_AllocatedBytes - allocationsBefore.m_AllocatedBytes;
+    }
+
+    printf("%-24s %10.3f ms %14.0f ops/s %10.1f MiB/s %10llu allocs\n", result.m_Name.c_str(), result.m_Seconds * 1000.0,
+           result.m_Seconds > 0.0 ? result.m_Operations / result.m_Seconds : 0.0, result.m_Seconds > 0.0 ? result.m_Bytes / result.m_Seconds / (1024.0 * 1024.0) : 0.0,
+           (unsigned long long)result.m_AllocationCount.m_Allocations);
+
+    return result;
+}
+
+static void WriteResults(FILE* file, const BenchOptions& options, const std::vector<BenchResult>& results)
+{
+    const ArchiveShape& shape = options.m_Shape;
+    fprintf(file, "{\n");
+    fprintf(file, "  \"shape\": {\"entries\": %u, \"depth\": %u, \"min_size\": %llu, \"max_size\": %llu, \"compressible\": %.3f, \"resources\": %.3f, \"name_shift\": %d, \"seed\": %llu},\n",
+            shape.m_EntryCount, shape.m_MaxDepth, (unsigned long long)shape.m_MinEntrySize, (unsigned long long)shape.m_MaxEntrySize, shape.m_CompressibleRatio,
+            shape.m_ResourceRatio, shape.m_NameShift, (unsigned long long)shape.m_Seed);
+    fprintf(file, "  \"results\": [\n");
+
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BenchResult& result = results[i];
+        double operationsPerSecond = result.m_Seconds > 0.0 ? result.m_Operations / result.m_Seconds : 0.0;
+        double bytesPerSecond = result.m_Seconds > 0.0 ? result.m_Bytes / result.m_Seconds : 0.0;
+
+        fprintf(file,
+                "    {\"name\": \"%s\", \"iterations\": %u, \"seconds\": %.9f, \"operations\": %llu, \"bytes\": %llu, \"operations_per_second\": %.3f, "
+                "\"bytes_per_second\": %.3f, \"allocations\": %llu, \"allocated_bytes\": %llu}%s\n",
+                result.m_Name.c_str(), result.m_Iterations, result.m_Seconds, (unsigned long long)result.m_Operations, (unsigned long long)result.m_Bytes,
+                operationsPerSecond, bytesPerSecond, (unsigned long long)result.m_AllocationCount.m_Allocations,
+                (unsigned long long)result.m_AllocationCount.m_AllocatedBytes, i + 1 < results.size() ? "," : "");
+    }
+
+    fprintf(file, "  ]\n}\n");
+}
+
+static void PrintUsage()
+{
+    printf("usage: rpflib_bench [options]\n"
+           "  --entries N         number of entries (default 10000)\n"
+           "  --depth N           maximum directory depth (default 4)\n"
+           "  --min-size N        smallest entry size in bytes (default 64)\n"
+           "  --max-size N        largest entry size in bytes (default 262144)\n"
+           "  --compressible R    share of compressible entries, 0-1 (default 0.75)\n"
+           "  --resources R       share of resource entries, 0-1 (default 0.1)\n"
+           "  --name-shift N      name heap shift, 0-3 (default 0)\n"
+           "  --seed N            generator seed (default 1)\n"
+           "  --iterations N      runs per benchmark, the fastest is reported (default 3)\n"
+           "  --lookups N         lookups and reads per random benchmark (default 100000)\n"
+           "  --threads N         writer and extraction threads, 0 for all cores (default 0)\n"
+           "  --work-dir PATH     directory for generated archives\n"
+           "  --output PATH       write the results as JSON to PATH\n");
+}
+
+static bool ParseOptions(int argc, char** argv, BenchOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--help" || argument == "-h")
+            return false;
+
+        if (i + 1 >= argc)
+        {
+            printf("ERROR! Missing value for %s\n", argument.c_str());
+            return false;
+        }
+
+        const char* value = argv[++i];
+        if (argument == "--entries")
+            options.m_Shape.m_EntryCount = std::stoul(value);
+        else if (argument == "--depth")
+            options.m_Shape.m_MaxDepth = std::stoul(value);
+        else if (argument == "--min-size")
+            options.m_Shape.m_MinEntrySize = std::stoull(value);
+        else if (argument == "--max-size")
+            options.m_Shape.m_MaxEntrySize = std::stoull(value);
+        else if (argument == "--compressible")
+            options.m_Shape.m_CompressibleRatio = std::stod(value);
+        else if (argument == "--resources")
+            options.m_Shape.m_ResourceRatio = std::stod(value);
+        else if (argument == "--name-shift")
+            options.m_Shape.m_NameShift = std::stoi(value);
+        else if (argument == "--seed")
+            options.m_Shape.m_Seed = std::stoull(value);
+        else if (argument == "--iterations")
+            options.m_Iterations = std::stoul(value);
+        else if (argument == "--lookups")
+            options.m_LookupCount = std::stoul(value);
+        else if (argument == "--threads")
+            options.m_ThreadCount = std::stoul(value);
+        else if (argument == "--work-dir")
+            options.m_WorkDirectory = value;
+        else if (argument == "--output")
+            options.m_OutputPath = value;
+        else
+        {
+            printf("ERROR! Unknown option %s\n", argument.c_str());
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    BenchOptions options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    // joaat("a") is 0xCA2E9442, the game adds the length and 61 before picking one of the 101 keys
+    if (NgDecryptor::GetKeyIndex("a", 0) != (0xCA2E9442u + 61) % RPF7Keys::NG_KEY_COUNT || NgDecryptor::GetKeyIndex("a", 54) != 0)
+    {
+        printf("ERROR! NG key indices do not match the game!\n");
+        return 1;
+    }
+
+    std::filesystem::create_directories(options.m_WorkDirectory);
+    std::filesystem::path archivePath = options.m_WorkDirectory / "bench.rpf";
+    std::filesystem::path extractPath = options.m_WorkDirectory / "extract";
+
+    ArchiveGenerator generator(options.m_Shape);
+    std::vector<GeneratedEntry> entries = generator.GenerateEntries();
+
+    uint64_t totalEntryBytes = 0;
+    for (const GeneratedEntry& entry : entries)
+        totalEntryBytes += entry.m_Data.size();
+
+    RPF7WriteOptions writeOptions;
+    writeOptions.m_ThreadCount = options.m_ThreadCount;
+
+    RPF7ExtractOptions extractOptions;
+    extractOptions.m_ThreadCount = options.m_ThreadCount;
+    RPF7BatchReadOptions batchOptions;
+    batchOptions.m_ThreadCount = options.m_ThreadCount;
+
+    std::vector<BenchResult> results;
+
+    results.push_back(RunBench("build", options.m_Iterations,
+                               [&](uint64_t& operations)
+                               {
+                                   operations += entries.size();
+                                   generator.WriteArchive(archivePath, entries, writeOptions);
+                                   return totalEntryBytes;
+                               }));
+
+    results.push_back(RunBench("open", options.m_Iterations,
+                               [&](uint64_t& operations)
+                               {
+                                   operations++;
+                                   std::unique_ptr<RPF7Archive> archive = RPF7Archive::OpenArchive(archivePath);
+                                   return std::filesystem::file_size(archivePath);
+                               }));
+
+    RPF7OpenOptions lazyOptions;
+    lazyOptions.m_LazyIndex = true;
+    results.push_back(RunBench("open_lazy", options.m_Iterations,
+                               [&](uint64_t& operations)
+                               {
+                                   operations++;
+                                   std::unique_ptr<RPF7Archive> archive = RPF7Archive::OpenArchive(archivePath, lazyOptions);
+                                   return std::filesystem::file_size(archivePath);
+                               }));
+
+    std::unique_ptr<RPF7Archive> archive = RPF7Archive::OpenArchive(archivePath);
+    if (archive == nullptr || archive->GetEntryList().size() != entries.size())
+    {
+        printf("ERROR! Generated archive %s could not be read back!\n", archivePath.string().c_str());
+        return 1;
+    }
+
+    // the same pseudo random order for every run and build
+    std::vector<uint32_t> randomOrder(options.m_LookupCount);
+    std::mt19937_64 random(options.m_Shape.m_Seed);
+    for (uint32_t& entryIndex : randomOrder)
+        entryIndex = (uint32_t)(random() % entries.size());
+
+    results.push_back(RunBench("lookup_sequential", options.m_Iterations,
+                               [&](uint64_t& operations)
+                               {
+                                   for (const GeneratedEntry& entry : entries)
+                                       operations += archive->FindEntry(entry.m_Path) != nullptr;
+                                   return 0;
+                               }));
+
+    results.push_back(RunBench("lookup_random", options.m_Iterations,
+                               [&](uint64_t& operations)
+                               {
+                                   for (uint32_t entryIndex : randomOrder)
+                                       operations += archive->FindEntry(entries[entryIndex].m_Path) != nullptr;
+                                   return 0;
+                               }));
+
+    results.push_back(RunBench("read_sequential", options.m_Iterations,
+                               [&](uint64_t& operations)
+                               {
+                                   uint64_t bytes = 0;
+                                   for (const GeneratedEntry& entry : entries)
+                                   {
+                                       bytes += archive->GetEntryData(entry.m_Path).size();
+                                       operations++;
+                                   }
+                                   return bytes;
+                               }));
+
+    results.push_back(RunBench("read_random", options.m_Iterations,
+                               [&](uint64_t& operations)
+                               {
+                                   uint64_t bytes = 0;
+                                   for (uint32_t entryIndex : randomOrder)
+                                   {
+                                       bytes += archive->GetEntryData(entries[entryIndex].m_Path).size();
+                                       operations++;
+                                   }
+                                   return bytes;
+                               }));
+
+    std::vector<std::string> randomPaths;
+    randomPaths.reserve(randomOrder.size());
+    for (uint32_t entryIndex : randomOrder)
+        randomPaths.push_back(entries[entryIndex].m_Path);
+
+    results.push_back(RunBench("read_batch", options.m_Iterations,
+                               [&](uint64_t& operations)
+                               {
+                                   uint64_t bytes = 0;
+                                   for (const RPF7Archive::EntryDataBuffer& entryData : archive->GetEntriesData(randomPaths, batchOptions))
+                                   {
+                                       bytes += entryData.size();
+                                       operations++;
+                                   }
+                                   return bytes;
+                               }));
+
+    // reads much smaller than the inflate window leave output pending inside zlib between calls, every entry still has
+    // to come back whole
+    bool isStreamIntact = true;
+    results.push_back(RunBench("read_stream_small", options.m_Iterations,
+                               [&](uint64_t& operations)
+                               {
+                                   uint64_t bytes = 0;
+                                   uint8_t chunk[61];
+                                   for (const GeneratedEntry& entry : entries)
+                                   {
+                                       std::unique_ptr<EntryReader> reader = archive->OpenEntryStream(entry.m_Path);
+                                       uint64_t entryBytes = 0;
+                                       while (reader != nullptr && entryBytes <= entry.m_Data.size())
+                                       {
+                                           uint64_t readBytes = reader->Read(chunk, sizeof(chunk));
+                                           if (readBytes == 0)
+                                               break;
+
+                                           if (entryBytes + readBytes > entry.m_Data.size() || std::memcmp(chunk, entry.m_Data.data() + entryBytes, readBytes) != 0)
+                                               isStreamIntact = false;
+
+                                           entryBytes += readBytes;
+                                       }
+
+                                       if (reader == nullptr || reader->HasFailed() || entryBytes != entry.m_Data.size())
+                                           isStreamIntact = false;
+
+                                       bytes += entryBytes;
+                                       operations++;
+                                   }
+                                   return bytes;
+                               }));
+
+    if (!isStreamIntact)
+    {
+        printf("ERROR! Streamed entries of %s do not match the generated data!\n", archivePath.string().c_str());
+        return 1;
+    }
+
+    results.push_back(RunBench("extract_all", options.m_Iterations,
+                               [&](uint64_t& operations)
+                               {
+                                   std::filesystem::remove_all(extractPath);
+                                   operations += archive->ExtractAll(extractPath, extractOptions);
+                                   return totalEntryBytes;
+                               }));
+    std::filesystem::remove_all(extractPath);
+
+    RPF7Archive::EntryDataBuffer compressibleData = ArchiveGenerator::GenerateData(options.m_Shape.m_Seed, 16 * 1024 * 1024, true);
+    RPF7Archive::EntryDataBuffer compressedData;
+    results.push_back(RunBench("compress", options.m_Iterations,
+                               [&](uint64_t& operations)
+                               {
+                                   operations++;
+                                   compressedData = RPF7Archive::CompressData(compressibleData.data(), compressibleData.size());
+                                   return compressibleData.size();
+                               }));
+
+    RPF7Archive::EntryDataBuffer decompressedData(compressibleData.size());
+    results.push_back(RunBench("decompress", options.m_Iterations,
+                               [&](uint64_t& operations)
+                               {
+                                   operations++;
+                                   return RPF7Archive::DecompressData(compressedData.data(), compressedData.size(), decompressedData.data(), decompressedData.size());
+                               }));
+
+    if (!options.m_OutputPath.empty())
+    {
+        FILE* outputFile = fopen(options.m_OutputPath.string().c_str(), "w");
+        if (outputFile == nullptr)
+        {
+            printf("ERROR! Failed to open %s for writing!\n", options.m_OutputPath.string().c_str());
+            return 1;
+        }
+
+        WriteResults(outputFile, options, results);
+        fclose(outputFile);
+    }
+    else
+    {
+        WriteResults(stdout, options, results);
+    }
+
+    archive.reset();
+    std::filesystem::remove(archivePath);
+
+    return 0;
+}
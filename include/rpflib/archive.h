@@ -1,8 +1,8 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include <filesystem>
-#include <fstream>
 
 namespace rpflib
 {
@@ -16,7 +16,9 @@ namespace rpflib
         {
             OPEN_MODE_INVALILD = -1,
             OPEN_MODE_READ = 0,
-            OPEN_MODE_WRITE
+            OPEN_MODE_WRITE,
+            // reads an existing archive and writes only changed entries and the table of contents back on close
+            OPEN_MODE_UPDATE
         };
 
         explicit IRPFArchive(const std::filesystem::path& path, OpenMode openMode)
@@ -26,7 +28,7 @@ namespace rpflib
 
         virtual void OpenArchive() = 0;
         virtual void CreateArchive() = 0;
-        virtual void CloseArchive() = 0;
+        virtual bool CloseArchive() = 0;
 
         virtual void AddEntry(const std::filesystem::path& entryPath, const std::filesystem::path& entryFilePath) = 0;
         virtual EntryDataBuffer GetEntryData(const std::string& entryPath) = 0;
@@ -35,11 +37,12 @@ namespace rpflib
         virtual bool DoesEntryExists(const std::string& entryPath) = 0;
 
         [[nodiscard]] bool IsWriting() const { return m_OpenMode == OpenMode::OPEN_MODE_WRITE; }
-        [[nodiscard]] bool IsReading() const { return m_OpenMode == OpenMode::OPEN_MODE_READ; }
+        // existing archive contents can be read in update mode as well
+        [[nodiscard]] bool IsReading() const { return m_OpenMode == OpenMode::OPEN_MODE_READ || m_OpenMode == OpenMode::OPEN_MODE_UPDATE; }
+        [[nodiscard]] bool IsUpdating() const { return m_OpenMode == OpenMode::OPEN_MODE_UPDATE; }
 
     protected:
         const OpenMode m_OpenMode = OpenMode::OPEN_MODE_INVALILD;
         const std::filesystem::path m_Path;
-        std::fstream m_FileStream;
     };
 }
\ No newline at end of file
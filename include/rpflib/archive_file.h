@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <span>
+
+namespace rpflib
+{
+    // Read-only handle to an archive file. All reads are positional (pread / overlapped ReadFile) or served from
+    // an optional memory mapping, so a single handle can be shared by any number of threads without locking.
+    class ArchiveFile
+    {
+    public:
+        ~ArchiveFile();
+
+        ArchiveFile(const ArchiveFile&) = delete;
+        ArchiveFile& operator=(const ArchiveFile&) = delete;
+
+        // isWriteShared lets an OutputFile write to the same file while it is open, which Windows refuses otherwise.
+        static std::shared_ptr<ArchiveFile> Open(const std::filesystem::path& path, bool memoryMapped = false, bool isWriteShared = false);
+
+        // Returns an empty span when the file is not mapped or the requested range is outside of the file.
+        [[nodiscard]] std::span<const uint8_t> GetView(uint64_t offset, uint64_t size) const;
+        bool Read(uint64_t offset, void* buffer, uint64_t size) const;
+
+        [[nodiscard]] bool IsMapped() const
+        {
+            return m_Data != nullptr;
+        }
+
+        [[nodiscard]] uint64_t GetSize() const
+        {
+            return m_Size;
+        }
+
+#ifndef _WIN32
+        [[nodiscard]] int GetFileDescriptor() const
+        {
+            return m_FileDescriptor;
+        }
+#endif
+
+    private:
+        ArchiveFile() = default;
+
+        const uint8_t* m_Data = nullptr;
+        uint64_t m_Size = 0;
+
+#ifdef _WIN32
+        void* m_FileHandle = nullptr;
+        void* m_MappingHandle = nullptr;
+#else
+        int m_FileDescriptor = -1;
+#endif
+    };
+}
@@ -1,9 +1,25 @@
 #pragma once
 
-#include <map>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <span>
 
 #include <rpflib/archive.h>
+#include <rpflib/archive_file.h>
+#include <rpflib/async_reader.h>
+#include <rpflib/compression_policy.h>
+#include <rpflib/crypto.h>
+#include <rpflib/entry_cache.h>
+#include <rpflib/entry_index.h>
 #include <rpflib/entry_node.h>
+#include <rpflib/entry_reader.h>
+#include <rpflib/entry_source.h>
+#include <rpflib/name_heap_builder.h>
+#include <rpflib/output_file.h>
+#include <rpflib/stats.h>
 
 namespace rpflib
 {
@@ -83,37 +99,238 @@ namespace rpflib
         {
             return m_EntrySize == 0 ? m_FileEntry.m_RealSize : m_EntrySize;
         }
+        // resources of MAX_FILE_SIZE bytes or more keep their real size in the RSC7 header, see RPF7Archive::GetEntryStoredSize
+        [[nodiscard]] bool HasSaturatedSize() const
+        {
+            return IsResource() && m_EntrySize == MAX_FILE_SIZE;
+        }
+
+        [[nodiscard]] uint32_t GetResourceVersion() const
+        {
+            return ((m_ResourceEntry.m_VirtualFlags >> 28) & 0xF) | (((m_ResourceEntry.m_PhysicalFlags >> 28) & 0xF) << 4);
+        }
+        [[nodiscard]] uint64_t GetVirtualSize() const
+        {
+            return GetSizeFromFlags(m_ResourceEntry.m_VirtualFlags);
+        }
+        [[nodiscard]] uint64_t GetPhysicalSize() const
+        {
+            return GetSizeFromFlags(m_ResourceEntry.m_PhysicalFlags);
+        }
+
+        // Segment size encoded in resource flags, a page size shift in the low 4 bits and page counts for nine
+        // page sizes above it.
+        static uint64_t GetSizeFromFlags(uint32_t flags)
+        {
+            uint64_t pageCount = ((flags >> 27) & 0x1) << 0;
+            pageCount += ((flags >> 26) & 0x1) << 1;
+            pageCount += ((flags >> 25) & 0x1) << 2;
+            pageCount += ((flags >> 24) & 0x1) << 3;
+            pageCount += ((flags >> 17) & 0x7F) << 4;
+            pageCount += ((flags >> 11) & 0x3F) << 5;
+            pageCount += ((flags >> 7) & 0xF) << 6;
+            pageCount += ((flags >> 5) & 0x3) << 7;
+            pageCount += ((flags >> 4) & 0x1) << 8;
+
+            return (static_cast<uint64_t>(BLOCK_SIZE) << (flags & 0xF)) * pageCount;
+        }
+    };
+
+    struct RSC7Header
+    {
+        uint32_t m_Magic;
+        uint32_t m_Version;
+        uint32_t m_VirtualFlags;
+        uint32_t m_PhysicalFlags;
     };
 #pragma pack(pop)
 
+    struct RPF7ResourceInfo
+    {
+        uint32_t m_Version = 0;
+        uint64_t m_VirtualSize = 0;
+        uint64_t m_PhysicalSize = 0;
+        // size of the resource in the archive including its RSC7 header
+        uint64_t m_StoredSize = 0;
+    };
+
+    struct RPF7OpenOptions
+    {
+        // maps the whole archive once and serves reads straight from the mapping
+        bool m_MemoryMapped = false;
+        // only loads the header, entry table and name heap on open, paths are resolved by walking the directory
+        // ranges and every directory is indexed the first time a lookup passes through it
+        bool m_LazyIndex = false;
+        // keeps up to this many bytes of decompressed entries around for repeated reads, 0 disables the cache
+        uint64_t m_CacheBudget = 0;
+        // required for ENCRYPTION_AES and ENCRYPTION_NG archives, shared with nested archives
+        std::shared_ptr<const RPF7Keys> m_Keys;
+        // Directory of index files that hold the decoded table of contents and the prebuilt path index, so a later
+        // open only maps a file. An index file is used while the archive size, modification time and header match and
+        // rewritten otherwise, empty disables them. Index files of encrypted archives hold the decrypted names.
+        std::filesystem::path m_IndexCacheDirectory;
+        // counts STAT_COUNTER_SEEKS, every read then updates the end of the last read which all readers of the archive share
+        bool m_CountSeeks = false;
+    };
+
+    struct RPF7WriteOptions
+    {
+        // 0 uses one worker per hardware thread
+        uint32_t m_ThreadCount = 0;
+        // upper bound for entry data that is read or compressed but not yet written, at least one entry is always in flight
+        uint64_t m_MaxInFlightBytes = 256ull * 1024 * 1024;
+        // CompressionPolicy::Fast() trades archive size for pack time
+        CompressionPolicy m_CompressionPolicy = CompressionPolicy::Default();
+        // entries with byte-identical content point at the data of the first copy instead of being compressed and
+        // written again, identical content is detected by a 128 bit hash
+        bool m_Deduplicate = false;
+        // prints the number of deduplicated entries and the bytes they saved once the entry data is written
+        bool m_ReportDeduplication = false;
+        // entry data is gathered in an aligned buffer of this size before it is written, larger entries are written
+        // straight from their own memory
+        uint64_t m_WriteBufferSize = 4ull * 1024 * 1024;
+    };
+
+    struct RPF7BatchReadOptions
+    {
+        // entries at most this many bytes apart are fetched with one read, the bytes in between are discarded
+        uint64_t m_MaxGapBytes = 64 * 1024;
+        // upper bound for a single coalesced read, a larger entry is still read in one piece
+        uint64_t m_MaxReadBytes = 16ull * 1024 * 1024;
+        // upper bound for read data that is not yet decompressed, at least one read is always in flight
+        uint64_t m_MaxInFlightBytes = 128ull * 1024 * 1024;
+        // 0 uses one worker per hardware thread
+        uint32_t m_ThreadCount = 0;
+    };
+
+    struct RPF7ExtractOptions
+    {
+        // 0 uses one worker per hardware thread
+        uint32_t m_ThreadCount = 0;
+    };
+
     class RPF7Archive : public IRPFArchive
     {
     public:
         static const uint32_t IDENT = 0x52504637;
         static const uint32_t RESOURCE_IDENT = 0x37435352;
 
+        typedef std::function<bool(const std::string& entryPath)> EntryFilter;
+        typedef std::function<void(EntryDataBuffer&& entryData, bool isSuccess)> EntryDataCallback;
+
         ~RPF7Archive() final;
 
-        static std::unique_ptr<RPF7Archive> OpenArchive(const std::filesystem::path& archivePath)
+        // The entry index is immutable once OpenArchive returns and all reads are positional, so GetEntryData,
+        // GetEntryView, SaveEntryToPath and DoesEntryExists can be called from any number of threads at once.
+        static std::unique_ptr<RPF7Archive> OpenArchive(const std::filesystem::path& archivePath, const RPF7OpenOptions& options = {})
+        {
+            return std::unique_ptr<RPF7Archive>(new RPF7Archive(archivePath, options));
+        }
+
+        static std::unique_ptr<RPF7Archive> CreateArchive(const std::filesystem::path& outputFile, int nameShift = 0, const RPF7WriteOptions& options = {})
         {
-            return std::unique_ptr<RPF7Archive>(new RPF7Archive(archivePath, OpenMode::OPEN_MODE_READ));
+            return std::unique_ptr<RPF7Archive>(new RPF7Archive(outputFile, OpenMode::OPEN_MODE_WRITE, nameShift, options));
         }
 
-        static std::unique_ptr<RPF7Archive> CreateArchive(const std::filesystem::path& outputFile, int nameShift = 0)
+        // Opens an existing archive for modification. Added entries replace existing ones with the same path, their
+        // data goes into free block runs or is appended, and only the entry table and name heap are rewritten when
+        // the archive is closed. Reads return the archive as it was opened until then. Space freed by removed and
+        // replaced entries is only reused by a later update, so the old entry table stays valid until the new one
+        // is written.
+        static std::unique_ptr<RPF7Archive> UpdateArchive(const std::filesystem::path& archivePath, const RPF7WriteOptions& options = {})
         {
-            return std::unique_ptr<RPF7Archive>(new RPF7Archive(outputFile, OpenMode::OPEN_MODE_WRITE, nameShift));
+            return std::unique_ptr<RPF7Archive>(new RPF7Archive(archivePath, OpenMode::OPEN_MODE_UPDATE, 0, options));
         }
 
-        void CloseArchive() override;
+        // Writes a created or updated archive, returns false if that failed. An update that fails while writing entry
+        // data leaves the archive as it was opened, a created archive that fails is left empty.
+        bool CloseArchive() override;
 
         void AddEntry(const std::filesystem::path& entryPath, const std::filesystem::path& entryFilePath) override;
+        void AddEntry(const std::filesystem::path& entryPath, EntryDataBuffer&& entryData);
+        // entryData has to stay valid until the archive is closed
+        void AddEntry(const std::filesystem::path& entryPath, std::span<const uint8_t> entryData);
+        void AddEntry(const std::filesystem::path& entryPath, uint64_t entrySize, EntrySource::ReadCallback entryReader);
+        void AddEntry(const std::filesystem::path& entryPath, const EntrySource& entrySource);
+        // Removes a file or a whole directory, the freed blocks are reused by entries added afterwards.
+        bool RemoveEntry(const std::string& entryPath);
         EntryDataBuffer GetEntryData(const std::string& entryPath) override;
         EntryPathList GetEntryList() override;
         bool SaveEntryToPath(const std::string& entryPath, const std::filesystem::path& outputPath) override;
         bool DoesEntryExists(const std::string& entryPath) override;
 
+        // Path lookups are case-insensitive and accept both '/' and '\' separators, the leading separator is optional and
+        // repeated ones count as one.
+        [[nodiscard]] const RPF7Entry* FindEntry(std::string_view entryPath) const;
+        // entryPathHash is EntryIndex::GetPathHash of the full entry path, e.g. joaat("/x64/data/file.ymap")
+        [[nodiscard]] const RPF7Entry* FindEntry(uint32_t entryPathHash) const;
+        // Full path index of every file entry, built on first use even in lazy index mode. The entry indices of its
+        // items point into GetEntries().
+        [[nodiscard]] const EntryIndex& GetEntryIndex() const
+        {
+            EnsureEntryIndex();
+            return m_EntryIndex;
+        }
+        // empty if the archive could not be opened
+        [[nodiscard]] const std::vector<RPF7Entry>& GetEntries() const
+        {
+            return m_Entries;
+        }
+        EntryDataBuffer GetEntryData(const RPF7Entry& entry);
+        // Reads many entries at once. The requests are sorted by offset and nearby entries are merged into large
+        // sequential reads, the results are decompressed in parallel and returned in the order of entryPaths.
+        // Missing entries are returned as empty buffers.
+        std::vector<EntryDataBuffer> GetEntriesData(const std::vector<std::string>& entryPaths, const RPF7BatchReadOptions& options = {});
+
+        // Size of the entry data in the archive, the real size of resources with a saturated size field is read from
+        // their header.
+        [[nodiscard]] uint64_t GetEntryStoredSize(const RPF7Entry& entry) const;
+
+        // Returns false if the entry is not a resource.
+        bool GetResourceInfo(const RPF7Entry& entry, RPF7ResourceInfo& info) const;
+        // Inflates the body of a resource straight into the caller's segment buffers, which have to hold at least
+        // m_VirtualSize and m_PhysicalSize bytes.
+        bool GetResourceData(const RPF7Entry& entry, std::span<uint8_t> virtualData, std::span<uint8_t> physicalData);
+        // Resizes the buffers to the segment sizes, buffers that are reused between calls keep their capacity.
+        bool GetResourceData(const std::string& entryPath, EntryDataBuffer& virtualData, EntryDataBuffer& physicalData);
+
+        // Returns the decompressed entry as a shared buffer. With a cache budget set, repeated reads of the same entry
+        // return the cached buffer without copying or decoding it again.
+        std::shared_ptr<const EntryDataBuffer> GetSharedEntryData(const std::string& entryPath);
+        std::shared_ptr<const EntryDataBuffer> GetSharedEntryData(const RPF7Entry& entry);
+        [[nodiscard]] EntryCache::Stats GetCacheStats() const;
+
+        // Reads and decompresses the entry without blocking the caller, callback runs on a worker thread of asyncReader.
+        // Missing entries call back right away with isSuccess false. The archive has to outlive every pending request.
+        void GetEntryDataAsync(const std::string& entryPath, EntryDataCallback callback, AsyncReader& asyncReader = AsyncReader::GetDefault());
+        // The future holds an empty buffer if the entry could not be read.
+        std::future<EntryDataBuffer> GetEntryDataAsync(const std::string& entryPath, AsyncReader& asyncReader = AsyncReader::GetDefault());
+
+        // Stored entries of a memory mapped archive are returned as a view into the mapping without copying,
+        // everything else is decoded into fallbackBuffer and the returned span points into it.
+        std::span<const uint8_t> GetEntryView(const std::string& entryPath, EntryDataBuffer& fallbackBuffer);
+
+        // Opens a sequential reader that decodes the entry incrementally, returns nullptr if the entry does not exist.
+        // The data matches GetEntryData, large resources included.
+        std::unique_ptr<EntryReader> OpenEntryStream(const std::string& entryPath);
+        // Reader source that streams the entry the way GetEntryData returns it, for copying entries into an archive
+        // that is being written without holding them in memory. This archive has to outlive the written archive.
+        EntrySource OpenEntrySource(const std::string& entryPath);
+
+        // Opens an archive stored inside this one in place. The nested archive shares this archive's file handle
+        // and mapping, reads only its own byte range and can itself open further nested archives.
+        std::unique_ptr<RPF7Archive> OpenNestedArchive(const std::string& entryPath);
+
+        // Extracts entries in on-disk order on a work-stealing thread pool, returns the number of written files. Entries that
+        // fail to read or whose path would leave outputDirectory are skipped and not counted.
+        uint64_t ExtractAll(const std::filesystem::path& outputDirectory, const RPF7ExtractOptions& options = {});
+        uint64_t ExtractAll(const std::filesystem::path& outputDirectory, const EntryFilter& filter, const RPF7ExtractOptions& options = {});
+
         static EntryDataBuffer CompressData(uint8_t* data, uint64_t dataLength);
+        // Raw deflate with the given zlib level and strategy, returns an empty buffer on failure.
+        static EntryDataBuffer CompressData(std::span<const uint8_t> data, int level, int strategy);
         static EntryDataBuffer DecompressData(uint8_t* data, uint64_t dataLength);
+        static uint64_t DecompressData(const uint8_t* data, uint64_t dataLength, uint8_t* output, uint64_t outputLength);
         static std::filesystem::path CorrectEntryPath(const std::filesystem::path& entryPath);
         static EntryDataBuffer GetFileData(const std::filesystem::path& filePath);
         static uint64_t GetFileSize(const std::filesystem::path& filePath);
@@ -125,12 +342,25 @@ namespace rpflib
         {
             return ((dataSize + 511) / 512) * 512;
         }
-        static void PrintEntryTree(EntryNode<RPF7Entry>* parent, uint16_t&& level = 0);
+        static void PrintEntryTree(const EntryNodeTree<RPF7Entry>& tree, uint32_t nodeIndex = EntryNodeTree<RPF7Entry>::ROOT_NODE, uint16_t level = 0);
 
         uint64_t GetEntryNodeTotalCount();
-        EntryNode<RPF7Entry>* GetRootEntryNode()
+        EntryNodeTree<RPF7Entry>& GetEntryNodeTree()
         {
-            return &m_RootNode;
+            EnsureEntryIndex();
+            EnsureNodeTree();
+            return m_NodeTree;
+        }
+
+        // Counters and latency histograms of this archive, everything is also counted in ArchiveStats::GetGlobal().
+        [[nodiscard]] const ArchiveStats& GetStats() const
+        {
+            return m_Stats;
+        }
+
+        [[nodiscard]] EncryptionType GetEncryption() const
+        {
+            return m_Header.m_Encryption;
         }
 
         int GetNameShift() const
@@ -143,39 +373,112 @@ namespace rpflib
         }
 
     private:
-        RPF7Archive(const std::filesystem::path& archivePath, OpenMode openMode, int nameShift = 0);
+        RPF7Archive(const std::filesystem::path& archivePath, OpenMode openMode, int nameShift = 0, const RPF7WriteOptions& writeOptions = {});
+        RPF7Archive(const std::filesystem::path& archivePath, const RPF7OpenOptions& options);
+        RPF7Archive(const std::filesystem::path& archivePath, std::shared_ptr<ArchiveFile> archiveFile, uint64_t baseOffset, uint64_t archiveSize, const RPF7OpenOptions& options);
 
         void OpenArchive() override;
         void CreateArchive() override;
+        void ReadArchive();
+
+        [[nodiscard]] bool IsOpen() const
+        {
+            return m_ArchiveFile != nullptr || m_OutputFile != nullptr;
+        }
+        bool ReadArchiveData(uint64_t offset, void* buffer, uint64_t size) const;
+        // Returns a view into the mapping, readBuffer or outputBuffer so callers can reuse both buffers between reads.
+        std::span<const uint8_t> ReadEntryData(const RPF7Entry& entry, EntryDataBuffer& readBuffer, EntryDataBuffer& outputBuffer) const;
 
         void ReadHeader(RPF7Header& header);
+        bool SetupDecryption();
+        // whole 16 byte blocks are decrypted in place, name and length select the NG key
+        void DecryptData(uint8_t* data, uint64_t size, std::string_view name, uint64_t length) const;
+        [[nodiscard]] bool IsEntryEncrypted(const RPF7Entry& entry) const;
+        // data holds size bytes of the stored entry starting at storedOffset, which has to be block aligned
+        void DecryptEntryData(const RPF7Entry& entry, uint8_t* data, uint64_t storedOffset, uint64_t size) const;
         void ReadNames();
         void ReadEntries();
+        [[nodiscard]] bool IsIndexFileEnabled() const;
+        // takes the entry table, name heap and path index from the index file if it matches the archive
+        bool LoadIndexFile();
+        void WriteIndexFile();
 
-        void WriteHeader();
-        void WriteEntries();
-        void WriteNames();
-        void WriteEntriesData();
+        // The table of contents has a known size once every entry is added, so the entry data is written right
+        // behind it in one pass and the table itself once at the end.
+        bool WriteArchive();
+        // header, entry table and name heap with a single write at the start of the file
+        bool WriteTableOfContents();
+        // allocateBlocks returns the first block of a run of blockCount free blocks
+        typedef std::function<uint64_t(uint64_t blockCount)> BlockAllocator;
+        bool WriteEntriesData(const BlockAllocator& allocateBlocks, const std::vector<uint32_t>& relocatedNodes);
+        bool CommitUpdate();
 
         RPF7Entry CreateDirectoryEntry();
-        RPF7Entry CreateFileEntry(const std::filesystem::path& path);
-        bool IsFileAResource(const std::filesystem::path& path, uint32_t& virtualFlags, uint32_t& physicalFlags);
+        RPF7Entry CreateFileEntry(const EntrySource& source);
+        bool IsFileAResource(const EntrySource& source, uint32_t& virtualFlags, uint32_t& physicalFlags);
+
+        void EnsureEntryIndex() const;
+        // the tree is built together with the index unless the index came from an index file
+        void EnsureNodeTree() const;
+        const EntryIndex* GetDirectoryIndex(uint32_t directoryIndex) const;
+        uint32_t ResolveEntryPath(std::string_view entryPath) const;
 
-        void BuildEntryMapAndNodeTree(const RPF7Entry& parentEntry, EntryNode<RPF7Entry>* parentNode, std::vector<std::string>&& pathStack = std::vector<std::string>());
+        void BuildEntryMapAndNodeTree(const RPF7Entry& parentEntry, uint32_t parentNode, std::string& parentPath, bool isIndexing = true);
         std::vector<RPF7Entry> BuildEntriesListFromNodeTree();
-        std::map<uint32_t, std::string> BuildEntriesNameMap();
+        void BuildNameHeap();
 
         [[nodiscard]] std::string GetEntryName(uint32_t index);
         [[nodiscard]] std::string GetEntryName(const RPF7Entry& entry);
-        [[nodiscard]] uint32_t GetEntryNameOffset(const std::string& entryName);
+        [[nodiscard]] std::string_view GetEntryNameView(uint32_t index) const;
+        [[nodiscard]] std::string_view GetEntryNameView(const RPF7Entry& entry) const;
+        [[nodiscard]] uint32_t GetEntryNameOffset(std::string_view entryName);
+        [[nodiscard]] static bool HasExtension(std::string_view entryName);
+
+        // the size of large resources is spread over bytes 2, 5, 7 and 14 of their RSC7 header
+        static uint64_t GetResourceSizeFromHeader(const uint8_t* header);
+        static void SetResourceSizeInHeader(uint8_t* header, uint64_t size);
+        static void RestoreResourceHeader(const RPF7Entry& entry, uint8_t* header);
+
+        RPF7OpenOptions m_OpenOptions;
+        RPF7WriteOptions m_WriteOptions;
+        std::shared_ptr<ArchiveFile> m_ArchiveFile;
+        // write and update mode only
+        std::unique_ptr<OutputFile> m_OutputFile;
+        // byte range of this archive inside m_ArchiveFile, nested archives start past 0
+        uint64_t m_BaseOffset = 0;
+        uint64_t m_ArchiveSize = 0;
 
         RPF7Header m_Header;
-        EntryNode<RPF7Entry> m_RootNode;
+        struct PendingEntry
+        {
+            std::string m_EntryPath;
+            EntrySource m_Source;
+        };
+
+        EntryNodeTree<RPF7Entry> m_NodeTree;
+        // write mode only, referenced by EntryNode::m_DataIndex
+        std::vector<PendingEntry> m_PendingEntries;
         std::vector<RPF7Entry> m_Entries;
-        std::map<uint32_t, std::string> m_NameMap;
-        std::map<std::string, const RPF7Entry*> m_EntryMap;
+        NameHeapBuilder m_NameHeapBuilder;
+        std::vector<char> m_NameHeap;
+
+        EntryIndex m_EntryIndex;
+        std::unique_ptr<EntryCache> m_EntryCache;
+        std::unique_ptr<AesDecryptor> m_AesDecryptor;
+        std::unique_ptr<NgDecryptor> m_NgDecryptor;
+        mutable std::once_flag m_EntryIndexOnce;
+        mutable std::once_flag m_NodeTreeOnce;
+        mutable std::atomic<bool> m_IsEntryIndexBuilt = false;
+
+        // lazy mode only, indexed by entry index and filled for directories on first use
+        mutable std::vector<std::unique_ptr<EntryIndex>> m_DirectoryIndices;
+        std::unique_ptr<std::once_flag[]> m_DirectoryIndexOnce;
 
         int m_NameShift;
         uint32_t m_NameHeapMaxSize;
+
+        mutable ArchiveStats m_Stats;
+        // end of the last read, used to count reads that are not sequential with RPF7OpenOptions::m_CountSeeks
+        mutable std::atomic<uint64_t> m_LastReadEnd = 0;
     };
 } // namespace rpflib
\ No newline at end of file
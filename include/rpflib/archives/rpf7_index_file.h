@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include <rpflib/archive_file.h>
+#include <rpflib/archives/rpf7.h>
+#include <rpflib/entry_index.h>
+
+namespace rpflib
+{
+    // Persisted table of contents of an archive: the decoded entry table, the name heap and the prebuilt path index,
+    // each in a 16 byte aligned section so the file can be mapped and used without any parsing.
+    class RPF7IndexFile
+    {
+    public:
+        static constexpr uint32_t IDENT = 0x49465052; // "RPFI"
+        static constexpr uint32_t VERSION = 2;
+        static constexpr uint32_t SECTION_ALIGNMENT = 16;
+
+        // identifies the archive an index file was built from
+        struct Key
+        {
+            uint64_t m_ArchiveSize = 0;
+            int64_t m_ArchiveTime = 0;
+            uint32_t m_HeaderChecksum = 0;
+        };
+
+        struct Header
+        {
+            uint32_t m_Magic;
+            uint32_t m_Version;
+            uint64_t m_ArchiveSize;
+            int64_t m_ArchiveTime;
+            uint32_t m_HeaderChecksum;
+            uint32_t m_EntryCount;
+            uint32_t m_NameHeapSize;
+            uint32_t m_SlotCount;
+            uint32_t m_ItemCount;
+            uint32_t m_PathDataSize;
+            // crc32 of this header with m_Checksum set to 0
+            uint32_t m_Checksum;
+            // crc32 of every section following the header, padding included
+            uint32_t m_DataChecksum;
+            uint32_t m_Reserved[2];
+        };
+
+        // Returns a key with m_ArchiveSize 0 if the archive can not be inspected.
+        static Key GetKey(const std::filesystem::path& archivePath, const RPF7Header& archiveHeader);
+        // One file per archive path, archives with the same name in different directories do not collide.
+        static std::filesystem::path GetIndexPath(const std::filesystem::path& cacheDirectory, const std::filesystem::path& archivePath);
+
+        // Writes to a temporary file first and renames it, so readers never see a partial index.
+        static bool Write(const std::filesystem::path& indexPath, const Key& key, std::span<const RPF7Entry> entries, std::span<const char> nameHeap,
+                          const EntryIndex& entryIndex);
+        // Maps the index file, returns nullptr if it is missing, damaged or was built from a different archive. The
+        // sections are checked against their checksum, the entries themselves are validated by the archive.
+        static std::unique_ptr<RPF7IndexFile> Open(const std::filesystem::path& indexPath, const Key& key);
+
+        [[nodiscard]] std::span<const RPF7Entry> GetEntries() const;
+        [[nodiscard]] std::span<const char> GetNameHeap() const;
+        [[nodiscard]] std::span<const EntryIndex::Slot> GetSlots() const;
+        [[nodiscard]] std::span<const EntryIndex::Item> GetItems() const;
+        [[nodiscard]] std::string_view GetPathData() const;
+
+    private:
+        struct Layout
+        {
+            uint64_t m_EntriesOffset;
+            uint64_t m_SlotsOffset;
+            uint64_t m_ItemsOffset;
+            uint64_t m_NameHeapOffset;
+            uint64_t m_PathDataOffset;
+            uint64_t m_FileSize;
+        };
+
+        RPF7IndexFile() = default;
+
+        static Layout GetLayout(const Header& header);
+        static uint32_t GetHeaderChecksum(Header header);
+        static uint32_t GetDataChecksum(std::span<const uint8_t> fileData);
+
+        std::shared_ptr<ArchiveFile> m_File;
+        // holds the file if it could not be mapped
+        std::vector<uint8_t> m_FileData;
+        std::span<const uint8_t> m_Data;
+        Header m_Header = {};
+        Layout m_Layout = {};
+    };
+}
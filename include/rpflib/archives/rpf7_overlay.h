@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <rpflib/archives/rpf7.h>
+#include <rpflib/entry_index.h>
+
+namespace rpflib
+{
+    struct RPF7MountRequest
+    {
+        std::filesystem::path m_ArchivePath;
+        // prepended to every entry path of the archive, e.g. "/update" makes "/x64/a.ymap" resolve as "/update/x64/a.ymap"
+        // mount points are normalized like entry paths, "update", "update/" and "\\update" all mount at "/update"
+        std::string m_MountPoint;
+        // entries of higher priority mounts shadow entries with the same path, ties go to the most recent mount
+        int32_t m_Priority = 0;
+    };
+
+    struct RPF7OverlayOptions
+    {
+        // used for every archive opened by the overlay
+        RPF7OpenOptions m_OpenOptions;
+        // 0 uses one worker per hardware thread
+        uint32_t m_ThreadCount = 0;
+    };
+
+    // Entry a path resolved to, keeps its archive alive even if it is unmounted in the meantime.
+    struct RPF7OverlayEntry
+    {
+        std::shared_ptr<RPF7Archive> m_Archive;
+        const RPF7Entry* m_Entry = nullptr;
+        uint32_t m_MountId = 0;
+
+        explicit operator bool() const
+        {
+            return m_Entry != nullptr;
+        }
+    };
+
+    // Mounts any number of archives into one namespace. The file entries of all mounts are merged into a single
+    // index in which every path maps to the entry of the highest priority mount, so a lookup is one probe no matter
+    // how many archives are mounted. Mounting and unmounting rebuild the merged index and swap it in, lookups may
+    // run on any number of threads meanwhile.
+    class RPF7Overlay
+    {
+    public:
+        static constexpr uint32_t INVALID_MOUNT = 0;
+
+        typedef IRPFArchive::EntryDataBuffer EntryDataBuffer;
+        typedef IRPFArchive::EntryPathList EntryPathList;
+
+        explicit RPF7Overlay(const RPF7OverlayOptions& options = {});
+
+        RPF7Overlay(const RPF7Overlay&) = delete;
+        RPF7Overlay& operator=(const RPF7Overlay&) = delete;
+
+        // Opens and indexes the archives in parallel and merges them with a single rebuild. Returns the mount id of
+        // every request in order, INVALID_MOUNT for archives that could not be opened.
+        std::vector<uint32_t> Mount(const std::vector<RPF7MountRequest>& requests);
+        uint32_t Mount(const RPF7MountRequest& request);
+        // Mounts an archive that is already open, e.g. one returned by OpenNestedArchive.
+        uint32_t Mount(std::shared_ptr<RPF7Archive> archive, std::string_view mountPoint, int32_t priority = 0);
+        bool Unmount(uint32_t mountId);
+        void UnmountAll();
+
+        // Path lookups are case-insensitive and accept both '/' and '\' separators.
+        [[nodiscard]] RPF7OverlayEntry FindEntry(std::string_view entryPath) const;
+        // entryPathHash is EntryIndex::GetPathHash of the full overlay path
+        [[nodiscard]] RPF7OverlayEntry FindEntry(uint32_t entryPathHash) const;
+        [[nodiscard]] bool DoesEntryExists(std::string_view entryPath) const;
+        // Returns an empty buffer if no mount has the entry.
+        EntryDataBuffer GetEntryData(std::string_view entryPath) const;
+        // Sorted overlay paths of every visible entry.
+        [[nodiscard]] EntryPathList GetEntryList() const;
+
+        [[nodiscard]] uint32_t GetMountCount() const;
+        [[nodiscard]] uint32_t GetEntryCount() const;
+        // nullptr if the mount does not exist
+        [[nodiscard]] std::shared_ptr<RPF7Archive> GetMountedArchive(uint32_t mountId) const;
+
+    private:
+        struct MountedArchive
+        {
+            uint32_t m_MountId;
+            std::shared_ptr<RPF7Archive> m_Archive;
+            std::string m_MountPoint;
+            int32_t m_Priority;
+        };
+
+        // what an item of the merged index points at
+        struct OverlayTarget
+        {
+            uint32_t m_MountIndex;
+            uint32_t m_EntryIndex;
+        };
+
+        struct MergedIndex
+        {
+            std::vector<MountedArchive> m_Mounts;
+            EntryIndex m_EntryIndex;
+            std::vector<OverlayTarget> m_Targets;
+        };
+
+        static std::string GetMountPoint(std::string_view mountPoint);
+        // builds the index of mounts and publishes it, expects m_MountMutex to be held
+        void RebuildIndex(std::vector<MountedArchive> mounts);
+        static RPF7OverlayEntry GetOverlayEntry(const MergedIndex& index, uint32_t targetIndex);
+
+        RPF7OverlayOptions m_Options;
+
+        // serializes mounting and unmounting, lookups never take it
+        std::mutex m_MountMutex;
+        uint32_t m_NextMountId = 1;
+
+        mutable std::shared_mutex m_IndexMutex;
+        std::shared_ptr<const MergedIndex> m_Index;
+    };
+}
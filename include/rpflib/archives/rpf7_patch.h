@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <rpflib/archive_file.h>
+#include <rpflib/archives/rpf7.h>
+#include <rpflib/compression_policy.h>
+#include <rpflib/content_hash.h>
+
+namespace rpflib
+{
+    struct RPF7PatchCreateOptions
+    {
+        // 0 uses one worker per hardware thread
+        uint32_t m_ThreadCount = 0;
+        // upper bound for payloads that are read or compressed but not yet written, at least one payload is always in flight
+        uint64_t m_MaxInFlightBytes = 256ull * 1024 * 1024;
+        // decides how the payloads of added and changed entries are deflated
+        CompressionPolicy m_CompressionPolicy = CompressionPolicy::Default();
+    };
+
+    struct RPF7PatchApplyOptions
+    {
+        // used to read the archive, keys of encrypted archives go here
+        RPF7OpenOptions m_OpenOptions;
+        RPF7WriteOptions m_WriteOptions;
+        // rewrites the whole archive even if it could be updated in place
+        bool m_ForceRewrite = false;
+    };
+
+    struct RPF7PatchSummary
+    {
+        uint32_t m_AddedCount = 0;
+        uint32_t m_ChangedCount = 0;
+        uint32_t m_RemovedCount = 0;
+        // operations whose result the archive already had
+        uint32_t m_SkippedCount = 0;
+        // entry data carried by the patch before deflating
+        uint64_t m_PayloadBytes = 0;
+        bool m_IsRewritten = false;
+    };
+
+    // Differences between two archives at entry level. A patch holds the removed paths and the added and changed entries
+    // with their data, every operation carries the content hash of the entry it expects and of the entry it produces so
+    // a patch is only applied to the archive it was created from.
+    class RPF7Patch
+    {
+    public:
+        static constexpr uint32_t IDENT = 0x50465052; // "RPFP"
+        static constexpr uint32_t VERSION = 1;
+
+        enum OperationType : uint32_t
+        {
+            OPERATION_ADD = 0,
+            OPERATION_CHANGE,
+            OPERATION_REMOVE
+        };
+
+#pragma pack(push, 1)
+        struct Header
+        {
+            uint32_t m_Magic;
+            uint32_t m_Version;
+            uint32_t m_OperationCount;
+            int32_t m_NameShift;
+            uint64_t m_Reserved;
+        };
+
+        // followed by m_PathLength bytes of path and m_PayloadSize bytes of payload
+        struct OperationHeader
+        {
+            OperationType m_Type;
+            uint32_t m_PathLength;
+            // size of the entry data the payload decodes to
+            uint64_t m_Size;
+            uint64_t m_PayloadSize;
+            uint32_t m_IsCompressed;
+            uint32_t m_Reserved;
+            // content of the entry in the old archive, zero for added entries
+            ContentHash m_BaseHash;
+            // content of the entry in the new archive, zero for removed entries
+            ContentHash m_ContentHash;
+        };
+#pragma pack(pop)
+
+        // Compares every file entry of both archives by content hash and writes a patch that turns oldArchive into
+        // newArchive. Entries are hashed in parallel and payloads are streamed to the patch a window at a time.
+        static bool Create(RPF7Archive& oldArchive, RPF7Archive& newArchive, const std::filesystem::path& patchPath,
+                           const RPF7PatchCreateOptions& options = {}, RPF7PatchSummary* summary = nullptr);
+
+        // Checks the entries the patch touches against their base hashes first and leaves the archive untouched on a
+        // mismatch. The archive is then updated in place, so only the changed entries are written along with the entry
+        // table and name heap. Encrypted archives can not be updated and are rewritten by streaming every entry into a
+        // new, unencrypted archive that replaces the old one. Payloads are checked against their content hash as they
+        // are written, if one does not match or anything fails to write the archive is left as it was.
+        static bool Apply(const std::filesystem::path& archivePath, const std::filesystem::path& patchPath, const RPF7PatchApplyOptions& options = {},
+                          RPF7PatchSummary* summary = nullptr);
+
+    private:
+        struct Operation
+        {
+            OperationHeader m_Header;
+            std::string m_Path;
+            uint64_t m_PayloadOffset;
+        };
+
+        static bool ReadOperations(const ArchiveFile& patchFile, Header& header, std::vector<Operation>& operations);
+        static EntrySource OpenPayloadSource(const std::shared_ptr<ArchiveFile>& patchFile, const Operation& operation);
+        // nameShift is the one of the archive the patch was created from
+        static bool RewriteArchive(const std::filesystem::path& archivePath, std::unique_ptr<RPF7Archive> archive, int nameShift,
+                                   const std::shared_ptr<ArchiveFile>& patchFile, const std::vector<const Operation*>& operations,
+                                   const RPF7PatchApplyOptions& options);
+    };
+}
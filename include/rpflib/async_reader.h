@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <rpflib/archive_file.h>
+#include <rpflib/thread_pool.h>
+
+namespace rpflib
+{
+    // Positional reads that complete on a worker thread. On Linux the reads are queued to an io_uring and a single
+    // completion thread hands finished reads to the worker pool, so a few threads keep deep I/O queues busy across
+    // any number of archives. Without io_uring, or if the kernel refuses to set one up, the workers run blocking
+    // reads instead. The same happens to the reads in flight and every later read if the ring fails while in use.
+    class AsyncReader
+    {
+    public:
+        typedef std::function<void(bool isSuccess)> ReadCallback;
+        typedef std::function<void()> Task;
+
+        // queueDepth bounds the reads in flight, workerThreadCount 0 uses std::thread::hardware_concurrency
+        explicit AsyncReader(uint32_t queueDepth = 256, uint32_t workerThreadCount = 0);
+        // Waits for every queued read and callback to finish.
+        ~AsyncReader();
+
+        AsyncReader(const AsyncReader&) = delete;
+        AsyncReader& operator=(const AsyncReader&) = delete;
+
+        // Process wide reader used when no reader is passed explicitly.
+        static AsyncReader& GetDefault();
+
+        // Reads size bytes at offset into buffer and runs callback on a worker thread. file and buffer have to stay
+        // valid until callback is called, file is kept alive by the reader.
+        void Read(std::shared_ptr<ArchiveFile> file, uint64_t offset, void* buffer, uint64_t size, ReadCallback callback);
+        // Runs task on a worker thread, used for work that needs no I/O.
+        void Submit(Task task);
+
+        [[nodiscard]] bool IsUsingIoUring() const
+        {
+            return m_Ring != nullptr && !m_IsRingFailed.load(std::memory_order_relaxed);
+        }
+
+    private:
+        struct Request;
+        struct IoUring;
+
+        bool SetupRing(uint32_t queueDepth);
+        // request nullptr queues a no-op that stops the completion thread
+        bool PushSubmission(Request* request);
+        void CompletionLoop();
+        // hands every read in flight to the workers, called by the completion thread before it exits on an error
+        void AbandonRing();
+        void ReleaseQueueSlot(Request* request);
+        void ReadOnWorker(Request* request);
+        void FinishRequest(Request* request, bool isSuccess);
+
+        ThreadPool m_WorkerPool;
+        std::unique_ptr<IoUring> m_Ring;
+        std::thread m_CompletionThread;
+
+        std::mutex m_StateMutex;
+        std::condition_variable m_StateChanged;
+        uint32_t m_QueueDepth = 0;
+        // reads currently owning a slot of the ring, linked through Request::m_Next
+        uint32_t m_InFlightCount = 0;
+        Request* m_InFlightRequests = nullptr;
+        std::atomic<bool> m_IsRingFailed = false;
+        // reads whose callback has not returned yet
+        uint64_t m_PendingCount = 0;
+    };
+}
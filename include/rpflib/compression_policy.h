@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace rpflib
+{
+    struct CompressionSettings
+    {
+        // zlib compression level, 0 stores entries uncompressed
+        int m_Level = 9;
+        // zlib strategy, e.g. Z_DEFAULT_STRATEGY (0), Z_FILTERED (1) or Z_RLE (3)
+        int m_Strategy = 0;
+    };
+
+    // Decides per entry whether and how its data is deflated. Path rules take precedence over extension rules, the
+    // longest matching path prefix wins and all matching is case-insensitive.
+    class CompressionPolicy
+    {
+    public:
+        static const int STORE_LEVEL = 0;
+        static const int FAST_LEVEL = 1;
+        static const int BEST_LEVEL = 9;
+
+        // Best compression, stores .rpf, .bik and .awc entries which are already compressed.
+        static CompressionPolicy Default();
+        // Same rules as Default at the fastest level, meant for iteration builds.
+        static CompressionPolicy Fast();
+
+        void SetDefaultSettings(const CompressionSettings& settings)
+        {
+            m_DefaultSettings = settings;
+        }
+        // extension including the dot, e.g. ".ytd"
+        void SetExtensionSettings(std::string_view extension, const CompressionSettings& settings);
+        // applies to the entry with this path and to everything below it if it is a directory
+        void SetPathSettings(std::string_view entryPath, const CompressionSettings& settings);
+
+        // Samples the data before compressing it and stores it if it looks incompressible.
+        void SetIncompressibleDetection(bool isEnabled)
+        {
+            m_IsIncompressibleDetectionEnabled = isEnabled;
+        }
+
+        [[nodiscard]] CompressionSettings GetSettings(std::string_view entryPath) const;
+        // Cheap order-0 entropy estimate over a few samples of the data, false for already compressed or random data.
+        [[nodiscard]] bool IsWorthCompressing(std::span<const uint8_t> data) const;
+
+    private:
+        struct Rule
+        {
+            std::string m_Pattern;
+            CompressionSettings m_Settings;
+        };
+
+        static std::string NormalizePattern(std::string_view pattern);
+
+        CompressionSettings m_DefaultSettings;
+        std::vector<Rule> m_ExtensionRules;
+        std::vector<Rule> m_PathRules;
+        bool m_IsIncompressibleDetectionEnabled = true;
+    };
+}
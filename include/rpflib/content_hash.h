@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace rpflib
+{
+    // 128 bit MurmurHash3 (x64 variant) of a piece of entry data, wide enough to treat equal hashes as equal content.
+    struct ContentHash
+    {
+        uint64_t m_Low = 0;
+        uint64_t m_High = 0;
+
+        static ContentHash Compute(std::span<const uint8_t> data, uint64_t seed = 0);
+
+        bool operator==(const ContentHash& other) const = default;
+
+        // for unordered containers, the hash bits are already well mixed
+        struct Hasher
+        {
+            size_t operator()(const ContentHash& hash) const
+            {
+                return static_cast<size_t>(hash.m_Low);
+            }
+        };
+    };
+
+    // Computes the same hash as ContentHash::Compute for data that arrives in pieces of any size.
+    class ContentHasher
+    {
+    public:
+        explicit ContentHasher(uint64_t seed = 0);
+
+        void Update(std::span<const uint8_t> data);
+        [[nodiscard]] ContentHash Finish() const;
+
+    private:
+        uint64_t m_H1;
+        uint64_t m_H2;
+        uint64_t m_Length = 0;
+        // bytes that do not fill a whole 16 byte block yet
+        uint8_t m_Tail[16] = {};
+        uint64_t m_TailLength = 0;
+    };
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace rpflib
+{
+    // Keys of encrypted archives. rpflib does not ship any, they have to be supplied by the caller.
+    struct RPF7Keys
+    {
+        static constexpr uint32_t AES_KEY_SIZE = 32;
+        static constexpr uint32_t NG_KEY_COUNT = 101;
+        static constexpr uint32_t NG_ROUND_COUNT = 17;
+        // 16 byte round key per round
+        static constexpr uint32_t NG_KEY_SIZE = NG_ROUND_COUNT * 16;
+        // 16 lookup tables of 256 entries per round
+        static constexpr uint32_t NG_TABLE_ENTRY_COUNT = NG_ROUND_COUNT * 16 * 256;
+
+        // ENCRYPTION_AES, AES_KEY_SIZE bytes
+        std::vector<uint8_t> m_AesKey;
+        // ENCRYPTION_NG, NG_KEY_COUNT keys of NG_KEY_SIZE bytes each and NG_TABLE_ENTRY_COUNT table entries
+        std::vector<uint8_t> m_NgKeys;
+        std::vector<uint32_t> m_NgDecryptTables;
+
+        [[nodiscard]] bool HasAesKey() const
+        {
+            return m_AesKey.size() == AES_KEY_SIZE;
+        }
+        [[nodiscard]] bool HasNgKeys() const
+        {
+            return m_NgKeys.size() == NG_KEY_COUNT * NG_KEY_SIZE && m_NgDecryptTables.size() == NG_TABLE_ENTRY_COUNT;
+        }
+    };
+
+    // AES-256 in ECB mode, runs on AES-NI when the CPU supports it and on T-tables otherwise.
+    class AesDecryptor
+    {
+    public:
+        static constexpr uint32_t BLOCK_SIZE = 16;
+
+        // key has to be RPF7Keys::AES_KEY_SIZE bytes
+        explicit AesDecryptor(std::span<const uint8_t> key);
+
+        // Decrypts every whole block in place, a trailing partial block is stored unencrypted and left as it is.
+        void Decrypt(uint8_t* data, uint64_t size) const;
+
+        static bool IsHardwareAccelerated();
+
+    private:
+        static constexpr uint32_t ROUND_COUNT = 14;
+
+        // decryption round keys in the order they are applied, as words for the tables and as bytes for AES-NI
+        uint32_t m_RoundKeys[(ROUND_COUNT + 1) * 4];
+        alignas(16) uint8_t m_RoundKeyBytes[(ROUND_COUNT + 1) * 16];
+    };
+
+    // Table-driven cipher of ENCRYPTION_NG archives. Every piece of data picks one of the keys from its name and length.
+    class NgDecryptor
+    {
+    public:
+        explicit NgDecryptor(std::shared_ptr<const RPF7Keys> keys);
+
+        // the game offsets the key index by 101 - 40
+        static constexpr uint32_t NG_KEY_INDEX_OFFSET = RPF7Keys::NG_KEY_COUNT - 40;
+
+        // joaat of the name plus the length and NG_KEY_INDEX_OFFSET, modulo the key count
+        static uint32_t GetKeyIndex(std::string_view name, uint64_t length);
+
+        // Decrypts every whole block in place, a trailing partial block is stored unencrypted and left as it is.
+        void Decrypt(uint8_t* data, uint64_t size, std::string_view name, uint64_t length) const;
+
+    private:
+        std::shared_ptr<const RPF7Keys> m_Keys;
+    };
+}
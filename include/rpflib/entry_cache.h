@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace rpflib
+{
+    // Byte-budgeted LRU cache of decompressed entry data. Keys are split over independently locked shards so
+    // concurrent readers rarely contend, and hits hand out the cached buffer itself instead of a copy.
+    class EntryCache
+    {
+    public:
+        typedef std::shared_ptr<const std::vector<uint8_t>> EntryDataPointer;
+
+        struct Stats
+        {
+            uint64_t m_Hits = 0;
+            uint64_t m_Misses = 0;
+            uint64_t m_Evictions = 0;
+            uint64_t m_CachedBytes = 0;
+            uint64_t m_CachedEntries = 0;
+        };
+
+        explicit EntryCache(uint64_t byteBudget, uint32_t shardCount = 16);
+
+        // Counts a hit or a miss and returns nullptr on a miss.
+        [[nodiscard]] EntryDataPointer Find(uint32_t key);
+        // Returns the buffer that ends up cached, which is the existing one if another reader inserted it first.
+        // Entries larger than a shard's share of the budget are returned without being cached.
+        EntryDataPointer Insert(uint32_t key, std::vector<uint8_t>&& data);
+        void Clear();
+
+        [[nodiscard]] Stats GetStats() const;
+        [[nodiscard]] uint64_t GetByteBudget() const
+        {
+            return m_ByteBudget;
+        }
+
+    private:
+        struct CacheItem
+        {
+            uint32_t m_Key;
+            EntryDataPointer m_Data;
+        };
+
+        struct Shard
+        {
+            std::mutex m_Mutex;
+            // most recently used first
+            std::list<CacheItem> m_Items;
+            std::unordered_map<uint32_t, std::list<CacheItem>::iterator> m_Lookup;
+            uint64_t m_CachedBytes = 0;
+        };
+
+        Shard& GetShard(uint32_t key)
+        {
+            return m_Shards[key % m_ShardCount];
+        }
+
+        uint64_t m_ByteBudget;
+        uint64_t m_ShardBudget;
+        uint32_t m_ShardCount;
+        std::unique_ptr<Shard[]> m_Shards;
+
+        std::atomic<uint64_t> m_Hits = 0;
+        std::atomic<uint64_t> m_Misses = 0;
+        std::atomic<uint64_t> m_Evictions = 0;
+    };
+}
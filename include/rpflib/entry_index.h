@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace rpflib
+{
+    // Flat open-addressing index from entry paths to entry indices. Paths are keyed by their case-insensitive joaat
+    // hash, which is stored inline in the slot so a lookup normally touches a single slot and one path compare.
+    class EntryIndex
+    {
+    public:
+        static const uint32_t INVALID_INDEX = 0xFFFFFFFF;
+
+        struct Item
+        {
+            uint32_t m_PathHash;
+            uint32_t m_EntryIndex;
+            uint32_t m_PathOffset;
+            uint32_t m_PathLength;
+        };
+
+        struct Slot
+        {
+            uint32_t m_PathHash;
+            uint32_t m_ItemIndex;
+        };
+
+        // Jenkins one-at-a-time hash of the lowercased path with '\\' treated as '/'
+        static uint32_t GetPathHash(std::string_view path);
+        static bool IsSamePath(std::string_view a, std::string_view b);
+        // Gives the path exactly one leading '/' and drops empty segments, the form paths are indexed in. Returns path
+        // itself if it already has that form, a view of buffer otherwise.
+        static std::string_view NormalizePath(std::string_view path, std::string& buffer);
+
+        void Reserve(uint32_t count);
+        // Keeps the first entry when two paths only differ in case.
+        void Insert(std::string_view path, uint32_t entryIndex);
+        void Clear();
+        // Takes over the tables of a persisted index as they are, returns false if they are not consistent.
+        bool Assign(std::span<const Slot> slots, std::span<const Item> items, std::string_view pathData);
+
+        [[nodiscard]] uint32_t Find(std::string_view path) const;
+        // The first inserted path wins if two paths share a hash.
+        [[nodiscard]] uint32_t Find(uint32_t pathHash) const;
+
+        [[nodiscard]] bool IsEmpty() const
+        {
+            return m_Items.empty();
+        }
+        [[nodiscard]] uint32_t GetSize() const
+        {
+            return static_cast<uint32_t>(m_Items.size());
+        }
+        [[nodiscard]] const std::vector<Item>& GetItems() const
+        {
+            return m_Items;
+        }
+        [[nodiscard]] std::string_view GetPath(const Item& item) const
+        {
+            return std::string_view(m_PathData).substr(item.m_PathOffset, item.m_PathLength);
+        }
+        [[nodiscard]] const std::vector<Slot>& GetSlots() const
+        {
+            return m_Slots;
+        }
+        [[nodiscard]] const std::string& GetPathData() const
+        {
+            return m_PathData;
+        }
+
+    private:
+        void Rehash(uint32_t slotCount);
+        uint32_t FindItem(std::string_view path, uint32_t pathHash) const;
+
+        std::vector<Slot> m_Slots;
+        std::vector<Item> m_Items;
+        std::string m_PathData;
+    };
+}
@@ -1,69 +1,290 @@
 #pragma once
 
-#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <rpflib/entry_index.h>
 
 namespace rpflib
 {
+    static const uint32_t INVALID_ENTRY_NODE = 0xFFFFFFFF;
+
     template<typename EntryType>
     struct EntryNode
     {
-        using EntryNodeType = EntryNode<EntryType>;
-
         EntryType* m_Entry = nullptr;
-        EntryNodeType* m_Parent = nullptr;
-        EntryNodeType* m_FirstChild = nullptr;
-        EntryNodeType* m_NextSibling = nullptr;
+        // points into the archive's name heap or the tree's name arena
+        std::string_view m_Name {};
 
-        std::string m_Name {};
+        uint32_t m_Parent = INVALID_ENTRY_NODE;
+        uint32_t m_FirstChild = INVALID_ENTRY_NODE;
+        uint32_t m_LastChild = INVALID_ENTRY_NODE;
+        uint32_t m_NextSibling = INVALID_ENTRY_NODE;
         uint32_t m_ChildrenCount = 0;
-        std::filesystem::path m_RelativePath { };
-        std::filesystem::path m_FilePath { };
+        // archive specific per-node data, e.g. the source of an entry added for writing
+        uint32_t m_DataIndex = INVALID_ENTRY_NODE;
 
-        EntryNode() = default;
-        EntryNode(const std::string& name, EntryNode* parent) :
-            m_Name(name), m_Parent(parent) { }
-        ~EntryNode() = default;
+        [[nodiscard]] uint32_t GetChildrenCount() const
+        {
+            return m_ChildrenCount;
+        }
 
-        [[nodiscard]] EntryNodeType* Find(const std::string& item) const
+        [[nodiscard]] bool HasChildren() const
         {
-            EntryNodeType* current = m_FirstChild;
-            while (current && current->m_Name != item)
-                current = current->m_NextSibling;
+            return m_FirstChild != INVALID_ENTRY_NODE;
+        }
+    };
 
-            return current;
+    // Entry tree stored in one contiguous node array. Nodes reference each other by index, children are appended in
+    // O(1) through m_LastChild and names that do not live in a name heap are interned into a chunked arena.
+    // Names are matched case-insensitively, like entry paths.
+    template<typename EntryType>
+    class EntryNodeTree
+    {
+    public:
+        using EntryNodeType = EntryNode<EntryType>;
+
+        static const uint32_t ROOT_NODE = 0;
+
+        EntryNodeTree()
+        {
+            Clear();
+        }
+
+        EntryNodeTree(const EntryNodeTree&) = delete;
+        EntryNodeTree& operator=(const EntryNodeTree&) = delete;
+
+        void Clear()
+        {
+            m_Nodes.clear();
+            m_Nodes.emplace_back();
+            m_ChildLookup.clear();
+            m_IsChildLookupEnabled = false;
+            m_RemovedNodeCount = 0;
+            m_InternedNames.clear();
+            m_NameBlocks.clear();
+            m_NameBlockUsed = NAME_BLOCK_SIZE;
+        }
+
+        void Reserve(uint32_t nodeCount)
+        {
+            m_Nodes.reserve(nodeCount);
         }
 
-        [[nodiscard]] EntryNodeType* GetLastChild() const
+        // includes removed nodes, which stay in the array
+        [[nodiscard]] uint32_t GetNodeCount() const
         {
-            EntryNodeType* nextChild = m_FirstChild;
-            EntryNodeType* child = nullptr;
+            return static_cast<uint32_t>(m_Nodes.size());
+        }
+        [[nodiscard]] uint32_t GetRemovedNodeCount() const
+        {
+            return m_RemovedNodeCount;
+        }
+        [[nodiscard]] bool IsRemoved(uint32_t nodeIndex) const
+        {
+            return nodeIndex != ROOT_NODE && m_Nodes[nodeIndex].m_Parent == INVALID_ENTRY_NODE;
+        }
+
+        // references are invalidated by Add, hold on to node indices instead
+        [[nodiscard]] EntryNodeType& GetNode(uint32_t nodeIndex)
+        {
+            return m_Nodes[nodeIndex];
+        }
+        [[nodiscard]] const EntryNodeType& GetNode(uint32_t nodeIndex) const
+        {
+            return m_Nodes[nodeIndex];
+        }
+        [[nodiscard]] EntryNodeType& GetRoot()
+        {
+            return m_Nodes[ROOT_NODE];
+        }
 
-            while(nextChild != nullptr)
+        // name has to outlive the tree, use FindOrAdd for names that need to be copied
+        uint32_t Add(uint32_t parentIndex, std::string_view name)
+        {
+            uint32_t nodeIndex = static_cast<uint32_t>(m_Nodes.size());
+
+            EntryNodeType& node = m_Nodes.emplace_back();
+            node.m_Name = name;
+            node.m_Parent = parentIndex;
+
+            EntryNodeType& parent = m_Nodes[parentIndex];
+            if (parent.m_FirstChild == INVALID_ENTRY_NODE)
+                parent.m_FirstChild = nodeIndex;
+            else
+                m_Nodes[parent.m_LastChild].m_NextSibling = nodeIndex;
+
+            parent.m_LastChild = nodeIndex;
+            parent.m_ChildrenCount++;
+
+            if (m_IsChildLookupEnabled)
+                m_ChildLookup.emplace(ChildKey {parentIndex, name}, nodeIndex);
+
+            return nodeIndex;
+        }
+
+        [[nodiscard]] uint32_t Find(uint32_t parentIndex, std::string_view name) const
+        {
+            if (m_IsChildLookupEnabled)
             {
-                child = nextChild;
-                nextChild = nextChild->m_NextSibling;
+                auto childIt = m_ChildLookup.find(ChildKey {parentIndex, name});
+                return childIt == m_ChildLookup.end() ? INVALID_ENTRY_NODE : childIt->second;
             }
 
-            return child;
+            uint32_t current = m_Nodes[parentIndex].m_FirstChild;
+            while (current != INVALID_ENTRY_NODE && !EntryIndex::IsSamePath(m_Nodes[current].m_Name, name))
+                current = m_Nodes[current].m_NextSibling;
+
+            return current;
         }
 
-        [[nodiscard]] uint32_t GetChildrenCount() const
+        // Hashed lookup used when building a tree from arbitrary paths, copies the name into the arena.
+        uint32_t FindOrAdd(uint32_t parentIndex, std::string_view name)
         {
-            return m_ChildrenCount;
+            if (!m_IsChildLookupEnabled)
+            {
+                for (uint32_t nodeIndex = 1; nodeIndex < m_Nodes.size(); nodeIndex++)
+                {
+                    if (!IsRemoved(nodeIndex))
+                        m_ChildLookup.emplace(ChildKey {m_Nodes[nodeIndex].m_Parent, m_Nodes[nodeIndex].m_Name}, nodeIndex);
+                }
+
+                m_IsChildLookupEnabled = true;
+            }
+
+            auto childIt = m_ChildLookup.find(ChildKey {parentIndex, name});
+            if (childIt != m_ChildLookup.end())
+                return childIt->second;
+
+            return Add(parentIndex, InternName(name));
         }
 
-        EntryNodeType* Add(const std::string& name)
+        // Unlinks the node from its parent and marks it and all of its descendants as removed.
+        void Remove(uint32_t nodeIndex)
         {
-            EntryNodeType* newItem = new EntryNodeType(name, this);
-            if(m_FirstChild == nullptr)
-                m_FirstChild = newItem;
+            if (nodeIndex >= m_Nodes.size() || IsRemoved(nodeIndex) || nodeIndex == ROOT_NODE)
+                return;
+
+            uint32_t parentIndex = m_Nodes[nodeIndex].m_Parent;
+            EntryNodeType& parent = m_Nodes[parentIndex];
+
+            uint32_t previous = INVALID_ENTRY_NODE;
+            for (uint32_t current = parent.m_FirstChild; current != nodeIndex; current = m_Nodes[current].m_NextSibling)
+                previous = current;
+
+            if (previous == INVALID_ENTRY_NODE)
+                parent.m_FirstChild = m_Nodes[nodeIndex].m_NextSibling;
             else
-                GetLastChild()->m_NextSibling = newItem;
+                m_Nodes[previous].m_NextSibling = m_Nodes[nodeIndex].m_NextSibling;
+
+            if (parent.m_LastChild == nodeIndex)
+                parent.m_LastChild = previous;
+
+            parent.m_ChildrenCount--;
+            m_Nodes[nodeIndex].m_NextSibling = INVALID_ENTRY_NODE;
+
+            if (m_IsChildLookupEnabled)
+            {
+                auto childIt = m_ChildLookup.find(ChildKey {parentIndex, m_Nodes[nodeIndex].m_Name});
+                if (childIt != m_ChildLookup.end() && childIt->second == nodeIndex)
+                    m_ChildLookup.erase(childIt);
+            }
+
+            std::vector<uint32_t> removeStack = {nodeIndex};
+            while (!removeStack.empty())
+            {
+                uint32_t removedIndex = removeStack.back();
+                removeStack.pop_back();
+
+                m_Nodes[removedIndex].m_Parent = INVALID_ENTRY_NODE;
+                m_RemovedNodeCount++;
+                ForEachChild(removedIndex, [&](uint32_t childIndex) { removeStack.push_back(childIndex); });
+            }
+        }
+
+        // Copies every node name into the arena so the tree no longer references the memory names were added from.
+        void InternNames()
+        {
+            for (EntryNodeType& node : m_Nodes)
+                node.m_Name = InternName(node.m_Name);
+
+            if (!m_IsChildLookupEnabled)
+                return;
+
+            m_ChildLookup.clear();
+            for (uint32_t nodeIndex = 1; nodeIndex < m_Nodes.size(); nodeIndex++)
+            {
+                if (!IsRemoved(nodeIndex))
+                    m_ChildLookup.emplace(ChildKey {m_Nodes[nodeIndex].m_Parent, m_Nodes[nodeIndex].m_Name}, nodeIndex);
+            }
+        }
+
+        std::string_view InternName(std::string_view name)
+        {
+            if (name.empty())
+                return {};
+
+            auto nameIt = m_InternedNames.find(name);
+            if (nameIt != m_InternedNames.end())
+                return *nameIt;
+
+            if (m_NameBlockUsed + name.size() > NAME_BLOCK_SIZE)
+            {
+                m_NameBlocks.push_back(std::make_unique<char[]>(std::max<size_t>(name.size(), NAME_BLOCK_SIZE)));
+                m_NameBlockUsed = 0;
+            }
+
+            char* nameData = m_NameBlocks.back().get() + m_NameBlockUsed;
+            std::copy(name.begin(), name.end(), nameData);
+            m_NameBlockUsed += name.size();
+
+            std::string_view internedName(nameData, name.size());
+            m_InternedNames.insert(internedName);
+            return internedName;
+        }
 
-            m_ChildrenCount++;
-            return newItem;
+        template<typename Callback>
+        void ForEachChild(uint32_t parentIndex, Callback&& callback) const
+        {
+            for (uint32_t child = m_Nodes[parentIndex].m_FirstChild; child != INVALID_ENTRY_NODE; child = m_Nodes[child].m_NextSibling)
+                callback(child);
         }
 
-        bool HasChildren() const { return m_FirstChild != nullptr; }
+    private:
+        static constexpr size_t NAME_BLOCK_SIZE = 64 * 1024;
+
+        struct ChildKey
+        {
+            uint32_t m_Parent;
+            std::string_view m_Name;
+
+            bool operator==(const ChildKey& other) const
+            {
+                return m_Parent == other.m_Parent && EntryIndex::IsSamePath(m_Name, other.m_Name);
+            }
+        };
+
+        struct ChildKeyHash
+        {
+            size_t operator()(const ChildKey& key) const
+            {
+                return EntryIndex::GetPathHash(key.m_Name) ^ (static_cast<size_t>(key.m_Parent) * 0x9E3779B97F4A7C15ull);
+            }
+        };
+
+        std::vector<EntryNodeType> m_Nodes;
+        std::unordered_map<ChildKey, uint32_t, ChildKeyHash> m_ChildLookup;
+        bool m_IsChildLookupEnabled = false;
+        uint32_t m_RemovedNodeCount = 0;
+
+        std::unordered_set<std::string_view> m_InternedNames;
+        std::vector<std::unique_ptr<char[]>> m_NameBlocks;
+        size_t m_NameBlockUsed = NAME_BLOCK_SIZE;
     };
-}
\ No newline at end of file
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include <rpflib/archive_file.h>
+
+struct z_stream_s;
+
+namespace rpflib
+{
+    // Sequential reader over a single archive entry. Compressed entries are inflated incrementally from fixed-size
+    // input windows straight into the caller's buffer, so memory use does not depend on the entry size.
+    // A reader is not thread-safe itself, but any number of readers can be used on the same archive concurrently.
+    class EntryReader
+    {
+    public:
+        static constexpr uint64_t WINDOW_SIZE = 64 * 1024;
+
+        // Decrypts size bytes of stored data that start storedOffset bytes into the entry, storedOffset is always a
+        // multiple of the window size.
+        typedef std::function<void(uint8_t* data, uint64_t storedOffset, uint64_t size)> DecryptCallback;
+
+        // Encrypted entries pass a decrypt callback, their data is then always read through whole windows.
+        EntryReader(std::shared_ptr<ArchiveFile> archiveFile, uint64_t storedOffset, uint64_t storedSize, uint64_t size, bool isCompressed,
+                    DecryptCallback decrypt = nullptr);
+        ~EntryReader();
+
+        EntryReader(const EntryReader&) = delete;
+        EntryReader& operator=(const EntryReader&) = delete;
+
+        // Returns the number of bytes read, less than size only at the end of the entry or on failure.
+        uint64_t Read(void* buffer, uint64_t size);
+        // Returns the number of bytes skipped.
+        uint64_t Skip(uint64_t size);
+        // Replaces the first data.size() bytes the reader produces, for entries whose stored start differs from their data.
+        void SetLeadingBytes(std::span<const uint8_t> data);
+
+        [[nodiscard]] uint64_t GetSize() const
+        {
+            return m_Size;
+        }
+        [[nodiscard]] uint64_t GetPosition() const
+        {
+            return m_Position;
+        }
+        [[nodiscard]] bool IsEndOfEntry() const
+        {
+            return m_Position >= m_Size || m_HasFailed;
+        }
+        [[nodiscard]] bool HasFailed() const
+        {
+            return m_HasFailed;
+        }
+
+    private:
+        uint64_t ReadStored(uint8_t* buffer, uint64_t size);
+        uint64_t ReadCompressed(uint8_t* buffer, uint64_t size);
+        bool FillInputWindow();
+
+        std::shared_ptr<ArchiveFile> m_ArchiveFile;
+        uint64_t m_StoredOffset = 0;
+        uint64_t m_StoredSize = 0;
+        uint64_t m_StoredPosition = 0;
+        uint64_t m_Size = 0;
+        uint64_t m_Position = 0;
+        bool m_IsCompressed = false;
+        bool m_HasFailed = false;
+        DecryptCallback m_Decrypt;
+
+        std::unique_ptr<z_stream_s> m_InflateStream;
+        std::vector<uint8_t> m_InputWindow;
+        uint64_t m_WindowPosition = 0;
+        uint64_t m_WindowSize = 0;
+        std::vector<uint8_t> m_SkipWindow;
+        std::vector<uint8_t> m_LeadingBytes;
+    };
+}
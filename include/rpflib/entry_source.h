@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+namespace rpflib
+{
+    // Where the data of an entry added for writing comes from: a file on disk, an owned buffer, caller owned memory,
+    // a pull-style reader callback of known size or a stream that opens such a reader. Copies share the same
+    // underlying source.
+    class EntrySource
+    {
+    public:
+        // Fills buffer with up to size bytes and returns the number of bytes produced, 0 ends the stream.
+        typedef std::function<uint64_t(uint8_t* buffer, uint64_t size)> ReadCallback;
+        // Returns a reader over the data from its first byte, an empty callback if it can not be opened.
+        typedef std::function<ReadCallback()> OpenCallback;
+
+        EntrySource() = default;
+
+        static EntrySource FromFile(const std::filesystem::path& filePath);
+        static EntrySource FromBuffer(std::vector<uint8_t>&& buffer);
+        // The memory has to stay valid until the archive is closed.
+        static EntrySource FromSpan(std::span<const uint8_t> data);
+        // The callback is drained exactly once, when the archive is closed.
+        static EntrySource FromReader(uint64_t size, ReadCallback reader);
+        // Opens a reader whenever the data is needed. A peek keeps only the bytes it read, so an entry waiting to be
+        // written holds no open reader, and the reader opened for the data is drained once when the archive is closed.
+        static EntrySource FromStream(uint64_t size, OpenCallback openReader);
+
+        [[nodiscard]] bool IsValid() const
+        {
+            return m_State != nullptr;
+        }
+
+        [[nodiscard]] uint64_t GetSize() const;
+        // Copies the first size bytes into buffer without consuming a reader source.
+        bool PeekData(void* buffer, uint64_t size) const;
+        // Reads the whole entry, fails if the source can not produce exactly GetSize bytes. Drains a reader source.
+        bool GetData(std::vector<uint8_t>& data) const;
+        // In-memory sources are exposed without copying, file and reader sources return an empty span.
+        [[nodiscard]] std::span<const uint8_t> GetView() const;
+
+    private:
+        enum class SourceType
+        {
+            SOURCE_TYPE_FILE = 0,
+            SOURCE_TYPE_BUFFER,
+            SOURCE_TYPE_SPAN,
+            SOURCE_TYPE_READER,
+            SOURCE_TYPE_STREAM
+        };
+
+        struct SourceState
+        {
+            SourceType m_Type = SourceType::SOURCE_TYPE_FILE;
+            uint64_t m_Size = 0;
+
+            std::filesystem::path m_FilePath;
+            std::vector<uint8_t> m_Buffer;
+            std::span<const uint8_t> m_Span;
+
+            // bytes already pulled from the reader or stream by PeekData
+            std::mutex m_ReaderMutex;
+            ReadCallback m_Reader;
+            OpenCallback m_OpenReader;
+            std::vector<uint8_t> m_ReaderPrefix;
+        };
+
+        std::shared_ptr<SourceState> m_State;
+    };
+}
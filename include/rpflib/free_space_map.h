@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+
+namespace rpflib
+{
+    // Tracks runs of unused data blocks inside an archive. Allocations take the first run that is large enough and
+    // fall back to appending at the end of the archive.
+    class FreeSpaceMap
+    {
+    public:
+        explicit FreeSpaceMap(uint64_t endBlock = 0) : m_EndBlock(endBlock) { }
+
+        // Adjacent runs are merged.
+        void AddFreeBlocks(uint64_t firstBlock, uint64_t blockCount);
+        uint64_t Allocate(uint64_t blockCount);
+
+        [[nodiscard]] uint64_t GetEndBlock() const
+        {
+            return m_EndBlock;
+        }
+        [[nodiscard]] uint64_t GetFreeBlockCount() const;
+
+    private:
+        // first block of a run mapped to its block count
+        std::map<uint64_t, uint64_t> m_FreeRuns;
+        uint64_t m_EndBlock;
+    };
+}
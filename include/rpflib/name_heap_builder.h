@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace rpflib
+{
+    // Collects the unique entry names of an archive that is being written and lays them out as an RPF7 name heap.
+    // Names are interned through a hash table and their shifted offsets are assigned in a single pass.
+    class NameHeapBuilder
+    {
+    public:
+        static const uint32_t INVALID_OFFSET = 0xFFFFFFFF;
+        static constexpr int MAX_NAME_SHIFT = 3;
+
+        NameHeapBuilder();
+
+        void Reserve(uint32_t count);
+        // The name has to stay valid until the heap is built.
+        void Add(std::string_view name);
+        void Clear();
+
+        // Picks the smallest name shift starting at minNameShift the heap fits in, returns -1 if it does not fit at all.
+        int Build(int minNameShift);
+
+        [[nodiscard]] uint32_t GetOffset(std::string_view name) const;
+        [[nodiscard]] int GetNameShift() const
+        {
+            return m_NameShift;
+        }
+        [[nodiscard]] const std::vector<char>& GetHeap() const
+        {
+            return m_Heap;
+        }
+
+        [[nodiscard]] static uint64_t GetHeapMaxSize(int nameShift)
+        {
+            return 65536ull << nameShift;
+        }
+
+    private:
+        struct NameItem
+        {
+            std::string_view m_Name;
+            uint32_t m_Offset;
+        };
+
+        std::vector<NameItem> m_Names;
+        std::unordered_map<std::string_view, uint32_t> m_NameLookup;
+
+        std::vector<char> m_Heap;
+        int m_NameShift = 0;
+    };
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <span>
+
+namespace rpflib
+{
+    // Writable handle to an archive file. All writes are positional (pwrite / overlapped WriteFile), so the table of
+    // contents is written in place without seeking and entry data can go out in a few large system calls.
+    class OutputFile
+    {
+    public:
+        ~OutputFile();
+
+        OutputFile(const OutputFile&) = delete;
+        OutputFile& operator=(const OutputFile&) = delete;
+
+        // Creates the file or truncates an existing one.
+        static std::unique_ptr<OutputFile> Create(const std::filesystem::path& path);
+        // Opens an existing file without truncating it.
+        static std::unique_ptr<OutputFile> Open(const std::filesystem::path& path);
+
+        bool Write(uint64_t offset, const void* data, uint64_t size);
+        // Writes the buffers back to back starting at offset, with a single pwritev where the platform has one.
+        bool Write(uint64_t offset, std::span<const std::span<const uint8_t>> buffers);
+
+        // Allocates disk space for the first size bytes without changing the file size, so the data written later does
+        // not fragment the file. Does nothing where the platform can not preallocate.
+        void Reserve(uint64_t size);
+        // Sets the file size, space reserved past it is released.
+        bool Resize(uint64_t size);
+
+    private:
+        OutputFile() = default;
+
+#ifdef _WIN32
+        void* m_FileHandle = nullptr;
+#else
+        int m_FileDescriptor = -1;
+#endif
+    };
+
+    // Gathers sequential writes in one aligned buffer and passes data larger than the buffer to the file directly,
+    // together with what is buffered, so entries of any size leave in large writes.
+    class OutputBuffer
+    {
+    public:
+        static constexpr uint64_t ALIGNMENT = 4096;
+
+        OutputBuffer(OutputFile& file, uint64_t capacity);
+        // Does not flush, buffered data is dropped unless Flush was called.
+        ~OutputBuffer();
+
+        OutputBuffer(const OutputBuffer&) = delete;
+        OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+        // Writes data followed by paddingSize zero bytes at offset, a write that does not continue the previous one
+        // flushes the buffer first.
+        bool Write(uint64_t offset, std::span<const uint8_t> data, uint64_t paddingSize = 0);
+        bool Flush();
+
+    private:
+        OutputFile& m_File;
+        uint8_t* m_Buffer = nullptr;
+        uint64_t m_Capacity = 0;
+        // file offset of the first buffered byte
+        uint64_t m_BufferOffset = 0;
+        uint64_t m_BufferSize = 0;
+    };
+}
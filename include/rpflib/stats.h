@@ -0,0 +1,194 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace rpflib
+{
+    enum class StatCounter : uint32_t
+    {
+        STAT_COUNTER_READ_CALLS = 0,
+        STAT_COUNTER_BYTES_READ,
+        // reads that do not continue where the previous read of the same archive ended, only counted with
+        // RPF7OpenOptions::m_CountSeeks
+        STAT_COUNTER_SEEKS,
+        STAT_COUNTER_ENTRIES_READ,
+        STAT_COUNTER_INFLATE_BYTES_IN,
+        STAT_COUNTER_INFLATE_BYTES_OUT,
+        STAT_COUNTER_ENTRIES_WRITTEN,
+        STAT_COUNTER_BYTES_WRITTEN,
+        STAT_COUNTER_DEFLATE_BYTES_IN,
+        STAT_COUNTER_DEFLATE_BYTES_OUT,
+        // entries that reuse the data of an identical entry and the stored bytes that were not written for them
+        STAT_COUNTER_DEDUP_ENTRIES,
+        STAT_COUNTER_DEDUP_BYTES,
+        STAT_COUNTER_COUNT
+    };
+
+    enum class StatTimer : uint32_t
+    {
+        STAT_TIMER_OPEN = 0,
+        STAT_TIMER_READ_NAMES,
+        STAT_TIMER_READ_ENTRIES,
+        STAT_TIMER_BUILD_INDEX,
+        STAT_TIMER_READ_ENTRY,
+        STAT_TIMER_INFLATE,
+        STAT_TIMER_DEFLATE,
+        STAT_TIMER_WRITE_ARCHIVE,
+        STAT_TIMER_EXTRACT_ALL,
+        STAT_TIMER_READ_BATCH,
+        STAT_TIMER_DECRYPT,
+        STAT_TIMER_COUNT
+    };
+
+    // Latency histogram with power of two buckets, bucket i counts durations below 2^i nanoseconds.
+    class LatencyHistogram
+    {
+    public:
+        static const uint32_t BUCKET_COUNT = 40;
+
+        struct Snapshot
+        {
+            std::array<uint64_t, BUCKET_COUNT> m_Buckets {};
+            uint64_t m_Count = 0;
+            uint64_t m_TotalNanoseconds = 0;
+            uint64_t m_MaxNanoseconds = 0;
+
+            // upper bound of the bucket the percentile falls into, percentile in [0, 1]
+            [[nodiscard]] uint64_t GetPercentile(double percentile) const;
+        };
+
+        void Record(uint64_t nanoseconds);
+        void Reset();
+        [[nodiscard]] Snapshot GetSnapshot() const;
+
+    private:
+        // the count is the sum of the buckets, so a record updates two of these
+        std::array<std::atomic<uint64_t>, BUCKET_COUNT> m_Buckets {};
+        std::atomic<uint64_t> m_TotalNanoseconds = 0;
+        std::atomic<uint64_t> m_MaxNanoseconds = 0;
+    };
+
+    // Lock-free counters and latency histograms. Every archive owns one and also adds everything to one of the shards
+    // of the global stats, picked per thread, so threads reading different archives do not share any counter. The
+    // global counters and histograms are summed over the shards when they are read.
+    class ArchiveStats
+    {
+    public:
+        ArchiveStats() = default;
+        ArchiveStats(const ArchiveStats&) = delete;
+        ArchiveStats& operator=(const ArchiveStats&) = delete;
+
+        static ArchiveStats& GetGlobal();
+
+        void Add(StatCounter counter, uint64_t value)
+        {
+            if (!m_IsGlobal)
+                m_Values.m_Counters[static_cast<uint32_t>(counter)].fetch_add(value, std::memory_order_relaxed);
+
+            GetGlobalShard().m_Counters[static_cast<uint32_t>(counter)].fetch_add(value, std::memory_order_relaxed);
+        }
+        void Record(StatTimer timer, uint64_t nanoseconds)
+        {
+            if (!m_IsGlobal)
+                m_Values.m_Timers[static_cast<uint32_t>(timer)].Record(nanoseconds);
+
+            GetGlobalShard().m_Timers[static_cast<uint32_t>(timer)].Record(nanoseconds);
+        }
+        void Reset();
+
+        [[nodiscard]] uint64_t GetCounter(StatCounter counter) const;
+        [[nodiscard]] LatencyHistogram::Snapshot GetTimer(StatTimer timer) const;
+
+        static const char* GetCounterName(StatCounter counter);
+        static const char* GetTimerName(StatTimer timer);
+
+    private:
+        static const uint32_t GLOBAL_SHARD_COUNT = 16;
+
+        struct alignas(64) Values
+        {
+            std::array<std::atomic<uint64_t>, static_cast<uint32_t>(StatCounter::STAT_COUNTER_COUNT)> m_Counters {};
+            std::array<LatencyHistogram, static_cast<uint32_t>(StatTimer::STAT_TIMER_COUNT)> m_Timers;
+        };
+
+        struct GlobalTag
+        {
+        };
+        explicit ArchiveStats(GlobalTag) : m_IsGlobal(true) { }
+
+        // the shard of the global stats the calling thread adds to
+        static Values& GetGlobalShard();
+        static std::array<Values, GLOBAL_SHARD_COUNT>& GetGlobalShards();
+
+        bool m_IsGlobal = false;
+        // unused by the global stats, which only live in the shards
+        Values m_Values;
+    };
+
+    enum class TraceEventType : uint32_t
+    {
+        TRACE_EVENT_BEGIN = 0,
+        TRACE_EVENT_END
+    };
+
+    // Called from whichever thread runs the traced operation, name is a string literal.
+    typedef void (*TraceCallback)(TraceEventType type, const char* name, uint64_t timestampNanoseconds, void* userData);
+
+    // Only has an effect when rpflib is built with RPFLIB_ENABLE_TRACING.
+    void SetTraceCallback(TraceCallback callback, void* userData = nullptr);
+    void EmitTraceEvent(TraceEventType type, const char* name);
+
+    inline uint64_t GetTimestampNanoseconds()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    class TraceScope
+    {
+    public:
+        explicit TraceScope(const char* name) : m_Name(name)
+        {
+            EmitTraceEvent(TraceEventType::TRACE_EVENT_BEGIN, m_Name);
+        }
+        ~TraceScope()
+        {
+            EmitTraceEvent(TraceEventType::TRACE_EVENT_END, m_Name);
+        }
+
+    private:
+        const char* m_Name;
+    };
+
+    // Records the lifetime of the scope into a timer of stats and the global stats.
+    class StatTimerScope
+    {
+    public:
+        StatTimerScope(ArchiveStats& stats, StatTimer timer) : m_Stats(stats), m_Timer(timer), m_StartTime(GetTimestampNanoseconds()) { }
+        ~StatTimerScope()
+        {
+            m_Stats.Record(m_Timer, GetTimestampNanoseconds() - m_StartTime);
+        }
+
+    private:
+        ArchiveStats& m_Stats;
+        StatTimer m_Timer;
+        uint64_t m_StartTime;
+    };
+}
+
+#define RPFLIB_STATS_CONCAT_INNER(a, b) a##b
+#define RPFLIB_STATS_CONCAT(a, b) RPFLIB_STATS_CONCAT_INNER(a, b)
+
+#ifdef RPFLIB_ENABLE_TRACING
+#define RPFLIB_TRACE_SCOPE(name) rpflib::TraceScope RPFLIB_STATS_CONCAT(traceScope, __LINE__)(name)
+#else
+#define RPFLIB_TRACE_SCOPE(name) ((void)0)
+#endif
+
+// times the rest of the scope into a stats timer and emits it as a trace span when tracing is enabled
+#define RPFLIB_STAT_SCOPE(stats, timer)                                                                  \
+    rpflib::StatTimerScope RPFLIB_STATS_CONCAT(statScope, __LINE__)(stats, rpflib::StatTimer::timer); \
+    RPFLIB_TRACE_SCOPE(rpflib::ArchiveStats::GetTimerName(rpflib::StatTimer::timer))
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace rpflib
+{
+    // Work-stealing thread pool. Every worker owns a queue that it drains front to back, idle workers steal from the
+    // back of the other queues. Tasks receive the index of the worker running them so per-worker scratch state can be
+    // indexed without any synchronization.
+    class ThreadPool
+    {
+    public:
+        typedef std::function<void(uint32_t workerIndex)> Task;
+
+        // threadCount 0 uses std::thread::hardware_concurrency
+        explicit ThreadPool(uint32_t threadCount = 0);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        // workerHint selects the queue the task is pushed to, tasks are distributed round-robin otherwise.
+        void Submit(Task task, int32_t workerHint = -1);
+        // Blocks until every submitted task has finished. Must not be called from inside a task.
+        void Wait();
+
+        [[nodiscard]] uint32_t GetThreadCount() const
+        {
+            return static_cast<uint32_t>(m_Threads.size());
+        }
+
+    private:
+        struct WorkerQueue
+        {
+            std::mutex m_Mutex;
+            std::deque<Task> m_Tasks;
+        };
+
+        void WorkerLoop(uint32_t workerIndex);
+        bool PopTask(uint32_t workerIndex, Task& task);
+
+        std::vector<std::unique_ptr<WorkerQueue>> m_Queues;
+        std::vector<std::thread> m_Threads;
+
+        std::mutex m_StateMutex;
+        std::condition_variable m_WorkAvailable;
+        std::condition_variable m_WorkDone;
+
+        std::atomic<uint64_t> m_QueuedTasks = 0;
+        std::atomic<uint64_t> m_PendingTasks = 0;
+        std::atomic<uint32_t> m_NextQueue = 0;
+        bool m_Stopping = false;
+    };
+}
@@ -0,0 +1,136 @@
+#include <rpflib/archive_file.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace rpflib;
+
+ArchiveFile::~ArchiveFile()
+{
+#ifdef _WIN32
+    if (m_Data != nullptr)
+        UnmapViewOfFile(m_Data);
+
+    if (m_MappingHandle != nullptr)
+        CloseHandle(m_MappingHandle);
+
+    if (m_FileHandle != nullptr && m_FileHandle != INVALID_HANDLE_VALUE)
+        CloseHandle(m_FileHandle);
+#else
+    if (m_Data != nullptr)
+        munmap(const_cast<uint8_t*>(m_Data), m_Size);
+
+    if (m_FileDescriptor != -1)
+        close(m_FileDescriptor);
+#endif
+}
+
+std::shared_ptr<ArchiveFile> ArchiveFile::Open(const std::filesystem::path& path, bool memoryMapped, bool isWriteShared)
+{
+    std::shared_ptr<ArchiveFile> file(new ArchiveFile());
+
+#ifdef _WIN32
+    DWORD shareMode = isWriteShared ? FILE_SHARE_READ | FILE_SHARE_WRITE : FILE_SHARE_READ;
+    file->m_FileHandle = CreateFileW(path.c_str(), GENERIC_READ, shareMode, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file->m_FileHandle == INVALID_HANDLE_VALUE)
+        return nullptr;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file->m_FileHandle, &fileSize) || fileSize.QuadPart == 0)
+        return nullptr;
+
+    file->m_Size = fileSize.QuadPart;
+    if (!memoryMapped)
+        return file;
+
+    file->m_MappingHandle = CreateFileMappingW(file->m_FileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (file->m_MappingHandle == nullptr)
+        return nullptr;
+
+    file->m_Data = static_cast<const uint8_t*>(MapViewOfFile(file->m_MappingHandle, FILE_MAP_READ, 0, 0, 0));
+    if (file->m_Data == nullptr)
+        return nullptr;
+#else
+    file->m_FileDescriptor = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file->m_FileDescriptor == -1)
+        return nullptr;
+
+    struct stat fileStat {};
+    if (fstat(file->m_FileDescriptor, &fileStat) != 0 || fileStat.st_size == 0)
+        return nullptr;
+
+    file->m_Size = fileStat.st_size;
+    if (!memoryMapped)
+        return file;
+
+    void* data = mmap(nullptr, file->m_Size, PROT_READ, MAP_SHARED, file->m_FileDescriptor, 0);
+    if (data == MAP_FAILED)
+        return nullptr;
+
+    file->m_Data = static_cast<const uint8_t*>(data);
+#endif
+
+    return file;
+}
+
+std::span<const uint8_t> ArchiveFile::GetView(uint64_t offset, uint64_t size) const
+{
+    if (m_Data == nullptr)
+        return {};
+
+    if (offset > m_Size || size > m_Size - offset)
+        return {};
+
+    return {m_Data + offset, static_cast<size_t>(size)};
+}
+
+bool ArchiveFile::Read(uint64_t offset, void* buffer, uint64_t size) const
+{
+    if (offset > m_Size || size > m_Size - offset)
+        return false;
+
+    if (m_Data != nullptr)
+    {
+        std::memcpy(buffer, m_Data + offset, size);
+        return true;
+    }
+
+    uint8_t* output = static_cast<uint8_t*>(buffer);
+    while (size > 0)
+    {
+#ifdef _WIN32
+        OVERLAPPED overlapped {};
+        overlapped.Offset = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+        DWORD chunkSize = static_cast<DWORD>(std::min<uint64_t>(size, 0x40000000));
+        DWORD bytesRead = 0;
+        if (!ReadFile(m_FileHandle, output, chunkSize, &bytesRead, &overlapped) || bytesRead == 0)
+            return false;
+#else
+        ssize_t bytesRead = pread(m_FileDescriptor, output, std::min<uint64_t>(size, 0x40000000), static_cast<off_t>(offset));
+        if (bytesRead < 0 && errno == EINTR)
+            continue;
+
+        if (bytesRead <= 0)
+            return false;
+#endif
+
+        output += bytesRead;
+        offset += bytesRead;
+        size -= bytesRead;
+    }
+
+    return true;
+}
@@ -1,11 +1,23 @@
 #include <functional>
 #include <rpflib/archives/rpf7.h>
+#include <rpflib/archives/rpf7_index_file.h>
+#include <rpflib/content_hash.h>
+#include <rpflib/free_space_map.h>
+#include <rpflib/thread_pool.h>
 #include <zlib.h>
+#include <cstring>
+#include <fstream>
 #include <queue>
+#include <iterator>
+#include <sstream>
+#include <algorithm>
+#include <set>
+#include <unordered_map>
 
 using namespace rpflib;
 
-RPF7Archive::RPF7Archive(const std::filesystem::path& archivePath, OpenMode openMode, int nameShift) : IRPFArchive(archivePath, openMode), m_NameShift(nameShift)
+RPF7Archive::RPF7Archive(const std::filesystem::path& archivePath, OpenMode openMode, int nameShift, const RPF7WriteOptions& writeOptions) :
+    IRPFArchive(archivePath, openMode), m_WriteOptions(writeOptions), m_NameShift(nameShift)
 {
     if (m_NameShift < 0 || m_NameShift > 3)
     {
@@ -22,44 +34,81 @@ RPF7Archive::RPF7Archive(const std::filesystem::path& archivePath, OpenMode open
         CreateArchive();
 }
 
-RPF7Archive::~RPF7Archive()
+RPF7Archive::RPF7Archive(const std::filesystem::path& archivePath, const RPF7OpenOptions& options) : IRPFArchive(archivePath, OpenMode::OPEN_MODE_READ), m_OpenOptions(options), m_NameShift(0)
 {
-    if (m_FileStream.is_open())
-        m_FileStream.close();
+    m_NameHeapMaxSize = 65536 << m_NameShift;
+
+    OpenArchive();
+}
+
+RPF7Archive::RPF7Archive(const std::filesystem::path& archivePath, std::shared_ptr<ArchiveFile> archiveFile, uint64_t baseOffset, uint64_t archiveSize, const RPF7OpenOptions& options) :
+    IRPFArchive(archivePath, OpenMode::OPEN_MODE_READ), m_OpenOptions(options), m_ArchiveFile(std::move(archiveFile)), m_BaseOffset(baseOffset), m_ArchiveSize(archiveSize), m_NameShift(0)
+{
+    m_NameHeapMaxSize = 65536 << m_NameShift;
+
+    ReadArchive();
 }
 
+RPF7Archive::~RPF7Archive() = default;
+
 void RPF7Archive::OpenArchive()
 {
     if (!IsReading())
         return;
 
-    if (m_FileStream.is_open())
+    if (IsOpen())
         return;
 
     if (!std::filesystem::exists(m_Path) || std::filesystem::is_directory(m_Path))
         return;
 
-    m_FileStream.open(m_Path, std::ios::binary | std::ios::in);
+    RPFLIB_STAT_SCOPE(m_Stats, STAT_TIMER_OPEN);
+
+    // an archive being updated is written through m_OutputFile while this handle is open
+    m_ArchiveFile = ArchiveFile::Open(m_Path, m_OpenOptions.m_MemoryMapped, IsUpdating());
+    if (!IsOpen())
+        return;
+
+    m_ArchiveSize = m_ArchiveFile->GetSize();
+    ReadArchive();
+    if (IsUpdating() && IsOpen() && !m_Entries.empty())
+    {
+        // the tree is what gets modified, so it is always built up front
+        EnsureEntryIndex();
+
+        m_OutputFile = OutputFile::Open(m_Path);
+        if (m_OutputFile == nullptr)
+            printf("ERROR! Failed to open %s for updating!\n", m_Path.string().c_str());
+    }
+}
 
+void RPF7Archive::ReadArchive()
+{
     ReadHeader(m_Header);
     if (m_Header.m_Magic.m_Number != IDENT)
     {
-        m_FileStream.close();
+        CloseArchive();
         return;
     }
 
-    if (m_Header.m_Encryption != ENCRYPTION_OPEN)
+    if (!SetupDecryption())
     {
-        printf("ERROR! Currently only non-encrypted RPF7 files are supported!\n");
-        m_FileStream.close();
+        CloseArchive();
         return;
     }
 
     m_NameShift = (m_Header.m_NameSize >> 28) & 0x3;
     m_NameHeapMaxSize = 65536 << m_NameShift;
 
-    ReadNames();
-    ReadEntries();
+    if (!LoadIndexFile())
+    {
+        ReadNames();
+        ReadEntries();
+        WriteIndexFile();
+    }
+
+    if (!IsUpdating() && m_OpenOptions.m_CacheBudget != 0)
+        m_EntryCache = std::make_unique<EntryCache>(m_OpenOptions.m_CacheBudget);
 }
 
 void RPF7Archive::CreateArchive()
@@ -67,37 +116,64 @@ void RPF7Archive::CreateArchive()
     if (!IsWriting())
         return;
 
-    if (m_FileStream.is_open())
+    if (m_OutputFile != nullptr)
         return;
 
-    m_FileStream.open(m_Path, std::ios::binary | std::ios::out | std::ios::trunc);
-    if (!m_FileStream.is_open())
+    m_OutputFile = OutputFile::Create(m_Path);
+    if (m_OutputFile == nullptr)
         return;
 
     m_Header = {};
     m_Header.m_NameSize = 0;
 }
 
-void RPF7Archive::CloseArchive()
+bool RPF7Archive::CloseArchive()
 {
-    if (IsWriting())
+    bool isWritten = true;
+    if (IsWriting() && m_OutputFile != nullptr)
     {
-        WriteHeader();
-        WriteEntries();
-        WriteNames();
-        WriteEntriesData();
+        RPFLIB_STAT_SCOPE(m_Stats, STAT_TIMER_WRITE_ARCHIVE);
+
+        isWritten = WriteArchive();
     }
 
-    if (m_FileStream.is_open())
-        m_FileStream.close();
+    if (IsUpdating() && m_OutputFile != nullptr)
+        isWritten = CommitUpdate();
+
+    m_OutputFile.reset();
+
+    m_ArchiveFile.reset();
+    m_EntryCache.reset();
+
+    return isWritten;
 }
 
 void RPF7Archive::AddEntry(const std::filesystem::path& entryPath, const std::filesystem::path& entryFilePath)
 {
-    if (!IsWriting())
+    AddEntry(entryPath, EntrySource::FromFile(entryFilePath));
+}
+
+void RPF7Archive::AddEntry(const std::filesystem::path& entryPath, EntryDataBuffer&& entryData)
+{
+    AddEntry(entryPath, EntrySource::FromBuffer(std::move(entryData)));
+}
+
+void RPF7Archive::AddEntry(const std::filesystem::path& entryPath, std::span<const uint8_t> entryData)
+{
+    AddEntry(entryPath, EntrySource::FromSpan(entryData));
+}
+
+void RPF7Archive::AddEntry(const std::filesystem::path& entryPath, uint64_t entrySize, EntrySource::ReadCallback entryReader)
+{
+    AddEntry(entryPath, EntrySource::FromReader(entrySize, std::move(entryReader)));
+}
+
+void RPF7Archive::AddEntry(const std::filesystem::path& entryPath, const EntrySource& entrySource)
+{
+    if (!IsWriting() && !IsUpdating())
         return;
 
-    if (!m_FileStream.is_open())
+    if (m_OutputFile == nullptr)
         return;
 
     if (!entryPath.has_extension())
@@ -106,31 +182,55 @@ void RPF7Archive::AddEntry(const std::filesystem::path& entryPath, const std::fi
     std::istringstream iss(entryPath.string());
     std::string item;
 
-    EntryNode<RPF7Entry>* currentParent = &m_RootNode;
+    uint32_t currentParent = EntryNodeTree<RPF7Entry>::ROOT_NODE;
     while (std::getline(iss, item, '/'))
     {
         if (item.empty())
             continue;
 
-        if (currentParent == nullptr)
-            continue;
+        currentParent = m_NodeTree.FindOrAdd(currentParent, item);
+    }
 
-        EntryNode<RPF7Entry>* existingNode = currentParent->Find(item);
-        if (existingNode != nullptr)
-        {
-            currentParent = existingNode;
-            continue;
-        }
+    if (currentParent == EntryNodeTree<RPF7Entry>::ROOT_NODE)
+        return;
 
-        EntryNode<RPF7Entry>* node = currentParent->Add(item);
-        currentParent = node;
+    EntryNode<RPF7Entry>& node = m_NodeTree.GetNode(currentParent);
+    if (node.m_DataIndex == INVALID_ENTRY_NODE)
+    {
+        node.m_DataIndex = static_cast<uint32_t>(m_PendingEntries.size());
+        m_PendingEntries.emplace_back();
     }
 
-    if (currentParent != nullptr)
+    m_PendingEntries[node.m_DataIndex] = {entryPath.string(), entrySource};
+}
+
+bool RPF7Archive::RemoveEntry(const std::string& entryPath)
+{
+    if (!IsWriting() && !IsUpdating())
+        return false;
+
+    if (m_OutputFile == nullptr)
+        return false;
+
+    std::istringstream iss(CorrectEntryPath(entryPath).string());
+    std::string item;
+
+    uint32_t currentNode = EntryNodeTree<RPF7Entry>::ROOT_NODE;
+    while (std::getline(iss, item, '/'))
     {
-        currentParent->m_RelativePath = entryPath;
-        currentParent->m_FilePath = entryFilePath;
+        if (item.empty())
+            continue;
+
+        currentNode = m_NodeTree.Find(currentNode, item);
+        if (currentNode == INVALID_ENTRY_NODE)
+            return false;
     }
+
+    if (currentNode == EntryNodeTree<RPF7Entry>::ROOT_NODE)
+        return false;
+
+    m_NodeTree.Remove(currentNode);
+    return true;
 }
 
 RPF7Archive::EntryDataBuffer RPF7Archive::GetEntryData(const std::string& entryPath)
@@ -139,31 +239,469 @@ RPF7Archive::EntryDataBuffer RPF7Archive::GetEntryData(const std::string& entryP
     if (!IsReading())
         return buffer;
 
-    if (m_EntryMap.empty())
+    const RPF7Entry* entry = FindEntry(entryPath);
+    if (entry == nullptr)
         return buffer;
 
-    if (!m_FileStream.is_open())
+    return GetEntryData(*entry);
+}
+
+RPF7Archive::EntryDataBuffer RPF7Archive::GetEntryData(const RPF7Entry& entry)
+{
+    EntryDataBuffer buffer;
+    if (!IsReading())
         return buffer;
 
-    const RPF7Entry* entry = m_EntryMap.at(entryPath);
-    uint64_t entryFileOffset = entry->m_EntryOffset * RPF7Entry::BLOCK_SIZE;
-    uint64_t entryFileSize = entry->GetEntrySize();
+    if (!IsOpen())
+        return buffer;
+
+    if (m_EntryCache != nullptr)
+    {
+        std::shared_ptr<const EntryDataBuffer> sharedData = GetSharedEntryData(entry);
+        if (sharedData != nullptr)
+            buffer = *sharedData;
+
+        return buffer;
+    }
+
+    EntryDataBuffer outputBuffer;
+    std::span<const uint8_t> data = ReadEntryData(entry, buffer, outputBuffer);
+
+    if (data.data() == outputBuffer.data())
+        return outputBuffer;
+
+    if (data.data() == buffer.data())
+        return buffer;
+
+    return EntryDataBuffer(data.begin(), data.end());
+}
+
+std::vector<RPF7Archive::EntryDataBuffer> RPF7Archive::GetEntriesData(const std::vector<std::string>& entryPaths, const RPF7BatchReadOptions& options)
+{
+    std::vector<EntryDataBuffer> entriesData(entryPaths.size());
+    if (!IsReading())
+        return entriesData;
+
+    if (!IsOpen())
+        return entriesData;
+
+    RPFLIB_STAT_SCOPE(m_Stats, STAT_TIMER_READ_BATCH);
+
+    struct BatchJob
+    {
+        const RPF7Entry* m_Entry;
+        uint64_t m_Offset;
+        uint64_t m_Size;
+        uint32_t m_ResultIndex;
+    };
+
+    std::vector<BatchJob> jobs;
+    jobs.reserve(entryPaths.size());
+
+    for (uint32_t i = 0; i < entryPaths.size(); i++)
+    {
+        const RPF7Entry* entry = FindEntry(entryPaths[i]);
+        if (entry == nullptr || entry->IsDirectory())
+            continue;
+
+        uint64_t entryFileOffset = entry->m_EntryOffset * RPF7Entry::BLOCK_SIZE;
+        uint64_t entryFileSize = GetEntryStoredSize(*entry);
+        if (entryFileOffset + entryFileSize > m_ArchiveSize)
+            continue;
+
+        if (m_EntryCache != nullptr)
+        {
+            EntryCache::EntryDataPointer cachedData = m_EntryCache->Find(static_cast<uint32_t>(entry - m_Entries.data()));
+            if (cachedData != nullptr)
+            {
+                entriesData[i] = *cachedData;
+                continue;
+            }
+        }
+
+        jobs.push_back({entry, entryFileOffset, entryFileSize, i});
+    }
 
-    auto oldPosition = m_FileStream.tellg();
-    m_FileStream.seekg(entryFileOffset, std::ios::beg);
+    if (jobs.empty())
+        return entriesData;
 
-    buffer.resize(entryFileSize);
-    m_FileStream.read((char*)buffer.data(), entryFileSize);
+    std::sort(jobs.begin(), jobs.end(), [](const BatchJob& a, const BatchJob& b) { return a.m_Offset < b.m_Offset; });
 
-    if (entry->IsCompressed())
+    struct ReadGroup
     {
-        buffer = DecompressData(buffer.data(), buffer.size());
+        uint64_t m_Offset;
+        uint64_t m_Size;
+        size_t m_FirstJob;
+        size_t m_JobCount;
+    };
+
+    // merge entries whose ranges touch or are close enough that reading the gap is cheaper than another seek
+    std::vector<ReadGroup> groups;
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        const BatchJob& job = jobs[i];
+        if (!groups.empty())
+        {
+            ReadGroup& group = groups.back();
+            uint64_t groupEnd = group.m_Offset + group.m_Size;
+            uint64_t jobEnd = std::max(groupEnd, job.m_Offset + job.m_Size);
+            if (job.m_Offset <= GetEntryDataBlockSize(groupEnd) + options.m_MaxGapBytes && jobEnd - group.m_Offset <= options.m_MaxReadBytes)
+            {
+                group.m_Size = jobEnd - group.m_Offset;
+                group.m_JobCount++;
+                continue;
+            }
+        }
+
+        groups.push_back({job.m_Offset, job.m_Size, i, 1});
     }
 
-    if (oldPosition > m_FileStream.tellg())
-        m_FileStream.seekg(oldPosition, std::ios::beg);
+    ThreadPool threadPool(options.m_ThreadCount);
+    std::mutex groupMutex;
+    std::condition_variable groupDone;
+    uint64_t inFlightBytes = 0;
+
+    // the calling thread streams through the archive in offset order while the workers slice and inflate
+    for (const ReadGroup& group : groups)
+    {
+        std::shared_ptr<EntryDataBuffer> groupData;
+        std::span<const uint8_t> groupView;
 
-    return buffer;
+        if (m_ArchiveFile->IsMapped())
+        {
+            groupView = m_ArchiveFile->GetView(m_BaseOffset + group.m_Offset, group.m_Size);
+            if (groupView.size() != group.m_Size)
+                continue;
+        }
+        else
+        {
+            {
+                std::unique_lock lock(groupMutex);
+                groupDone.wait(lock, [&] { return inFlightBytes == 0 || inFlightBytes + group.m_Size <= options.m_MaxInFlightBytes; });
+                inFlightBytes += group.m_Size;
+            }
+
+            groupData = std::make_shared<EntryDataBuffer>(group.m_Size);
+            if (!ReadArchiveData(group.m_Offset, groupData->data(), groupData->size()))
+            {
+                std::lock_guard lock(groupMutex);
+                inFlightBytes -= group.m_Size;
+                continue;
+            }
+
+            groupView = *groupData;
+        }
+
+        threadPool.Submit(
+            [&, &group = group, groupData, groupView](uint32_t)
+            {
+                for (size_t i = group.m_FirstJob; i < group.m_FirstJob + group.m_JobCount; i++)
+                {
+                    const BatchJob& job = jobs[i];
+                    std::span<const uint8_t> storedData = groupView.subspan(job.m_Offset - group.m_Offset, job.m_Size);
+                    EntryDataBuffer& entryData = entriesData[job.m_ResultIndex];
+
+                    m_Stats.Add(StatCounter::STAT_COUNTER_ENTRIES_READ, 1);
+
+                    EntryDataBuffer decryptedData;
+                    if (IsEntryEncrypted(*job.m_Entry))
+                    {
+                        decryptedData.assign(storedData.begin(), storedData.end());
+                        DecryptEntryData(*job.m_Entry, decryptedData.data(), 0, decryptedData.size());
+                        storedData = decryptedData;
+                    }
+
+                    if (job.m_Entry->IsCompressed())
+                    {
+                        RPFLIB_STAT_SCOPE(m_Stats, STAT_TIMER_INFLATE);
+
+                        entryData.resize(job.m_Entry->m_FileEntry.m_RealSize);
+                        uint64_t inflatedSize = DecompressData(storedData.data(), storedData.size(), entryData.data(), entryData.size());
+                        entryData.resize(inflatedSize);
+
+                        m_Stats.Add(StatCounter::STAT_COUNTER_INFLATE_BYTES_IN, storedData.size());
+                        m_Stats.Add(StatCounter::STAT_COUNTER_INFLATE_BYTES_OUT, inflatedSize);
+                    }
+                    else
+                    {
+                        entryData.assign(storedData.begin(), storedData.end());
+                        if (job.m_Entry->HasSaturatedSize())
+                            RestoreResourceHeader(*job.m_Entry, entryData.data());
+                    }
+
+                    if (m_EntryCache != nullptr)
+                        m_EntryCache->Insert(static_cast<uint32_t>(job.m_Entry - m_Entries.data()), EntryDataBuffer(entryData));
+                }
+
+                if (groupData != nullptr)
+                {
+                    std::lock_guard lock(groupMutex);
+                    inFlightBytes -= group.m_Size;
+                    groupDone.notify_all();
+                }
+            });
+    }
+    threadPool.Wait();
+
+    return entriesData;
+}
+
+uint64_t RPF7Archive::GetEntryStoredSize(const RPF7Entry& entry) const
+{
+    if (!entry.HasSaturatedSize())
+        return entry.GetEntrySize();
+
+    uint8_t resourceHeader[sizeof(RSC7Header)];
+    if (!ReadArchiveData(entry.m_EntryOffset * RPF7Entry::BLOCK_SIZE, resourceHeader, sizeof(resourceHeader)))
+        return entry.GetEntrySize();
+
+    return GetResourceSizeFromHeader(resourceHeader);
+}
+
+bool RPF7Archive::GetResourceInfo(const RPF7Entry& entry, RPF7ResourceInfo& info) const
+{
+    if (!entry.IsResource())
+        return false;
+
+    info.m_Version = entry.GetResourceVersion();
+    info.m_VirtualSize = entry.GetVirtualSize();
+    info.m_PhysicalSize = entry.GetPhysicalSize();
+    info.m_StoredSize = GetEntryStoredSize(entry);
+
+    return true;
+}
+
+bool RPF7Archive::GetResourceData(const RPF7Entry& entry, std::span<uint8_t> virtualData, std::span<uint8_t> physicalData)
+{
+    if (!IsReading())
+        return false;
+
+    if (!IsOpen())
+        return false;
+
+    RPF7ResourceInfo info;
+    if (!GetResourceInfo(entry, info))
+        return false;
+
+    if (info.m_StoredSize < sizeof(RSC7Header) || virtualData.size() < info.m_VirtualSize || physicalData.size() < info.m_PhysicalSize)
+        return false;
+
+    EntryDataBuffer readBuffer;
+    EntryDataBuffer outputBuffer;
+    std::span<const uint8_t> storedData = ReadEntryData(entry, readBuffer, outputBuffer);
+    if (storedData.size() != info.m_StoredSize)
+        return false;
+
+    RPFLIB_STAT_SCOPE(m_Stats, STAT_TIMER_INFLATE);
+
+    // the body is one deflate stream holding the virtual segment followed by the physical one
+    std::span<const uint8_t> body = storedData.subspan(sizeof(RSC7Header));
+
+    z_stream infstream {};
+    infstream.next_in = const_cast<Bytef*>(body.data());
+    infstream.avail_in = (uInt)body.size();
+
+    if (inflateInit2(&infstream, -15) != Z_OK)
+        return false;
+
+    int result = Z_OK;
+    std::span<uint8_t> segments[] = {virtualData.first(info.m_VirtualSize), physicalData.first(info.m_PhysicalSize)};
+    for (std::span<uint8_t> segment : segments)
+    {
+        infstream.next_out = segment.data();
+        infstream.avail_out = (uInt)segment.size();
+
+        while (infstream.avail_out > 0 && result == Z_OK)
+            result = inflate(&infstream, Z_NO_FLUSH);
+    }
+
+    uint64_t inflatedSize = infstream.total_out;
+    inflateEnd(&infstream);
+
+    m_Stats.Add(StatCounter::STAT_COUNTER_INFLATE_BYTES_IN, body.size());
+    m_Stats.Add(StatCounter::STAT_COUNTER_INFLATE_BYTES_OUT, inflatedSize);
+
+    return inflatedSize == info.m_VirtualSize + info.m_PhysicalSize;
+}
+
+bool RPF7Archive::GetResourceData(const std::string& entryPath, EntryDataBuffer& virtualData, EntryDataBuffer& physicalData)
+{
+    if (!IsReading())
+        return false;
+
+    const RPF7Entry* entry = FindEntry(entryPath);
+    if (entry == nullptr || !entry->IsResource())
+        return false;
+
+    virtualData.resize(entry->GetVirtualSize());
+    physicalData.resize(entry->GetPhysicalSize());
+
+    return GetResourceData(*entry, virtualData, physicalData);
+}
+
+std::shared_ptr<const RPF7Archive::EntryDataBuffer> RPF7Archive::GetSharedEntryData(const std::string& entryPath)
+{
+    if (!IsReading())
+        return nullptr;
+
+    const RPF7Entry* entry = FindEntry(entryPath);
+    if (entry == nullptr)
+        return nullptr;
+
+    return GetSharedEntryData(*entry);
+}
+
+std::shared_ptr<const RPF7Archive::EntryDataBuffer> RPF7Archive::GetSharedEntryData(const RPF7Entry& entry)
+{
+    if (!IsReading())
+        return nullptr;
+
+    if (!IsOpen())
+        return nullptr;
+
+    // entries are cached by their position in the entry table, entries from elsewhere bypass the cache
+    bool isCacheable = m_EntryCache != nullptr && &entry >= m_Entries.data() && &entry < m_Entries.data() + m_Entries.size();
+    uint32_t entryIndex = isCacheable ? static_cast<uint32_t>(&entry - m_Entries.data()) : 0;
+
+    if (isCacheable)
+    {
+        EntryCache::EntryDataPointer cachedData = m_EntryCache->Find(entryIndex);
+        if (cachedData != nullptr)
+            return cachedData;
+    }
+
+    EntryDataBuffer readBuffer;
+    EntryDataBuffer outputBuffer;
+    std::span<const uint8_t> data = ReadEntryData(entry, readBuffer, outputBuffer);
+
+    EntryDataBuffer entryData;
+    if (data.data() == outputBuffer.data())
+        entryData = std::move(outputBuffer);
+    else if (data.data() == readBuffer.data())
+        entryData = std::move(readBuffer);
+    else
+        entryData.assign(data.begin(), data.end());
+
+    // a failed or short read is returned as it is but never cached, the next call reads the entry again
+    uint64_t entrySize = entry.IsCompressed() ? entry.m_FileEntry.m_RealSize : GetEntryStoredSize(entry);
+    if (isCacheable && entryData.size() == entrySize)
+        return m_EntryCache->Insert(entryIndex, std::move(entryData));
+
+    return std::make_shared<const EntryDataBuffer>(std::move(entryData));
+}
+
+EntryCache::Stats RPF7Archive::GetCacheStats() const
+{
+    if (m_EntryCache == nullptr)
+        return {};
+
+    return m_EntryCache->GetStats();
+}
+
+void RPF7Archive::GetEntryDataAsync(const std::string& entryPath, EntryDataCallback callback, AsyncReader& asyncReader)
+{
+    const RPF7Entry* entry = IsReading() && IsOpen() ? FindEntry(entryPath) : nullptr;
+    if (entry == nullptr || entry->IsDirectory())
+    {
+        callback({}, false);
+        return;
+    }
+
+    uint64_t entryFileOffset = entry->m_EntryOffset * RPF7Entry::BLOCK_SIZE;
+    uint64_t entryFileSize = GetEntryStoredSize(*entry);
+    uint64_t entryDataSize = entry->IsCompressed() ? entry->m_FileEntry.m_RealSize : entryFileSize;
+    if (entryFileOffset + entryFileSize > m_ArchiveSize)
+    {
+        callback({}, false);
+        return;
+    }
+
+    // cached and mapped entries need no I/O, they are decoded on a worker like everything else
+    if (m_EntryCache != nullptr || m_ArchiveFile->IsMapped())
+    {
+        asyncReader.Submit([this, entry, entryDataSize, callback = std::move(callback)]() {
+            EntryDataBuffer entryData = GetEntryData(*entry);
+            bool isSuccess = entryData.size() == entryDataSize;
+            callback(std::move(entryData), isSuccess);
+        });
+        return;
+    }
+
+    m_Stats.Add(StatCounter::STAT_COUNTER_ENTRIES_READ, 1);
+    m_Stats.Add(StatCounter::STAT_COUNTER_READ_CALLS, 1);
+    m_Stats.Add(StatCounter::STAT_COUNTER_BYTES_READ, entryFileSize);
+    if (m_OpenOptions.m_CountSeeks && m_LastReadEnd.exchange(entryFileOffset + entryFileSize, std::memory_order_relaxed) != entryFileOffset)
+        m_Stats.Add(StatCounter::STAT_COUNTER_SEEKS, 1);
+
+    std::shared_ptr<EntryDataBuffer> storedData = std::make_shared<EntryDataBuffer>(entryFileSize);
+    asyncReader.Read(m_ArchiveFile, m_BaseOffset + entryFileOffset, storedData->data(), entryFileSize,
+                     [this, entry, entryDataSize, storedData, callback = std::move(callback)](bool isSuccess) {
+                         if (!isSuccess)
+                         {
+                             callback({}, false);
+                             return;
+                         }
+
+                         if (IsEntryEncrypted(*entry))
+                             DecryptEntryData(*entry, storedData->data(), 0, storedData->size());
+
+                         if (!entry->IsCompressed())
+                         {
+                             if (entry->HasSaturatedSize())
+                                 RestoreResourceHeader(*entry, storedData->data());
+
+                             callback(std::move(*storedData), true);
+                             return;
+                         }
+
+                         EntryDataBuffer entryData(entryDataSize);
+                         uint64_t inflatedSize = 0;
+                         {
+                             RPFLIB_STAT_SCOPE(m_Stats, STAT_TIMER_INFLATE);
+                             inflatedSize = DecompressData(storedData->data(), storedData->size(), entryData.data(), entryData.size());
+                         }
+                         entryData.resize(inflatedSize);
+
+                         m_Stats.Add(StatCounter::STAT_COUNTER_INFLATE_BYTES_IN, storedData->size());
+                         m_Stats.Add(StatCounter::STAT_COUNTER_INFLATE_BYTES_OUT, inflatedSize);
+
+                         callback(std::move(entryData), inflatedSize == entryDataSize);
+                     });
+}
+
+std::future<RPF7Archive::EntryDataBuffer> RPF7Archive::GetEntryDataAsync(const std::string& entryPath, AsyncReader& asyncReader)
+{
+    std::shared_ptr<std::promise<EntryDataBuffer>> promise = std::make_shared<std::promise<EntryDataBuffer>>();
+    std::future<EntryDataBuffer> future = promise->get_future();
+
+    GetEntryDataAsync(
+        entryPath, [promise](EntryDataBuffer&& entryData, bool isSuccess) { promise->set_value(isSuccess ? std::move(entryData) : EntryDataBuffer {}); },
+        asyncReader);
+
+    return future;
+}
+
+std::span<const uint8_t> RPF7Archive::GetEntryView(const std::string& entryPath, EntryDataBuffer& fallbackBuffer)
+{
+    if (!IsReading())
+        return {};
+
+    const RPF7Entry* entry = FindEntry(entryPath);
+    if (entry == nullptr)
+        return {};
+
+    // encrypted entries and the header of resources with a saturated size have to be decoded in a copy
+    if (m_ArchiveFile != nullptr && m_ArchiveFile->IsMapped() && !entry->IsCompressed() && !entry->HasSaturatedSize() && !IsEntryEncrypted(*entry))
+    {
+        uint64_t entryFileOffset = entry->m_EntryOffset * RPF7Entry::BLOCK_SIZE;
+        if (entryFileOffset + entry->GetEntrySize() > m_ArchiveSize)
+            return {};
+
+        return m_ArchiveFile->GetView(m_BaseOffset + entryFileOffset, entry->GetEntrySize());
+    }
+
+    fallbackBuffer = GetEntryData(*entry);
+    return fallbackBuffer;
 }
 
 IRPFArchive::EntryPathList RPF7Archive::GetEntryList()
@@ -172,10 +710,15 @@ IRPFArchive::EntryPathList RPF7Archive::GetEntryList()
     if (!IsReading())
         return pathList;
 
-    if (m_EntryMap.empty())
+    EnsureEntryIndex();
+    if (m_EntryIndex.IsEmpty())
         return pathList;
 
-    std::transform(m_EntryMap.begin(), m_EntryMap.end(), std::back_inserter(pathList), [](const std::pair<std::string, const RPF7Entry*>& pair) { return pair.first; });
+    pathList.reserve(m_EntryIndex.GetSize());
+    for (const EntryIndex::Item& item : m_EntryIndex.GetItems())
+        pathList.emplace_back(m_EntryIndex.GetPath(item));
+
+    std::sort(pathList.begin(), pathList.end());
 
     return pathList;
 }
@@ -185,13 +728,11 @@ bool RPF7Archive::SaveEntryToPath(const std::string& entryPath, const std::files
     if (!IsReading())
         return false;
 
-    if (m_EntryMap.empty())
+    const RPF7Entry* entry = FindEntry(entryPath);
+    if (entry == nullptr)
         return false;
 
-    if (!DoesEntryExists(entryPath))
-        return false;
-
-    EntryDataBuffer buffer = GetEntryData(entryPath);
+    EntryDataBuffer buffer = GetEntryData(*entry);
 
     std::filesystem::create_directories(outputPath.parent_path());
     std::fstream outputFile(outputPath, std::ios::binary | std::ios::out | std::ios::trunc);
@@ -201,265 +742,1076 @@ bool RPF7Archive::SaveEntryToPath(const std::string& entryPath, const std::files
     outputFile.write(reinterpret_cast<char*>(buffer.data()), buffer.size());
     outputFile.close();
 
-    return true;
+    return true;
+}
+
+std::unique_ptr<EntryReader> RPF7Archive::OpenEntryStream(const std::string& entryPath)
+{
+    if (!IsReading())
+        return nullptr;
+
+    if (!IsOpen())
+        return nullptr;
+
+    const RPF7Entry* entry = FindEntry(entryPath);
+    if (entry == nullptr)
+        return nullptr;
+
+    uint64_t entryFileOffset = entry->m_EntryOffset * RPF7Entry::BLOCK_SIZE;
+    uint64_t entryFileSize = GetEntryStoredSize(*entry);
+    uint64_t entrySize = entry->IsCompressed() ? entry->m_FileEntry.m_RealSize : entryFileSize;
+
+    if (entryFileOffset + entryFileSize > m_ArchiveSize)
+        return nullptr;
+
+    EntryReader::DecryptCallback decrypt;
+    if (IsEntryEncrypted(*entry))
+        decrypt = [this, entry](uint8_t* data, uint64_t storedOffset, uint64_t size) { DecryptEntryData(*entry, data, storedOffset, size); };
+
+    std::unique_ptr<EntryReader> reader =
+        std::make_unique<EntryReader>(m_ArchiveFile, m_BaseOffset + entryFileOffset, entryFileSize, entrySize, entry->IsCompressed(), std::move(decrypt));
+
+    // the stored header of a large resource carries its size, the stream serves the header the resource was added with
+    if (entry->HasSaturatedSize())
+    {
+        uint8_t resourceHeader[sizeof(RSC7Header)];
+        RestoreResourceHeader(*entry, resourceHeader);
+        reader->SetLeadingBytes(resourceHeader);
+    }
+
+    return reader;
+}
+
+EntrySource RPF7Archive::OpenEntrySource(const std::string& entryPath)
+{
+    if (!IsReading())
+        return {};
+
+    const RPF7Entry* entry = FindEntry(entryPath);
+    if (entry == nullptr)
+        return {};
+
+    uint64_t entrySize = entry->IsCompressed() ? entry->m_FileEntry.m_RealSize : GetEntryStoredSize(*entry);
+
+    return EntrySource::FromStream(entrySize,
+                                   [this, entryPath]() -> EntrySource::ReadCallback
+                                   {
+                                       std::shared_ptr<EntryReader> reader = OpenEntryStream(entryPath);
+                                       if (reader == nullptr)
+                                           return nullptr;
+
+                                       return [reader](uint8_t* buffer, uint64_t size) { return reader->Read(buffer, size); };
+                                   });
+}
+
+std::unique_ptr<RPF7Archive> RPF7Archive::OpenNestedArchive(const std::string& entryPath)
+{
+    if (!IsReading())
+        return nullptr;
+
+    if (!IsOpen())
+        return nullptr;
+
+    const RPF7Entry* entry = FindEntry(entryPath);
+    if (entry == nullptr)
+        return nullptr;
+
+    // nested archives are always stored, anything else can not be addressed in place
+    if (!entry->IsFile() || entry->IsCompressed() || IsEntryEncrypted(*entry))
+        return nullptr;
+
+    uint64_t entryFileOffset = entry->m_EntryOffset * RPF7Entry::BLOCK_SIZE;
+    uint64_t entryFileSize = entry->GetEntrySize();
+    if (entryFileOffset + entryFileSize > m_ArchiveSize)
+        return nullptr;
+
+    // any spelling of the path names the nested archive alike, NG decryption keys on the file name the entry is stored with
+    std::string entryPathBuffer(entryPath);
+    std::replace(entryPathBuffer.begin(), entryPathBuffer.end(), '\\', '/');
+    std::string normalizedBuffer;
+    std::string_view normalizedPath = EntryIndex::NormalizePath(entryPathBuffer, normalizedBuffer);
+    std::filesystem::path nestedPath = m_Path / std::filesystem::path(normalizedPath.substr(1)).parent_path() / GetEntryNameView(*entry);
+
+    std::unique_ptr<RPF7Archive> nestedArchive(new RPF7Archive(nestedPath, m_ArchiveFile, m_BaseOffset + entryFileOffset, entryFileSize, m_OpenOptions));
+    if (!nestedArchive->IsOpen())
+        return nullptr;
+
+    return nestedArchive;
+}
+
+uint64_t RPF7Archive::ExtractAll(const std::filesystem::path& outputDirectory, const RPF7ExtractOptions& options)
+{
+    return ExtractAll(outputDirectory, nullptr, options);
+}
+
+uint64_t RPF7Archive::ExtractAll(const std::filesystem::path& outputDirectory, const EntryFilter& filter, const RPF7ExtractOptions& options)
+{
+    if (!IsReading())
+        return 0;
+
+    if (!IsOpen())
+        return 0;
+
+    RPFLIB_STAT_SCOPE(m_Stats, STAT_TIMER_EXTRACT_ALL);
+
+    struct ExtractJob
+    {
+        const RPF7Entry* m_Entry;
+        std::filesystem::path m_OutputPath;
+    };
+
+    EnsureEntryIndex();
+
+    std::vector<ExtractJob> jobs;
+    jobs.reserve(m_EntryIndex.GetSize());
+
+    std::string entryPath;
+    for (const EntryIndex::Item& item : m_EntryIndex.GetItems())
+    {
+        entryPath = m_EntryIndex.GetPath(item);
+        if (filter && !filter(entryPath))
+            continue;
+
+        // names come from the archive, a rooted path or a parent component would land outside outputDirectory
+        std::filesystem::path relativePath = std::filesystem::path(entryPath.substr(1)).lexically_normal();
+        if (relativePath.empty() || relativePath.has_root_path() || *relativePath.begin() == ".." || relativePath == ".")
+        {
+            printf("WARNING: Skipping %s, it does not stay inside the output directory\n", entryPath.c_str());
+            continue;
+        }
+
+        jobs.push_back({&m_Entries[item.m_EntryIndex], outputDirectory / relativePath});
+    }
+
+    if (jobs.empty())
+        return 0;
+
+    // reading in on-disk order keeps every worker streaming forward through the archive
+    std::sort(jobs.begin(), jobs.end(), [](const ExtractJob& a, const ExtractJob& b) { return a.m_Entry->m_EntryOffset < b.m_Entry->m_EntryOffset; });
+
+    std::set<std::filesystem::path> outputDirectories;
+    for (auto& job : jobs)
+        outputDirectories.insert(job.m_OutputPath.parent_path());
+
+    for (auto& directory : outputDirectories)
+        std::filesystem::create_directories(directory);
+
+    ThreadPool threadPool(options.m_ThreadCount);
+    uint32_t threadCount = threadPool.GetThreadCount();
+
+    struct WorkerBuffers
+    {
+        EntryDataBuffer m_ReadBuffer;
+        EntryDataBuffer m_OutputBuffer;
+    };
+    std::vector<WorkerBuffers> workerBuffers(threadCount);
+    std::atomic<uint64_t> extractedCount = 0;
+
+    // every worker gets one contiguous slice of the archive, stealing balances out uneven slices
+    for (uint64_t i = 0; i < jobs.size(); i++)
+    {
+        int32_t workerHint = static_cast<int32_t>((i * threadCount) / jobs.size());
+        threadPool.Submit(
+            [&, i](uint32_t workerIndex)
+            {
+                const ExtractJob& job = jobs[i];
+                WorkerBuffers& buffers = workerBuffers[workerIndex];
+
+                std::span<const uint8_t> data = ReadEntryData(*job.m_Entry, buffers.m_ReadBuffer, buffers.m_OutputBuffer);
+
+                // a failed read or inflate comes back short, the file is not created at all then
+                uint64_t entrySize = job.m_Entry->IsCompressed() ? job.m_Entry->m_FileEntry.m_RealSize : GetEntryStoredSize(*job.m_Entry);
+                if (data.size() != entrySize)
+                {
+                    printf("ERROR! Could not read %s\n", job.m_OutputPath.string().c_str());
+                    return;
+                }
+
+                std::fstream outputFile(job.m_OutputPath, std::ios::binary | std::ios::out | std::ios::trunc);
+                if (!outputFile.is_open())
+                    return;
+
+                outputFile.write(reinterpret_cast<const char*>(data.data()), data.size());
+                if (outputFile.good())
+                    extractedCount++;
+            },
+            workerHint);
+    }
+    threadPool.Wait();
+
+    return extractedCount;
+}
+
+bool RPF7Archive::DoesEntryExists(const std::string& entryPath)
+{
+    return FindEntry(entryPath) != nullptr;
+}
+
+const RPF7Entry* RPF7Archive::FindEntry(std::string_view entryPath) const
+{
+    if (m_Entries.empty())
+        return nullptr;
+
+    // both modes look up the same form, so "dir/x.bin" and "//dir//x.bin" resolve alike before and after indexing
+    std::string pathBuffer;
+    std::string_view rootName = GetEntryNameView(m_Entries[0]);
+    if (rootName.empty())
+    {
+        entryPath = EntryIndex::NormalizePath(entryPath, pathBuffer);
+    }
+    else
+    {
+        if (entryPath.size() <= rootName.size() || !EntryIndex::IsSamePath(entryPath.substr(0, rootName.size()), rootName))
+            return nullptr;
+
+        std::string normalizedBuffer;
+        pathBuffer = rootName;
+        pathBuffer += EntryIndex::NormalizePath(entryPath.substr(rootName.size()), normalizedBuffer);
+        entryPath = pathBuffer;
+    }
+
+    uint32_t entryIndex = m_IsEntryIndexBuilt ? m_EntryIndex.Find(entryPath) : ResolveEntryPath(entryPath);
+    if (entryIndex == EntryIndex::INVALID_INDEX)
+        return nullptr;
+
+    return &m_Entries[entryIndex];
+}
+
+const RPF7Entry* RPF7Archive::FindEntry(uint32_t entryPathHash) const
+{
+    EnsureEntryIndex();
+
+    uint32_t entryIndex = m_EntryIndex.Find(entryPathHash);
+    if (entryIndex == EntryIndex::INVALID_INDEX)
+        return nullptr;
+
+    return &m_Entries[entryIndex];
+}
+
+void RPF7Archive::ReadHeader(RPF7Header& header)
+{
+    if (!IsReading())
+        return;
+
+    if (!IsOpen())
+        return;
+
+    if (!ReadArchiveData(0, &header, sizeof(header)))
+        header = {};
+}
+
+void RPF7Archive::ReadNames()
+{
+    if (!IsReading())
+        return;
+
+    if (!IsOpen())
+        return;
+
+    RPFLIB_STAT_SCOPE(m_Stats, STAT_TIMER_READ_NAMES);
+
+    uint64_t namePosition = sizeof(RPF7Header) + (sizeof(RPF7Entry) * (uint64_t)m_Header.m_EntryCount);
+
+    // names are resolved straight from the raw heap, entries reference them by their shifted offset
+    uint32_t actualNameSize = m_Header.m_NameSize & 0x0FFFFFFF;
+    m_NameHeap.resize(actualNameSize);
+    if (!ReadArchiveData(namePosition, m_NameHeap.data(), m_NameHeap.size()))
+    {
+        m_NameHeap.clear();
+        return;
+    }
+
+    DecryptData(reinterpret_cast<uint8_t*>(m_NameHeap.data()), m_NameHeap.size(), m_Path.filename().string(), m_ArchiveSize);
+
+    // guarantees that every name lookup terminates inside the heap
+    m_NameHeap.push_back('\0');
+}
+
+void RPF7Archive::PrintEntryTree(const EntryNodeTree<RPF7Entry>& tree, uint32_t nodeIndex, uint16_t level)
+{
+    if (nodeIndex >= tree.GetNodeCount())
+        return;
+
+    tree.ForEachChild(nodeIndex, [&](uint32_t childIndex)
+    {
+        const EntryNode<RPF7Entry>& child = tree.GetNode(childIndex);
+        printf("%*s%.*s\n", level * 2, "", (int)child.m_Name.size(), child.m_Name.data());
+
+        if (child.HasChildren())
+            PrintEntryTree(tree, childIndex, level + 1);
+    });
+}
+
+void RPF7Archive::ReadEntries()
+{
+    if (!IsReading())
+        return;
+
+    if (!IsOpen())
+        return;
+
+    RPFLIB_STAT_SCOPE(m_Stats, STAT_TIMER_READ_ENTRIES);
+
+    m_Entries.resize(m_Header.m_EntryCount);
+    if (m_Entries.empty() || !ReadArchiveData(sizeof(RPF7Header), m_Entries.data(), sizeof(RPF7Entry) * m_Entries.size()))
+    {
+        m_Entries.clear();
+        return;
+    }
+
+    DecryptData(reinterpret_cast<uint8_t*>(m_Entries.data()), sizeof(RPF7Entry) * m_Entries.size(), m_Path.filename().string(), m_ArchiveSize);
+
+    RPF7Entry& rootEntry = m_Entries[0];
+    if (m_AesDecryptor != nullptr || m_NgDecryptor != nullptr)
+    {
+        // a table decrypted with the right key always starts with the unnamed root directory and its children
+        const auto& directory = rootEntry.m_DirectoryEntry;
+        if (!rootEntry.IsDirectory() || rootEntry.m_NameOffset != 0 || (uint64_t)directory.m_EntriesIndex + directory.m_EntriesCount > m_Entries.size())
+        {
+            printf("ERROR! The keys do not decrypt the entries of %s!\n", m_Path.string().c_str());
+            m_Entries.clear();
+            return;
+        }
+    }
+
+    if (!rootEntry.IsDirectory())
+    {
+        printf("ERROR! Root entry is not a directory!\n");
+        return;
+    }
+
+    if (m_OpenOptions.m_LazyIndex)
+    {
+        m_DirectoryIndices.resize(m_Entries.size());
+        m_DirectoryIndexOnce = std::make_unique<std::once_flag[]>(m_Entries.size());
+        return;
+    }
+
+    EnsureEntryIndex();
+}
+
+bool RPF7Archive::IsIndexFileEnabled() const
+{
+    // nested archives have no file of their own to key the index on
+    return !m_OpenOptions.m_IndexCacheDirectory.empty() && !IsUpdating() && m_BaseOffset == 0;
+}
+
+bool RPF7Archive::LoadIndexFile()
+{
+    if (!IsIndexFileEnabled())
+        return false;
+
+    RPF7IndexFile::Key key = RPF7IndexFile::GetKey(m_Path, m_Header);
+    std::unique_ptr<RPF7IndexFile> indexFile = RPF7IndexFile::Open(RPF7IndexFile::GetIndexPath(m_OpenOptions.m_IndexCacheDirectory, m_Path), key);
+    if (indexFile == nullptr)
+        return false;
+
+    std::span<const RPF7Entry> entries = indexFile->GetEntries();
+    std::span<const char> nameHeap = indexFile->GetNameHeap();
+    if (entries.empty() || entries.size() != m_Header.m_EntryCount || nameHeap.size() != (m_Header.m_NameSize & 0x0FFFFFFF))
+        return false;
+
+    for (const EntryIndex::Item& item : indexFile->GetItems())
+    {
+        if (item.m_EntryIndex >= entries.size())
+            return false;
+    }
+
+    // a checksum only proves the file is the one that was written, not that it describes this archive
+    uint64_t tableSize = sizeof(RPF7Header) + sizeof(RPF7Entry) * entries.size() + nameHeap.size();
+    if (tableSize > m_ArchiveSize || !entries[0].IsDirectory())
+        return false;
+
+    for (const RPF7Entry& entry : entries)
+    {
+        if (entry.IsDirectory())
+        {
+            if ((uint64_t)entry.m_DirectoryEntry.m_EntriesIndex + entry.m_DirectoryEntry.m_EntriesCount > entries.size())
+                return false;
+        }
+        else if ((uint64_t)entry.m_EntryOffset * RPF7Entry::BLOCK_SIZE + entry.GetEntrySize() > m_ArchiveSize)
+        {
+            return false;
+        }
+    }
+
+    if (!m_EntryIndex.Assign(indexFile->GetSlots(), indexFile->GetItems(), indexFile->GetPathData()))
+        return false;
+
+    m_Entries.assign(entries.begin(), entries.end());
+    m_NameHeap.assign(nameHeap.begin(), nameHeap.end());
+    m_NameHeap.push_back('\0');
+
+    // the index is complete, the node tree is only built if someone asks for it
+    std::call_once(m_EntryIndexOnce, [this]() { m_IsEntryIndexBuilt = true; });
+
+    return true;
+}
+
+void RPF7Archive::WriteIndexFile()
+{
+    if (!IsIndexFileEnabled() || m_Entries.empty() || m_NameHeap.empty())
+        return;
+
+    // lazy archives build the full index once so the next open does not need to resolve paths at all
+    EnsureEntryIndex();
+
+    RPF7IndexFile::Key key = RPF7IndexFile::GetKey(m_Path, m_Header);
+    std::span<const char> nameHeap(m_NameHeap.data(), m_NameHeap.size() - 1);
+    RPF7IndexFile::Write(RPF7IndexFile::GetIndexPath(m_OpenOptions.m_IndexCacheDirectory, m_Path), key, m_Entries, nameHeap, m_EntryIndex);
+}
+
+void RPF7Archive::EnsureEntryIndex() const
+{
+    // the index and node tree are caches over the immutable entry table, building them is logically const
+    std::call_once(m_EntryIndexOnce, [this]()
+    {
+        RPF7Archive* archive = const_cast<RPF7Archive*>(this);
+        if (archive->m_Entries.empty())
+            return;
+
+        RPFLIB_STAT_SCOPE(m_Stats, STAT_TIMER_BUILD_INDEX);
+
+        // one walk fills both, the tree is marked as built with it
+        std::call_once(m_NodeTreeOnce, [archive]()
+        {
+            RPF7Entry& rootEntry = archive->m_Entries[0];
+            archive->m_NodeTree.GetRoot().m_Entry = &rootEntry;
+            archive->m_NodeTree.Reserve(archive->m_Header.m_EntryCount);
+            archive->m_EntryIndex.Reserve(archive->m_Header.m_EntryCount);
+
+            std::string rootPath(archive->GetEntryNameView(rootEntry));
+            archive->BuildEntryMapAndNodeTree(rootEntry, EntryNodeTree<RPF7Entry>::ROOT_NODE, rootPath);
+        });
+
+        m_IsEntryIndexBuilt = true;
+    });
+}
+
+void RPF7Archive::EnsureNodeTree() const
+{
+    std::call_once(m_NodeTreeOnce, [this]()
+    {
+        RPF7Archive* archive = const_cast<RPF7Archive*>(this);
+        if (archive->m_Entries.empty())
+            return;
+
+        RPF7Entry& rootEntry = archive->m_Entries[0];
+        archive->m_NodeTree.GetRoot().m_Entry = &rootEntry;
+        archive->m_NodeTree.Reserve(m_Header.m_EntryCount);
+
+        // the index is already in use by readers at this point and must not be touched
+        std::string rootPath(GetEntryNameView(rootEntry));
+        archive->BuildEntryMapAndNodeTree(rootEntry, EntryNodeTree<RPF7Entry>::ROOT_NODE, rootPath, false);
+    });
+}
+
+const EntryIndex* RPF7Archive::GetDirectoryIndex(uint32_t directoryIndex) const
+{
+    if (directoryIndex >= m_DirectoryIndices.size())
+        return nullptr;
+
+    std::call_once(m_DirectoryIndexOnce[directoryIndex], [this, directoryIndex]()
+    {
+        const RPF7Entry& directoryEntry = m_Entries[directoryIndex];
+        if (!directoryEntry.IsDirectory())
+            return;
+
+        auto directoryIndexTable = std::make_unique<EntryIndex>();
+        directoryIndexTable->Reserve(directoryEntry.m_DirectoryEntry.m_EntriesCount);
+
+        for (uint32_t i = 0; i < directoryEntry.m_DirectoryEntry.m_EntriesCount; i++)
+        {
+            uint32_t entryArrayIdx = directoryEntry.m_DirectoryEntry.m_EntriesIndex + i;
+            if (entryArrayIdx >= m_Entries.size())
+                break;
+
+            directoryIndexTable->Insert(GetEntryNameView(m_Entries[entryArrayIdx]), entryArrayIdx);
+        }
+
+        m_DirectoryIndices[directoryIndex] = std::move(directoryIndexTable);
+    });
+
+    return m_DirectoryIndices[directoryIndex].get();
 }
 
-bool RPF7Archive::DoesEntryExists(const std::string& entryPath)
+uint32_t RPF7Archive::ResolveEntryPath(std::string_view entryPath) const
 {
-    if (m_EntryMap.empty())
-        return false;
+    // walks the directory ranges of the entry table, only the directories on the path get indexed
+    std::string_view rootName = GetEntryNameView(m_Entries[0]);
+    if (!rootName.empty())
+    {
+        if (entryPath.size() <= rootName.size() || !EntryIndex::IsSamePath(entryPath.substr(0, rootName.size()), rootName))
+            return EntryIndex::INVALID_INDEX;
 
-    return m_EntryMap.contains(entryPath);
-}
+        entryPath.remove_prefix(rootName.size());
+    }
 
-void RPF7Archive::ReadHeader(RPF7Header& header)
-{
-    if (!IsReading())
-        return;
+    uint32_t currentIndex = 0;
+    std::string_view entryName;
+    while (!entryPath.empty())
+    {
+        size_t separator = entryPath.find_first_of("/\\");
+        entryName = entryPath.substr(0, separator);
+        entryPath.remove_prefix(separator == std::string_view::npos ? entryPath.size() : separator + 1);
 
-    if (!m_FileStream.is_open())
-        return;
+        if (entryName.empty())
+            continue;
+
+        const EntryIndex* directoryIndex = GetDirectoryIndex(currentIndex);
+        if (directoryIndex == nullptr)
+            return EntryIndex::INVALID_INDEX;
+
+        currentIndex = directoryIndex->Find(entryName);
+        if (currentIndex == EntryIndex::INVALID_INDEX)
+            return EntryIndex::INVALID_INDEX;
+    }
 
-    auto oldPosition = m_FileStream.tellg();
-    m_FileStream.seekg(0, std::ios::beg);
-    m_FileStream.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (currentIndex == 0 || !HasExtension(entryName))
+        return EntryIndex::INVALID_INDEX;
 
-    if (oldPosition > m_FileStream.tellg())
-        m_FileStream.seekg(oldPosition, std::ios::beg);
+    return currentIndex;
 }
 
-void RPF7Archive::ReadNames()
+std::span<const uint8_t> RPF7Archive::ReadEntryData(const RPF7Entry& entry, EntryDataBuffer& readBuffer, EntryDataBuffer& outputBuffer) const
 {
-    if (!IsReading())
-        return;
+    uint64_t entryFileOffset = entry.m_EntryOffset * RPF7Entry::BLOCK_SIZE;
+    uint64_t entryFileSize = GetEntryStoredSize(entry);
+    if (entryFileOffset + entryFileSize > m_ArchiveSize)
+        return {};
 
-    if (!m_FileStream.is_open())
-        return;
-
-    auto oldPosition = m_FileStream.tellg();
-    uint32_t namePosition = sizeof(RPF7Header) + (sizeof(RPF7Entry) * m_Header.m_EntryCount);
-    m_FileStream.seekg(namePosition, std::ios::beg);
+    RPFLIB_STAT_SCOPE(m_Stats, STAT_TIMER_READ_ENTRY);
+    m_Stats.Add(StatCounter::STAT_COUNTER_ENTRIES_READ, 1);
 
-    uint32_t actualNameSize = m_Header.m_NameSize & 0x0FFFFFFF;
-    std::vector<uint8_t> nameBuffer(actualNameSize);
-    m_FileStream.read(reinterpret_cast<char*>(nameBuffer.data()), nameBuffer.size());
+    std::span<const uint8_t> storedData;
+    if (m_ArchiveFile->IsMapped())
+    {
+        storedData = m_ArchiveFile->GetView(m_BaseOffset + entryFileOffset, entryFileSize);
+        if (storedData.size() != entryFileSize)
+            return {};
+    }
+    else
+    {
+        readBuffer.resize(entryFileSize);
+        if (!ReadArchiveData(entryFileOffset, readBuffer.data(), entryFileSize))
+            return {};
 
-    uint32_t nameMask = (1 << m_NameShift) - 1;
+        storedData = readBuffer;
+    }
 
-    uint32_t startPosition = 0;
-    for (uint32_t i = 0; i < actualNameSize; i++)
+    if (IsEntryEncrypted(entry))
     {
-        uint8_t c = nameBuffer[i];
-        if (c == '\0')
-        {
-            std::string entryName(nameBuffer.data() + startPosition, nameBuffer.data() + i);
+        if (storedData.data() != readBuffer.data())
+            readBuffer.assign(storedData.begin(), storedData.end());
 
-            uint32_t alignedOffset = startPosition >> m_NameShift;
-            m_NameMap[alignedOffset] = entryName;
+        DecryptEntryData(entry, readBuffer.data(), 0, readBuffer.size());
+        storedData = readBuffer;
+    }
 
-            startPosition = ((i + 1 + nameMask) & ~nameMask);
-        }
+    if (entry.HasSaturatedSize())
+    {
+        if (storedData.data() != readBuffer.data())
+            readBuffer.assign(storedData.begin(), storedData.end());
+
+        RestoreResourceHeader(entry, readBuffer.data());
+        storedData = readBuffer;
     }
 
-    if (oldPosition > m_FileStream.tellg())
-        m_FileStream.seekg(oldPosition, std::ios::beg);
+    if (!entry.IsCompressed())
+        return storedData;
+
+    RPFLIB_STAT_SCOPE(m_Stats, STAT_TIMER_INFLATE);
+
+    outputBuffer.resize(entry.m_FileEntry.m_RealSize);
+    uint64_t inflatedSize = DecompressData(storedData.data(), storedData.size(), outputBuffer.data(), outputBuffer.size());
+    outputBuffer.resize(inflatedSize);
+
+    m_Stats.Add(StatCounter::STAT_COUNTER_INFLATE_BYTES_IN, storedData.size());
+    m_Stats.Add(StatCounter::STAT_COUNTER_INFLATE_BYTES_OUT, inflatedSize);
+
+    return outputBuffer;
 }
 
-void RPF7Archive::PrintEntryTree(EntryNode<RPF7Entry>* parent, uint16_t&& level)
+bool RPF7Archive::ReadArchiveData(uint64_t offset, void* buffer, uint64_t size) const
 {
-    if (parent == nullptr)
-        return;
+    if (m_ArchiveFile == nullptr)
+        return false;
 
-    EntryNode<RPF7Entry>* currentChild = parent->m_FirstChild;
-    while (currentChild != nullptr)
-    {
-        if (currentChild->m_FirstChild != nullptr)
-        {
-            PrintEntryTree(currentChild, level + 1);
-        }
+    if (offset > m_ArchiveSize || size > m_ArchiveSize - offset)
+        return false;
 
-        currentChild = currentChild->m_NextSibling;
-    }
+    m_Stats.Add(StatCounter::STAT_COUNTER_READ_CALLS, 1);
+    m_Stats.Add(StatCounter::STAT_COUNTER_BYTES_READ, size);
+    if (m_OpenOptions.m_CountSeeks && m_LastReadEnd.exchange(offset + size, std::memory_order_relaxed) != offset)
+        m_Stats.Add(StatCounter::STAT_COUNTER_SEEKS, 1);
+
+    return m_ArchiveFile->Read(m_BaseOffset + offset, buffer, size);
 }
 
-void RPF7Archive::ReadEntries()
+bool RPF7Archive::WriteArchive()
 {
-    if (!IsReading())
-        return;
+    BuildNameHeap();
+    m_Entries = BuildEntriesListFromNodeTree();
 
-    if (!m_FileStream.is_open())
-        return;
+    uint64_t tableSize = sizeof(RPF7Header) + sizeof(RPF7Entry) * m_Entries.size() + GetEntryNameBlockSize(m_NameHeapBuilder.GetHeap().size());
 
-    auto oldPosition = m_FileStream.tellg();
-    m_FileStream.seekg(sizeof(RPF7Header), std::ios::beg);
+    // entries are only stored compressed if that shrinks them, so the source sizes bound the size of the archive
+    uint64_t dataSize = 0;
+    for (const PendingEntry& pending : m_PendingEntries)
+        dataSize += GetEntryDataBlockSize(pending.m_Source.GetSize());
 
-    m_Entries.resize(m_Header.m_EntryCount);
-    m_FileStream.read(reinterpret_cast<char*>(m_Entries.data()), sizeof(RPF7Entry) * m_Entries.size());
+    m_OutputFile->Reserve(GetEntryDataBlockSize(tableSize) + dataSize);
 
-    RPF7Entry& rootEntry = m_Entries[0];
-    if (!rootEntry.IsDirectory())
+    // a new archive is written back to back right after the names
+    uint64_t nextBlock = GetEntryDataBlockSize(tableSize) / RPF7Entry::BLOCK_SIZE;
+    uint64_t dataEnd = 0;
+    bool isWritten = WriteEntriesData(
+        [&nextBlock, &dataEnd](uint64_t blockCount)
+        {
+            uint64_t firstBlock = nextBlock;
+            nextBlock += blockCount;
+            if (blockCount != 0)
+                dataEnd = nextBlock * RPF7Entry::BLOCK_SIZE;
+
+            return firstBlock;
+        },
+        {});
+
+    // without its data the archive gets no header and entry table, a reader never takes it for a complete one
+    isWritten = isWritten && WriteTableOfContents();
+    if (!isWritten)
     {
-        printf("ERROR! Root entry is not a directory!\n");
-        return;
+        printf("ERROR! Failed to write %s\n", m_Path.string().c_str());
+
+        // the entries already written and the reservation are dropped as well
+        m_OutputFile->Resize(0);
+        return false;
     }
 
-    m_RootNode.m_Entry = &rootEntry;
-    BuildEntryMapAndNodeTree(rootEntry, &m_RootNode);
+    // gives back the part of the reservation the compressed entries did not need
+    isWritten = m_OutputFile->Resize(std::max(tableSize, dataEnd));
+    if (!isWritten)
+        printf("ERROR! Failed to write %s\n", m_Path.string().c_str());
 
-    if (oldPosition > m_FileStream.tellg())
-        m_FileStream.seekg(oldPosition, std::ios::beg);
+    return isWritten;
 }
 
-void RPF7Archive::WriteHeader()
+bool RPF7Archive::WriteTableOfContents()
 {
-    if (!IsWriting())
-        return;
+    static const uint8_t namePadding[16] = {};
 
-    if (!m_FileStream.is_open())
-        return;
+    const std::vector<char>& nameHeap = m_NameHeapBuilder.GetHeap();
+    uint64_t nameBlockSize = GetEntryNameBlockSize(nameHeap.size());
 
     m_Header.m_Magic.m_Number = RPF7Archive::IDENT;
     m_Header.m_Encryption = ENCRYPTION_OPEN;
-    m_Header.m_EntryCount = GetEntryNodeTotalCount();
-
-    auto oldPosition = m_FileStream.tellp();
-    m_FileStream.seekg(0, std::ios::beg);
-    m_FileStream.write(reinterpret_cast<char*>(&m_Header), sizeof(RPF7Header));
+    m_Header.m_EntryCount = static_cast<uint32_t>(m_Entries.size());
+    m_Header.m_NameSize = nameBlockSize | (m_NameShift << 28);
+
+    std::span<const uint8_t> tableOfContents[] = {
+        {reinterpret_cast<const uint8_t*>(&m_Header), sizeof(RPF7Header)},
+        {reinterpret_cast<const uint8_t*>(m_Entries.data()), sizeof(RPF7Entry) * m_Entries.size()},
+        {reinterpret_cast<const uint8_t*>(nameHeap.data()), nameHeap.size()},
+        {namePadding, nameBlockSize - nameHeap.size()},
+    };
 
-    if (oldPosition > m_FileStream.tellp())
-        m_FileStream.seekp(oldPosition, std::ios::beg);
+    return m_OutputFile->Write(0, tableOfContents);
 }
 
-void RPF7Archive::WriteEntries()
+bool RPF7Archive::WriteEntriesData(const BlockAllocator& allocateBlocks, const std::vector<uint32_t>& relocatedNodes)
 {
-    if (!IsWriting())
-        return;
+    if (m_OutputFile == nullptr)
+        return false;
 
-    if (!m_FileStream.is_open())
-        return;
+    const CompressionPolicy& compressionPolicy = m_WriteOptions.m_CompressionPolicy;
 
-    auto oldPosition = m_FileStream.tellp();
-    m_FileStream.seekg(sizeof(RPF7Header), std::ios::beg);
+    // consecutive entries leave in large writes, the zero padding of every entry goes into the same write
+    OutputBuffer output(*m_OutputFile, m_WriteOptions.m_WriteBufferSize);
+    bool isWritten = true;
 
-    if (m_NameMap.empty())
-        m_NameMap = BuildEntriesNameMap();
+    struct WriteJob
+    {
+        const EntryNode<RPF7Entry>* m_Node = nullptr;
+        // nullptr for entries whose stored data is moved as is
+        const PendingEntry* m_Pending = nullptr;
+        uint64_t m_ReservedBytes = 0;
+        EntryDataBuffer m_Buffer;
+        std::span<const uint8_t> m_Data;
+        bool m_IsCompressed = false;
+        bool m_IsDone = false;
+        // the data could not be read, nothing from this job on is committed
+        bool m_IsFailed = false;
+        // deduplication only, set if an earlier job has the same content and this one was not compressed
+        ContentHash m_ContentHash;
+        bool m_IsHashed = false;
+        bool m_IsDuplicate = false;
+    };
 
-    if (m_Entries.empty())
-        m_Entries = BuildEntriesListFromNodeTree();
+    // collect the entries in the exact order the serial writer used, so offsets stay deterministic
+    std::vector<WriteJob> jobs;
+    std::function<void(uint32_t)> recurseEntryCollect = [&](uint32_t parentIndex)
+    {
+        m_NodeTree.ForEachChild(parentIndex, [&](uint32_t childIndex)
+        {
+            const EntryNode<RPF7Entry>& child = m_NodeTree.GetNode(childIndex);
+            if (child.HasChildren())
+                recurseEntryCollect(childIndex);
+
+            if (child.m_DataIndex == INVALID_ENTRY_NODE)
+                return;
+
+            WriteJob& job = jobs.emplace_back();
+            job.m_Node = &child;
+            job.m_Pending = &m_PendingEntries[child.m_DataIndex];
+            job.m_ReservedBytes = std::max<uint64_t>(job.m_Pending->m_Source.GetSize(), 1);
+        });
+    };
+    recurseEntryCollect(EntryNodeTree<RPF7Entry>::ROOT_NODE);
 
-    m_FileStream.write(reinterpret_cast<char*>(m_Entries.data()), sizeof(RPF7Entry) * m_Entries.size());
+    for (uint32_t nodeIndex : relocatedNodes)
+    {
+        WriteJob& job = jobs.emplace_back();
+        job.m_Node = &m_NodeTree.GetNode(nodeIndex);
+        job.m_ReservedBytes = std::max<uint64_t>(GetEntryStoredSize(*job.m_Node->m_Entry), 1);
+    }
 
-    if (oldPosition > m_FileStream.tellp())
-        m_FileStream.seekp(oldPosition, std::ios::beg);
-}
+    ThreadPool threadPool(m_WriteOptions.m_ThreadCount);
+    std::mutex jobMutex;
+    std::condition_variable jobDone;
 
-void RPF7Archive::WriteNames()
-{
-    if (!IsWriting())
-        return;
+    // lowest job seen so far per content, jobs above it skip compression as they will reuse its data
+    std::unordered_map<ContentHash, uint64_t, ContentHash::Hasher> firstJobByHash;
+    // entry whose data was committed first per content, later jobs are matched against it in commit order only,
+    // which keeps the layout independent of how the workers are scheduled
+    struct CommittedData
+    {
+        const RPF7Entry* m_Entry;
+        uint64_t m_StoredSize;
+    };
+    std::unordered_map<ContentHash, CommittedData, ContentHash::Hasher> committedByHash;
+    uint64_t dedupEntryCount = 0;
+    uint64_t dedupBytes = 0;
 
-    if (!m_FileStream.is_open())
-        return;
+    uint64_t nextJob = 0;
+    uint64_t inFlightBytes = 0;
+    auto submitJobs = [&]()
+    {
+        while (nextJob < jobs.size())
+        {
+            WriteJob& job = jobs[nextJob];
+            if (inFlightBytes != 0 && inFlightBytes + job.m_ReservedBytes > m_WriteOptions.m_MaxInFlightBytes)
+                break;
+
+            inFlightBytes += job.m_ReservedBytes;
+            threadPool.Submit(
+                [&, &job = job](uint32_t)
+                {
+                    const EntryNode<RPF7Entry>* node = job.m_Node;
+                    if (job.m_Pending == nullptr)
+                    {
+                        const RPF7Entry* entry = node->m_Entry;
+
+                        EntryDataBuffer storedData(GetEntryStoredSize(*entry));
+                        bool isRead = ReadArchiveData((uint64_t)entry->m_EntryOffset * RPF7Entry::BLOCK_SIZE, storedData.data(), storedData.size());
+                        if (!isRead)
+                            printf("ERROR! Failed to read entry data at block %u for moving it!\n", (uint32_t)entry->m_EntryOffset);
+
+                        std::lock_guard lock(jobMutex);
+                        job.m_IsFailed = !isRead;
+                        job.m_Data = storedData;
+                        job.m_Buffer = std::move(storedData);
+                        job.m_IsDone = true;
+                        jobDone.notify_all();
+                        return;
+                    }
+
+                    const EntrySource& source = job.m_Pending->m_Source;
+                    CompressionSettings compressionSettings = compressionPolicy.GetSettings(job.m_Pending->m_EntryPath);
+
+                    bool needToCompress = compressionSettings.m_Level != CompressionPolicy::STORE_LEVEL;
+                    needToCompress = needToCompress && !node->m_Entry->m_IsResource;
+
+                    // in-memory sources are compressed or written straight from the caller's memory
+                    EntryDataBuffer fileBuffer;
+                    std::span<const uint8_t> fileData = source.GetView();
+                    if (fileData.empty())
+                    {
+                        if (!source.GetData(fileBuffer))
+                        {
+                            printf("ERROR! Failed to read the data of %s!\n", job.m_Pending->m_EntryPath.c_str());
+
+                            std::lock_guard lock(jobMutex);
+                            job.m_IsFailed = true;
+                            job.m_IsDone = true;
+                            jobDone.notify_all();
+                            return;
+                        }
+
+                        fileData = fileBuffer;
+                    }
+
+                    if (m_WriteOptions.m_Deduplicate && !fileData.empty())
+                    {
+                        ContentHash contentHash = ContentHash::Compute(fileData);
+                        uint64_t jobIndex = &job - jobs.data();
+
+                        std::lock_guard lock(jobMutex);
+                        job.m_ContentHash = contentHash;
+                        job.m_IsHashed = true;
+
+                        auto [firstJob, isFirst] = firstJobByHash.try_emplace(contentHash, jobIndex);
+                        if (!isFirst && firstJob->second < jobIndex)
+                        {
+                            job.m_IsDuplicate = true;
+                            job.m_IsDone = true;
+                            jobDone.notify_all();
+                            return;
+                        }
+
+                        firstJob->second = jobIndex;
+                    }
+
+                    needToCompress = needToCompress && compressionPolicy.IsWorthCompressing(fileData);
+                    if (needToCompress)
+                    {
+                        // data that deflate does not shrink is stored, a compressed size equal to the real size
+                        // would also read back as uncompressed
+                        EntryDataBuffer compressedBuffer;
+                        {
+                            RPFLIB_STAT_SCOPE(m_Stats, STAT_TIMER_DEFLATE);
+                            compressedBuffer = CompressData(fileData, compressionSettings.m_Level, compressionSettings.m_Strategy);
+                        }
+
+                        m_Stats.Add(StatCounter::STAT_COUNTER_DEFLATE_BYTES_IN, fileData.size());
+                        m_Stats.Add(StatCounter::STAT_COUNTER_DEFLATE_BYTES_OUT, compressedBuffer.size());
+
+                        // the compressed size has to fit the 24 bit size field, only resources may saturate it
+                        needToCompress = !compressedBuffer.empty() && compressedBuffer.size() < fileData.size() && compressedBuffer.size() < RPF7Entry::MAX_FILE_SIZE;
+                        if (needToCompress)
+                        {
+                            fileBuffer = std::move(compressedBuffer);
+                            fileData = fileBuffer;
+                        }
+                    }
+
+                    std::lock_guard lock(jobMutex);
+                    job.m_Buffer = std::move(fileBuffer);
+                    job.m_Data = fileData;
+                    job.m_IsCompressed = needToCompress;
+                    job.m_IsDone = true;
+                    jobDone.notify_all();
+                });
+            nextJob++;
+        }
+    };
+
+    // compression runs ahead on the pool while entries are committed to the file strictly in order
+    for (WriteJob& job : jobs)
+    {
+        submitJobs();
+
+        {
+            std::unique_lock lock(jobMutex);
+            jobDone.wait(lock, [&job] { return job.m_IsDone; });
+        }
 
-    auto oldPosition = m_FileStream.tellp();
-    m_FileStream.seekg(sizeof(RPF7Header) + m_Header.m_EntryCount * sizeof(RPF7Entry), std::ios::beg);
+        if (job.m_IsFailed)
+        {
+            isWritten = false;
+            break;
+        }
 
-    auto currentPosition = m_FileStream.tellp();
-    uint32_t nameMask = (1 << m_NameShift) - 1;
+        RPF7Entry* entry = job.m_Node->m_Entry;
+        std::span<const uint8_t> fileData = job.m_Data;
 
-    for (auto& name : m_NameMap)
-    {
-        uint64_t currentOffset = (uint64_t)m_FileStream.tellp() - currentPosition;
-        uint32_t expectedShiftedOffset = name.first;
-        uint32_t expectedActualOffset = expectedShiftedOffset << m_NameShift;
+        if (job.m_IsHashed)
+        {
+            auto [committedData, isFirst] = committedByHash.try_emplace(job.m_ContentHash, CommittedData{entry, fileData.size()});
+            if (!isFirst)
+            {
+                // same content means the same resource flags and real size, only the data location is shared
+                entry->m_EntryOffset = committedData->second.m_Entry->m_EntryOffset;
+                entry->m_EntrySize = committedData->second.m_Entry->m_EntrySize;
+
+                uint64_t savedBytes = GetEntryDataBlockSize(committedData->second.m_StoredSize);
+                dedupEntryCount++;
+                dedupBytes += savedBytes;
+                m_Stats.Add(StatCounter::STAT_COUNTER_DEDUP_ENTRIES, 1);
+                m_Stats.Add(StatCounter::STAT_COUNTER_DEDUP_BYTES, savedBytes);
+
+                EntryDataBuffer().swap(job.m_Buffer);
+                inFlightBytes -= job.m_ReservedBytes;
+                continue;
+            }
+
+            if (job.m_IsDuplicate)
+                printf("ERROR! Deduplicated entry has no committed copy!\n");
+        }
+
+        // large resources keep their real size in otherwise unused bytes of their header
+        bool isSizeInHeader = job.m_Pending != nullptr && entry->m_IsResource && fileData.size() >= RPF7Entry::MAX_FILE_SIZE;
+        if (job.m_Pending != nullptr)
+        {
+            if (entry->m_IsResource || job.m_IsCompressed)
+                entry->m_EntrySize = std::min<uint64_t>(fileData.size(), RPF7Entry::MAX_FILE_SIZE);
+            else
+                entry->m_EntrySize = 0;
+        }
 
-        if (currentOffset != expectedActualOffset)
+        uint64_t firstBlock = allocateBlocks(GetEntryDataBlockSize(fileData.size()) / RPF7Entry::BLOCK_SIZE);
+        if (firstBlock + GetEntryDataBlockSize(fileData.size()) / RPF7Entry::BLOCK_SIZE > RPF7Entry::DIR_OFFSET)
         {
-            printf("WARNING: Name offset mismatch! Expected %u, got %llu for name '%s'\n", expectedActualOffset, currentOffset, name.second.c_str());
+            printf("ERROR! Entry data at block %llu exceeds the addressable archive size!\n", (unsigned long long)firstBlock);
+            isWritten = false;
+            break;
         }
 
-        m_FileStream.write(name.second.c_str(), name.second.size());
-        uint8_t zero = 0;
-        m_FileStream.write(reinterpret_cast<char*>(&zero), sizeof(uint8_t));
+        entry->m_EntryOffset = firstBlock;
+
+        uint64_t dataPosition = firstBlock * RPF7Entry::BLOCK_SIZE;
+        uint64_t paddingSize = GetEntryDataBlockSize(fileData.size()) - fileData.size();
 
-        uint32_t nameLen = name.second.size() + 1;
-        uint32_t paddedLen = (nameLen + nameMask) & ~nameMask;
-        for (uint32_t i = nameLen; i < paddedLen; i++)
+        if (isSizeInHeader)
         {
-            m_FileStream.write(reinterpret_cast<char*>(&zero), sizeof(uint8_t));
+            uint8_t resourceHeader[sizeof(RSC7Header)];
+            std::copy(fileData.begin(), fileData.begin() + sizeof(resourceHeader), resourceHeader);
+            SetResourceSizeInHeader(resourceHeader, fileData.size());
+
+            isWritten = output.Write(dataPosition, resourceHeader) && isWritten;
+            isWritten = output.Write(dataPosition + sizeof(resourceHeader), fileData.subspan(sizeof(resourceHeader)), paddingSize) && isWritten;
+        }
+        else
+        {
+            isWritten = output.Write(dataPosition, fileData, paddingSize) && isWritten;
         }
-    }
 
-    uint64_t writtenBytes = ((uint64_t)(m_FileStream.tellp() - currentPosition));
-    uint64_t paddedBytes = GetEntryNameBlockSize(writtenBytes);
+        m_Stats.Add(StatCounter::STAT_COUNTER_ENTRIES_WRITTEN, 1);
+        m_Stats.Add(StatCounter::STAT_COUNTER_BYTES_WRITTEN, GetEntryDataBlockSize(fileData.size()));
 
-    for (uint64_t i = writtenBytes; i < paddedBytes; i++)
-    {
-        uint8_t zero = 0;
-        m_FileStream.write(reinterpret_cast<char*>(&zero), sizeof(uint8_t));
+        EntryDataBuffer().swap(job.m_Buffer);
+        inFlightBytes -= job.m_ReservedBytes;
     }
+    threadPool.Wait();
+    isWritten = output.Flush() && isWritten;
 
-    m_Header.m_NameSize = paddedBytes | (m_NameShift << 28);
-    WriteHeader();
+    if (m_WriteOptions.m_ReportDeduplication)
+        printf("Deduplicated %llu entries, saved %llu bytes\n", (unsigned long long)dedupEntryCount, (unsigned long long)dedupBytes);
 
-    if (oldPosition > m_FileStream.tellp())
-        m_FileStream.seekp(oldPosition, std::ios::beg);
+    return isWritten;
 }
 
-void RPF7Archive::WriteEntriesData()
+bool RPF7Archive::CommitUpdate()
 {
-    if (!IsWriting())
-        return;
+    if (!IsUpdating())
+        return false;
 
-    if (!m_FileStream.is_open())
-        return;
+    if (m_OutputFile == nullptr || m_ArchiveFile == nullptr)
+        return false;
+
+    RPFLIB_STAT_SCOPE(m_Stats, STAT_TIMER_WRITE_ARCHIVE);
+
+    // everything the table of contents on disk still references, nothing of it is overwritten before the new table is
+    // written, so the space of removed and replaced entries is only reused by a later update
+    uint64_t oldTableSize = sizeof(RPF7Header) + sizeof(RPF7Entry) * (uint64_t)m_Header.m_EntryCount + (m_Header.m_NameSize & 0x0FFFFFFF);
+    std::vector<std::pair<uint64_t, uint64_t>> usedBlocks;
+    for (const RPF7Entry& entry : m_Entries)
+    {
+        if (entry.IsDirectory())
+            continue;
+
+        uint64_t blockCount = GetEntryDataBlockSize(GetEntryStoredSize(entry)) / RPF7Entry::BLOCK_SIZE;
+        if (blockCount != 0)
+            usedBlocks.emplace_back((uint64_t)entry.m_EntryOffset, blockCount);
+    }
 
-    std::vector<std::string> compressionExtensionExclude = {".rpf", ".bik", ".awc"};
+    // the name heap and entry table are replaced below, so node names must not point into them anymore
+    m_NodeTree.InternNames();
+    BuildNameHeap();
+    m_Entries = BuildEntriesListFromNodeTree();
 
-    uint64_t currentPosition = m_FileStream.tellp();
-    m_FileStream.seekp(GetEntryDataBlockSize(currentPosition), std::ios::beg);
+    uint64_t tableSize = sizeof(RPF7Header) + sizeof(RPF7Entry) * m_Entries.size() + GetEntryNameBlockSize(m_NameHeapBuilder.GetHeap().size());
+    uint64_t tableBlocks = GetEntryDataBlockSize(tableSize) / RPF7Entry::BLOCK_SIZE;
 
-    std::function<void(const EntryNode<RPF7Entry>*)> recurseEntryWrite = [&](const EntryNode<RPF7Entry>* parent)
+    // entries that keep their data stay where they are, unless the grown table of contents now overlaps them
+    std::vector<uint32_t> relocatedNodes;
+    uint64_t dataEndBlock = 0;
+    for (uint32_t nodeIndex = 1; nodeIndex < m_NodeTree.GetNodeCount(); nodeIndex++)
     {
-        if (!parent)
-            return;
+        const EntryNode<RPF7Entry>& node = m_NodeTree.GetNode(nodeIndex);
+        if (m_NodeTree.IsRemoved(nodeIndex) || node.m_DataIndex != INVALID_ENTRY_NODE || node.m_Entry->IsDirectory())
+            continue;
 
-        for (auto currentChild = parent->m_FirstChild; currentChild != nullptr; currentChild = currentChild->m_NextSibling)
-        {
-            if (currentChild->HasChildren())
-                recurseEntryWrite(currentChild);
+        uint64_t blockCount = GetEntryDataBlockSize(GetEntryStoredSize(*node.m_Entry)) / RPF7Entry::BLOCK_SIZE;
+        if (blockCount == 0)
+            continue;
 
-            if (!currentChild->m_RelativePath.has_extension())
-                continue;
+        if (node.m_Entry->m_EntryOffset < tableBlocks)
+            relocatedNodes.push_back(nodeIndex);
+        else
+            dataEndBlock = std::max(dataEndBlock, node.m_Entry->m_EntryOffset + blockCount);
+    }
 
-            bool needToCompress =
-                std::find(compressionExtensionExclude.begin(), compressionExtensionExclude.end(), currentChild->m_RelativePath.extension().string()) == compressionExtensionExclude.end();
-            needToCompress = needToCompress && !currentChild->m_Entry->m_IsResource;
+    std::sort(usedBlocks.begin(), usedBlocks.end());
+    std::sort(relocatedNodes.begin(), relocatedNodes.end(), [this](uint32_t a, uint32_t b) { return m_NodeTree.GetNode(a).m_Entry->m_EntryOffset < m_NodeTree.GetNode(b).m_Entry->m_EntryOffset; });
 
-            auto fileData = GetFileData(currentChild->m_FilePath);
-            uint64_t fileDataSize = fileData.size();
-            if (needToCompress)
-                fileData = CompressData(fileData.data(), fileData.size());
+    // only holes the old table of contents did not reference become free runs, new data goes there or is appended
+    uint64_t freeBlock = std::max(tableBlocks, GetEntryDataBlockSize(oldTableSize) / RPF7Entry::BLOCK_SIZE);
+    std::vector<std::pair<uint64_t, uint64_t>> freeRuns;
+    for (auto& [firstBlock, blockCount] : usedBlocks)
+    {
+        if (firstBlock > freeBlock)
+            freeRuns.emplace_back(freeBlock, firstBlock - freeBlock);
 
-            if (currentChild->m_Entry->m_IsResource || needToCompress)
-                currentChild->m_Entry->m_EntrySize = fileData.size();
-            else
-                currentChild->m_Entry->m_EntrySize = 0;
+        freeBlock = std::max(freeBlock, firstBlock + blockCount);
+    }
 
-            currentChild->m_Entry->m_EntryOffset = (((uint64_t)m_FileStream.tellp()) / RPF7Entry::BLOCK_SIZE);
+    FreeSpaceMap freeSpace(freeBlock);
+    for (auto& [firstBlock, blockCount] : freeRuns)
+        freeSpace.AddFreeBlocks(firstBlock, blockCount);
 
-            // write file data then fill up the gaps
-            m_FileStream.write(reinterpret_cast<char*>(fileData.data()), fileData.size());
-            for (uint64_t i = 0; i < (GetEntryDataBlockSize(fileData.size()) - fileData.size()); i++)
-            {
-                uint8_t zero = 0;
-                m_FileStream.write(reinterpret_cast<char*>(&zero), sizeof(uint8_t));
-            }
-        }
-    };
-    recurseEntryWrite(&m_RootNode);
+    // at worst everything added and relocated is appended
+    uint64_t appendedSize = 0;
+    for (const PendingEntry& pending : m_PendingEntries)
+        appendedSize += GetEntryDataBlockSize(pending.m_Source.GetSize());
+    for (uint32_t nodeIndex : relocatedNodes)
+        appendedSize += GetEntryDataBlockSize(GetEntryStoredSize(*m_NodeTree.GetNode(nodeIndex).m_Entry));
+
+    m_OutputFile->Reserve(freeBlock * RPF7Entry::BLOCK_SIZE + appendedSize);
+
+    bool isWritten = WriteEntriesData(
+        [&freeSpace, &dataEndBlock](uint64_t blockCount)
+        {
+            uint64_t firstBlock = freeSpace.Allocate(blockCount);
+            if (blockCount != 0)
+                dataEndBlock = std::max(dataEndBlock, firstBlock + blockCount);
+
+            return firstBlock;
+        },
+        relocatedNodes);
+
+    // the table of contents goes last and only once all data is in place, an update that fails or is interrupted
+    // before it leaves the old one pointing at untouched data
+    isWritten = isWritten && WriteTableOfContents();
+    if (!isWritten)
+    {
+        printf("ERROR! Failed to write %s\n", m_Path.string().c_str());
+
+        // drops whatever was appended, the archive is the one that was opened
+        m_OutputFile->Resize(m_ArchiveSize);
+    }
+    else
+    {
+        // trims the space of removed entries at the end and whatever of the reservation was not needed
+        uint64_t archiveSize = std::max(tableSize, dataEndBlock * RPF7Entry::BLOCK_SIZE);
+        if (!m_OutputFile->Resize(archiveSize))
+            printf("WARNING: Failed to trim %s\n", m_Path.string().c_str());
+    }
 
-    WriteEntries();
+    m_OutputFile.reset();
+    m_ArchiveFile.reset();
+    m_EntryIndex.Clear();
+
+    return isWritten;
 }
 
 RPF7Entry RPF7Archive::CreateDirectoryEntry()
@@ -476,7 +1828,7 @@ RPF7Entry RPF7Archive::CreateDirectoryEntry()
     return newEntry;
 }
 
-RPF7Entry RPF7Archive::CreateFileEntry(const std::filesystem::path& path)
+RPF7Entry RPF7Archive::CreateFileEntry(const EntrySource& source)
 {
     RPF7Entry newEntry{};
     newEntry.m_EntrySize = 0;
@@ -485,7 +1837,7 @@ RPF7Entry RPF7Archive::CreateFileEntry(const std::filesystem::path& path)
 
     uint32_t virtualFlags = 0;
     uint32_t physicalFlags = 0;
-    newEntry.m_IsResource = IsFileAResource(path, virtualFlags, physicalFlags);
+    newEntry.m_IsResource = IsFileAResource(source, virtualFlags, physicalFlags);
 
     newEntry.m_FileEntry.m_RealSize = 0;
     newEntry.m_FileEntry.m_Encrypted = 0;
@@ -497,63 +1849,144 @@ RPF7Entry RPF7Archive::CreateFileEntry(const std::filesystem::path& path)
     }
     else
     {
-        newEntry.m_FileEntry.m_RealSize = GetFileSize(path);
+        newEntry.m_FileEntry.m_RealSize = source.GetSize();
         newEntry.m_FileEntry.m_Encrypted = 0;
     }
 
     return newEntry;
 }
 
-bool RPF7Archive::IsFileAResource(const std::filesystem::path& path, uint32_t& virtualFlags, uint32_t& physicalFlags)
+bool RPF7Archive::IsFileAResource(const EntrySource& source, uint32_t& virtualFlags, uint32_t& physicalFlags)
 {
-    if (!std::filesystem::exists(path))
+    uint32_t resourceHeader[4] = {};
+    if (!source.PeekData(resourceHeader, sizeof(resourceHeader)))
         return false;
 
-    std::fstream resourceStream(path, std::ios::in | std::ios::binary);
-    if (!resourceStream.is_open())
-        return false;
+    uint32_t magic = resourceHeader[0];
+    virtualFlags = resourceHeader[2];
+    physicalFlags = resourceHeader[3];
 
-    uint32_t magic = 0;
-    uint32_t flags = 0;
+    return magic == RPF7Archive::RESOURCE_IDENT;
+}
 
-    resourceStream.read(reinterpret_cast<char*>(&magic), sizeof(uint32_t));
-    resourceStream.read(reinterpret_cast<char*>(&flags), sizeof(uint32_t));
-    resourceStream.read(reinterpret_cast<char*>(&virtualFlags), sizeof(uint32_t));
-    resourceStream.read(reinterpret_cast<char*>(&physicalFlags), sizeof(uint32_t));
-    resourceStream.close();
+uint64_t RPF7Archive::GetResourceSizeFromHeader(const uint8_t* header)
+{
+    return (uint64_t)header[7] | ((uint64_t)header[14] << 8) | ((uint64_t)header[5] << 16) | ((uint64_t)header[2] << 24);
+}
 
-    return magic == RPF7Archive::RESOURCE_IDENT;
+void RPF7Archive::SetResourceSizeInHeader(uint8_t* header, uint64_t size)
+{
+    header[7] = (uint8_t)(size);
+    header[14] = (uint8_t)(size >> 8);
+    header[5] = (uint8_t)(size >> 16);
+    header[2] = (uint8_t)(size >> 24);
 }
 
-uint64_t RPF7Archive::GetEntryNodeTotalCount()
+void RPF7Archive::RestoreResourceHeader(const RPF7Entry& entry, uint8_t* header)
+{
+    RSC7Header resourceHeader;
+    resourceHeader.m_Magic = RESOURCE_IDENT;
+    resourceHeader.m_Version = entry.GetResourceVersion();
+    resourceHeader.m_VirtualFlags = entry.m_ResourceEntry.m_VirtualFlags;
+    resourceHeader.m_PhysicalFlags = entry.m_ResourceEntry.m_PhysicalFlags;
+
+    std::memcpy(header, &resourceHeader, sizeof(resourceHeader));
+}
+
+bool RPF7Archive::SetupDecryption()
 {
-    std::function<uint64_t(const EntryNode<RPF7Entry>*, int&&)> recursiveNodeCount = [&](const EntryNode<RPF7Entry>* parent, int&& count = 0) -> uint64_t
+    if (m_Header.m_Encryption == ENCRYPTION_OPEN)
+        return true;
+
+    if (IsUpdating())
     {
-        if (!parent)
-            return 0;
+        printf("ERROR! Encrypted RPF7 files can not be updated!\n");
+        return false;
+    }
 
-        count += parent->GetChildrenCount();
-        for (auto currentChild = parent->m_FirstChild; currentChild != nullptr; currentChild = currentChild->m_NextSibling)
+    if (m_Header.m_Encryption == ENCRYPTION_AES)
+    {
+        if (m_OpenOptions.m_Keys == nullptr || !m_OpenOptions.m_Keys->HasAesKey())
         {
-            if (currentChild->HasChildren())
-                recursiveNodeCount(currentChild, std::move(count));
+            printf("ERROR! AES encrypted RPF7 file needs an AES key!\n");
+            return false;
         }
 
-        return count;
-    };
+        m_AesDecryptor = std::make_unique<AesDecryptor>(m_OpenOptions.m_Keys->m_AesKey);
+        return true;
+    }
+
+    if (m_Header.m_Encryption == ENCRYPTION_NG)
+    {
+        if (m_OpenOptions.m_Keys == nullptr || !m_OpenOptions.m_Keys->HasNgKeys())
+        {
+            printf("ERROR! NG encrypted RPF7 file needs the NG keys and tables!\n");
+            return false;
+        }
+
+        m_NgDecryptor = std::make_unique<NgDecryptor>(m_OpenOptions.m_Keys);
+        return true;
+    }
 
-    return recursiveNodeCount(&m_RootNode, 1); // we start from 1 because root node counts as one already
+    printf("ERROR! Unknown RPF7 encryption 0x%08X!\n", (uint32_t)m_Header.m_Encryption);
+    return false;
 }
 
-std::string RPF7Archive::GetEntryName(uint32_t index)
+void RPF7Archive::DecryptData(uint8_t* data, uint64_t size, std::string_view name, uint64_t length) const
+{
+    if (m_AesDecryptor == nullptr && m_NgDecryptor == nullptr)
+        return;
+
+    RPFLIB_STAT_SCOPE(m_Stats, STAT_TIMER_DECRYPT);
+
+    if (m_AesDecryptor != nullptr)
+        m_AesDecryptor->Decrypt(data, size);
+    else
+        m_NgDecryptor->Decrypt(data, size, name, length);
+}
+
+bool RPF7Archive::IsEntryEncrypted(const RPF7Entry& entry) const
+{
+    if (m_AesDecryptor == nullptr && m_NgDecryptor == nullptr)
+        return false;
+
+    if (entry.IsFile())
+        return entry.m_FileEntry.m_Encrypted != 0;
+
+    // only the body of scripts is encrypted, the other resources are stored as they are
+    if (entry.IsResource())
+        return GetEntryNameView(entry).ends_with(".ysc");
+
+    return false;
+}
+
+void RPF7Archive::DecryptEntryData(const RPF7Entry& entry, uint8_t* data, uint64_t storedOffset, uint64_t size) const
 {
-    if (m_NameMap.empty())
-        return "";
+    // blocks are aligned to the start of the encrypted data, callers pass data starting on a block boundary
+    uint64_t encryptedOffset = entry.IsResource() ? sizeof(RSC7Header) : 0;
+    uint64_t length = entry.IsResource() ? GetEntryStoredSize(entry) : entry.m_FileEntry.m_RealSize;
+
+    if (storedOffset + size <= encryptedOffset)
+        return;
 
-    if (!m_NameMap.contains(index))
-        return "";
+    if (storedOffset < encryptedOffset)
+    {
+        data += encryptedOffset - storedOffset;
+        size -= encryptedOffset - storedOffset;
+    }
+
+    DecryptData(data, size, GetEntryNameView(entry), length);
+}
+
+uint64_t RPF7Archive::GetEntryNodeTotalCount()
+{
+    // every node including the root becomes exactly one entry
+    return m_NodeTree.GetNodeCount() - m_NodeTree.GetRemovedNodeCount();
+}
 
-    return m_NameMap[index];
+std::string RPF7Archive::GetEntryName(uint32_t index)
+{
+    return std::string(GetEntryNameView(index));
 }
 
 std::string RPF7Archive::GetEntryName(const RPF7Entry& entry)
@@ -561,19 +1994,37 @@ std::string RPF7Archive::GetEntryName(const RPF7Entry& entry)
     return GetEntryName(entry.m_NameOffset);
 }
 
-uint32_t RPF7Archive::GetEntryNameOffset(const std::string& entryName)
+std::string_view RPF7Archive::GetEntryNameView(uint32_t index) const
 {
-    if (m_NameMap.empty())
-        return 0;
+    uint64_t nameOffset = (uint64_t)index << m_NameShift;
+    if (nameOffset >= m_NameHeap.size())
+        return {};
+
+    return std::string_view(m_NameHeap.data() + nameOffset);
+}
+
+std::string_view RPF7Archive::GetEntryNameView(const RPF7Entry& entry) const
+{
+    return GetEntryNameView(entry.m_NameOffset);
+}
 
-    for (auto& name : m_NameMap)
-        if (name.second == entryName)
-            return name.first;
+bool RPF7Archive::HasExtension(std::string_view entryName)
+{
+    // same rule as std::filesystem::path::has_extension for a single file name
+    size_t extensionPosition = entryName.rfind('.');
+    return extensionPosition != std::string_view::npos && extensionPosition != 0 && entryName != "..";
+}
+
+uint32_t RPF7Archive::GetEntryNameOffset(std::string_view entryName)
+{
+    uint32_t nameOffset = m_NameHeapBuilder.GetOffset(entryName);
+    if (nameOffset == NameHeapBuilder::INVALID_OFFSET)
+        return 0;
 
-    return 0;
+    return nameOffset;
 }
 
-void RPF7Archive::BuildEntryMapAndNodeTree(const RPF7Entry& parentEntry, EntryNode<RPF7Entry>* parentNode, std::vector<std::string>&& pathStack)
+void RPF7Archive::BuildEntryMapAndNodeTree(const RPF7Entry& parentEntry, uint32_t parentNode, std::string& parentPath, bool isIndexing)
 {
     if (m_Entries.empty())
         return;
@@ -581,37 +2032,36 @@ void RPF7Archive::BuildEntryMapAndNodeTree(const RPF7Entry& parentEntry, EntryNo
     if (!parentEntry.IsDirectory())
         return;
 
-    std::string parentName = GetEntryName(parentEntry);
-    pathStack.push_back(parentName);
+    // one path buffer is extended and truncated while walking down instead of joining a path stack per entry
+    size_t parentPathLength = parentPath.size();
 
-    for (int i = 0; i < parentEntry.m_DirectoryEntry.m_EntriesCount; i++)
+    for (uint32_t i = 0; i < parentEntry.m_DirectoryEntry.m_EntriesCount; i++)
     {
         uint32_t entryArrayIdx = parentEntry.m_DirectoryEntry.m_EntriesIndex + i;
-        const RPF7Entry& childEntry = m_Entries[entryArrayIdx];
+        if (entryArrayIdx >= m_Entries.size())
+            break;
 
-        std::string entryName = GetEntryName(childEntry);
-        EntryNode<RPF7Entry>* addedEntry = nullptr;
+        RPF7Entry& childEntry = m_Entries[entryArrayIdx];
+        std::string_view entryName = GetEntryNameView(childEntry);
 
-        std::ostringstream parentPath;
-        std::copy(pathStack.begin(), pathStack.end(), std::ostream_iterator<std::string>(parentPath, "/"));
-        std::filesystem::path fullPath((parentPath.str() + entryName));
+        parentPath.resize(parentPathLength);
+        parentPath += '/';
+        parentPath += entryName;
 
-        if (fullPath.has_extension())
-            m_EntryMap[fullPath.string()] = &childEntry;
+        if (isIndexing && HasExtension(entryName))
+            m_EntryIndex.Insert(parentPath, entryArrayIdx);
 
-        if (parentNode && (parentNode->Find(entryName) == nullptr))
-        {
-            addedEntry = parentNode->Add(entryName);
-            addedEntry->m_Entry = const_cast<RPF7Entry*>(&childEntry);
-        }
+        // names point straight into the name heap, which lives as long as the tree
+        uint32_t addedNode = m_NodeTree.Add(parentNode, entryName);
+        m_NodeTree.GetNode(addedNode).m_Entry = &childEntry;
 
         if (childEntry.IsDirectory())
         {
-            BuildEntryMapAndNodeTree(childEntry, addedEntry, std::move(pathStack));
+            BuildEntryMapAndNodeTree(childEntry, addedNode, parentPath, isIndexing);
         }
     }
 
-    pathStack.pop_back();
+    parentPath.resize(parentPathLength);
 }
 
 std::vector<RPF7Entry> RPF7Archive::BuildEntriesListFromNodeTree()
@@ -619,162 +2069,177 @@ std::vector<RPF7Entry> RPF7Archive::BuildEntriesListFromNodeTree()
     std::vector<RPF7Entry> entryList;
     entryList.reserve(GetEntryNodeTotalCount());
 
-    std::function<void(EntryNode<RPF7Entry>*, uint32_t&&)> recursiveBuild = [&](EntryNode<RPF7Entry>* parent, uint32_t&& idx = 1)
-    {
-        if (parent == nullptr)
-            return;
+    uint32_t nextEntryIndex = 1;
+    std::vector<uint32_t> sortedChildren;
 
-        std::vector<EntryNode<RPF7Entry>*> sortedChildren;
-        EntryNode<RPF7Entry>* currentChild = parent->m_FirstChild;
-        while (currentChild != nullptr)
-        {
-            sortedChildren.push_back(currentChild);
-            currentChild = currentChild->m_NextSibling;
-        }
+    std::function<void(uint32_t)> recursiveBuild = [&](uint32_t parentIndex)
+    {
+        size_t childrenStart = sortedChildren.size();
+        m_NodeTree.ForEachChild(parentIndex, [&](uint32_t childIndex) { sortedChildren.push_back(childIndex); });
 
         // Build entries for sorted children
-        std::sort(sortedChildren.begin(), sortedChildren.end(), [](const EntryNode<RPF7Entry>* a, const EntryNode<RPF7Entry>* b) { return a->m_Name < b->m_Name; });
+        auto childrenBegin = sortedChildren.begin() + childrenStart;
+        std::sort(childrenBegin, sortedChildren.end(), [this](uint32_t a, uint32_t b) { return m_NodeTree.GetNode(a).m_Name < m_NodeTree.GetNode(b).m_Name; });
 
-        for (auto* child : sortedChildren)
+        for (size_t i = childrenStart; i < sortedChildren.size(); i++)
         {
-            RPF7Entry* newEntry = &entryList.emplace_back();
-            child->m_Entry = newEntry;
+            EntryNode<RPF7Entry>& child = m_NodeTree.GetNode(sortedChildren[i]);
 
-            bool isFile = child->m_Name.find(".") != std::string::npos;
-            *newEntry = isFile ? CreateFileEntry(child->m_FilePath) : CreateDirectoryEntry();
-            newEntry->m_NameOffset = GetEntryNameOffset(child->m_Name);
+            // entries of an updated archive keep their stored data unless they were replaced
+            const RPF7Entry* existingEntry = child.m_Entry;
+            RPF7Entry* newEntry = &entryList.emplace_back();
+            child.m_Entry = newEntry;
 
-            if (isFile)
-                m_EntryMap[child->m_RelativePath.string()] = newEntry;
+            // a node with neither data nor a stored file is a directory, whatever its name looks like
+            if (child.m_DataIndex != INVALID_ENTRY_NODE)
+                *newEntry = CreateFileEntry(m_PendingEntries[child.m_DataIndex].m_Source);
+            else if (existingEntry != nullptr && !existingEntry->IsDirectory())
+                *newEntry = *existingEntry;
+            else
+                *newEntry = CreateDirectoryEntry();
+            newEntry->m_NameOffset = GetEntryNameOffset(child.m_Name);
         }
 
-        idx += sortedChildren.size();
-        for (auto* child : sortedChildren)
+        nextEntryIndex += static_cast<uint32_t>(sortedChildren.size() - childrenStart);
+        for (size_t i = childrenStart; i < sortedChildren.size(); i++)
         {
-            if (child->m_FirstChild != nullptr)
+            uint32_t childIndex = sortedChildren[i];
+            EntryNode<RPF7Entry>& child = m_NodeTree.GetNode(childIndex);
+            if (child.HasChildren())
             {
-                child->m_Entry->m_DirectoryEntry.m_EntriesCount = child->GetChildrenCount();
-                child->m_Entry->m_DirectoryEntry.m_EntriesIndex = idx;
-                recursiveBuild(child, std::move(idx));
+                child.m_Entry->m_DirectoryEntry.m_EntriesCount = child.GetChildrenCount();
+                child.m_Entry->m_DirectoryEntry.m_EntriesIndex = nextEntryIndex;
+                recursiveBuild(childIndex);
             }
         }
+
+        sortedChildren.resize(childrenStart);
     };
 
     RPF7Entry* rootEntry = &entryList.emplace_back();
     *rootEntry = CreateDirectoryEntry();
     rootEntry->m_DirectoryEntry.m_EntriesIndex = 1;
-    rootEntry->m_DirectoryEntry.m_EntriesCount = m_RootNode.GetChildrenCount();
+    rootEntry->m_DirectoryEntry.m_EntriesCount = m_NodeTree.GetRoot().GetChildrenCount();
+    m_NodeTree.GetRoot().m_Entry = rootEntry;
 
-    recursiveBuild(&m_RootNode, 1);
+    recursiveBuild(EntryNodeTree<RPF7Entry>::ROOT_NODE);
 
     return entryList;
 }
 
-std::map<uint32_t, std::string> RPF7Archive::BuildEntriesNameMap()
+void RPF7Archive::BuildNameHeap()
 {
-    std::map<std::string, uint32_t> entryNameMap;
-    entryNameMap[""] = 0;
+    m_NameHeapBuilder.Clear();
+    m_NameHeapBuilder.Reserve(m_NodeTree.GetNodeCount());
 
-    std::function<void(EntryNode<RPF7Entry>*)> recursiveBuild = [&](EntryNode<RPF7Entry>* parent)
+    for (uint32_t nodeIndex = 1; nodeIndex < m_NodeTree.GetNodeCount(); nodeIndex++)
     {
-        std::vector<EntryNode<RPF7Entry>*> sortedChildren;
-        EntryNode<RPF7Entry>* currentChild = parent->m_FirstChild;
-        while (currentChild != nullptr)
-        {
-            sortedChildren.push_back(currentChild);
-            currentChild = currentChild->m_NextSibling;
-        }
-
-        std::sort(sortedChildren.begin(), sortedChildren.end(), [](const EntryNode<RPF7Entry>* a, const EntryNode<RPF7Entry>* b) { return a->m_Name < b->m_Name; });
-
-        for (auto* child : sortedChildren)
-        {
-            if (!entryNameMap.contains(child->m_Name))
-                entryNameMap[child->m_Name] = 0;
-
-            if (child->m_FirstChild != nullptr)
-            {
-                recursiveBuild(child);
-            }
-        }
-    };
-    recursiveBuild(&m_RootNode);
-
-    uint32_t nameMask = (1 << m_NameShift) - 1;
-    uint32_t byteOffset = 0;
-    std::map<uint32_t, std::string> reverseEntryNameMap;
+        if (!m_NodeTree.IsRemoved(nodeIndex))
+            m_NameHeapBuilder.Add(m_NodeTree.GetNode(nodeIndex).m_Name);
+    }
 
-    for (auto& entry : entryNameMap)
+    int nameShift = m_NameHeapBuilder.Build(m_NameShift);
+    if (nameShift < 0)
     {
-        uint32_t shiftedOffset = byteOffset >> m_NameShift;
-
-        uint32_t nameLen = entry.first.size() + 1;
-        uint32_t alignedLen = (nameLen + nameMask) & ~nameMask;
-
-        if (byteOffset + alignedLen > m_NameHeapMaxSize)
-        {
-            throw std::runtime_error("RPF7Archive::BuildEntriesNameMap: Name heap size exceeded maximum limit.");
-        }
-
-        entry.second = shiftedOffset;
-        reverseEntryNameMap[shiftedOffset] = entry.first;
+        throw std::runtime_error("RPF7Archive::BuildNameHeap: Name heap size exceeded maximum limit.");
+    }
 
-        byteOffset += alignedLen;
+    if (nameShift != m_NameShift)
+    {
+        printf("WARNING: names do not fit with nameShift %d, using %d instead\n", m_NameShift, nameShift);
+        m_NameShift = nameShift;
+        m_NameHeapMaxSize = NameHeapBuilder::GetHeapMaxSize(m_NameShift);
     }
 
-    return reverseEntryNameMap;
+    // keep a null-terminated copy so GetEntryName works the same way as for archives that were read
+    m_NameHeap.assign(m_NameHeapBuilder.GetHeap().begin(), m_NameHeapBuilder.GetHeap().end());
+    m_NameHeap.push_back('\0');
 }
 
 RPF7Archive::EntryDataBuffer RPF7Archive::CompressData(uint8_t* data, uint64_t dataLength)
 {
-    EntryDataBuffer deflateBuffer(dataLength);
+    return CompressData(std::span<const uint8_t>(data, dataLength), CompressionPolicy::BEST_LEVEL, Z_DEFAULT_STRATEGY);
+}
 
+RPF7Archive::EntryDataBuffer RPF7Archive::CompressData(std::span<const uint8_t> data, int level, int strategy)
+{
     z_stream defstream;
     defstream.zalloc = Z_NULL;
     defstream.zfree = Z_NULL;
     defstream.opaque = Z_NULL;
-    defstream.next_in = (Bytef*)data;
-    defstream.avail_in = (uInt)dataLength;
+
+    if (deflateInit2(&defstream, level, Z_DEFLATED, -15, MAX_MEM_LEVEL, strategy) != Z_OK)
+    {
+        printf("ERROR! deflateInit2 failed for level %d and strategy %d!\n", level, strategy);
+        return {};
+    }
+
+    // deflateBound covers the worst case, so a single Z_FINISH call always completes
+    EntryDataBuffer deflateBuffer(deflateBound(&defstream, (uLong)data.size()));
+
+    defstream.next_in = (Bytef*)data.data();
+    defstream.avail_in = (uInt)data.size();
     defstream.next_out = (Bytef*)deflateBuffer.data();
     defstream.avail_out = (uInt)deflateBuffer.size();
 
-    deflateInit2(&defstream, Z_BEST_COMPRESSION, Z_DEFLATED, -15, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY);
-    deflate(&defstream, Z_FINISH);
+    int result = deflate(&defstream, Z_FINISH);
     deflateEnd(&defstream);
 
+    if (result != Z_STREAM_END)
+        return {};
+
     deflateBuffer.resize(deflateBuffer.size() - defstream.avail_out);
     return deflateBuffer;
 }
 
 RPF7Archive::EntryDataBuffer RPF7Archive::DecompressData(uint8_t* data, uint64_t dataLength)
 {
-    constexpr uint64_t CHUNK_SIZE = 128;
-    EntryDataBuffer inflateBuffer(CHUNK_SIZE);
-    EntryDataBuffer fullInflatedBuffer;
+    constexpr uint64_t MIN_CHUNK_SIZE = 64 * 1024;
+    EntryDataBuffer inflateBuffer(std::max<uint64_t>(dataLength * 4, MIN_CHUNK_SIZE));
 
-    z_stream defstream;
-    defstream.zalloc = Z_NULL;
-    defstream.zfree = Z_NULL;
-    defstream.opaque = Z_NULL;
-    defstream.next_in = (Bytef*)data;
-    defstream.avail_in = (uInt)dataLength;
-    defstream.next_out = (Bytef*)inflateBuffer.data();
-    defstream.avail_out = (uInt)inflateBuffer.size();
+    z_stream infstream {};
+    infstream.next_in = (Bytef*)data;
+    infstream.avail_in = (uInt)dataLength;
+
+    if (inflateInit2(&infstream, -15) != Z_OK)
+        return {};
 
-    inflateInit2(&defstream, -15);
-    int ret = 0;
-    do
+    // inflate straight into the result and grow it geometrically instead of appending small chunks
+    uint64_t inflatedSize = 0;
+    int ret = Z_OK;
+    while (ret == Z_OK)
     {
-        defstream.next_out = inflateBuffer.data();
-        defstream.avail_out = inflateBuffer.size();
+        if (inflatedSize == inflateBuffer.size())
+            inflateBuffer.resize(inflateBuffer.size() * 2);
 
-        ret = inflate(&defstream, 0);
+        infstream.next_out = inflateBuffer.data() + inflatedSize;
+        infstream.avail_out = (uInt)std::min<uint64_t>(inflateBuffer.size() - inflatedSize, 0x40000000);
+        uInt availableOutput = infstream.avail_out;
+
+        ret = inflate(&infstream, Z_NO_FLUSH);
+        inflatedSize += availableOutput - infstream.avail_out;
+    }
+    inflateEnd(&infstream);
+
+    inflateBuffer.resize(inflatedSize);
+    return inflateBuffer;
+}
+
+uint64_t RPF7Archive::DecompressData(const uint8_t* data, uint64_t dataLength, uint8_t* output, uint64_t outputLength)
+{
+    z_stream infstream {};
+    infstream.next_in = const_cast<Bytef*>(data);
+    infstream.avail_in = (uInt)dataLength;
+    infstream.next_out = output;
+    infstream.avail_out = (uInt)outputLength;
+
+    if (inflateInit2(&infstream, -15) != Z_OK)
+        return 0;
 
-        fullInflatedBuffer.insert(fullInflatedBuffer.end(), inflateBuffer.data(), inflateBuffer.data() + (CHUNK_SIZE - defstream.avail_out));
-    } while (ret == Z_OK);
-    inflateEnd(&defstream);
+    inflate(&infstream, Z_FINISH);
+    inflateEnd(&infstream);
 
-    return fullInflatedBuffer;
+    return outputLength - infstream.avail_out;
 }
 
 std::filesystem::path RPF7Archive::CorrectEntryPath(const std::filesystem::path& entryPath)
@@ -0,0 +1,221 @@
+#include <rpflib/archives/rpf7_index_file.h>
+#include <zlib.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+using namespace rpflib;
+
+static uint64_t AlignSection(uint64_t offset)
+{
+    return (offset + RPF7IndexFile::SECTION_ALIGNMENT - 1) / RPF7IndexFile::SECTION_ALIGNMENT * RPF7IndexFile::SECTION_ALIGNMENT;
+}
+
+RPF7IndexFile::Key RPF7IndexFile::GetKey(const std::filesystem::path& archivePath, const RPF7Header& archiveHeader)
+{
+    Key key;
+
+    std::error_code errorCode;
+    uint64_t archiveSize = std::filesystem::file_size(archivePath, errorCode);
+    if (errorCode)
+        return key;
+
+    std::filesystem::file_time_type archiveTime = std::filesystem::last_write_time(archivePath, errorCode);
+    if (errorCode)
+        return key;
+
+    key.m_ArchiveSize = archiveSize;
+    key.m_ArchiveTime = archiveTime.time_since_epoch().count();
+    key.m_HeaderChecksum = crc32(0, reinterpret_cast<const Bytef*>(&archiveHeader), sizeof(archiveHeader));
+
+    return key;
+}
+
+std::filesystem::path RPF7IndexFile::GetIndexPath(const std::filesystem::path& cacheDirectory, const std::filesystem::path& archivePath)
+{
+    std::error_code errorCode;
+    std::filesystem::path absolutePath = std::filesystem::absolute(archivePath, errorCode);
+    if (errorCode)
+        absolutePath = archivePath;
+
+    char pathHash[16];
+    snprintf(pathHash, sizeof(pathHash), "%08X", EntryIndex::GetPathHash(absolutePath.generic_string()));
+
+    return cacheDirectory / (archivePath.filename().string() + "." + pathHash + ".rpfidx");
+}
+
+bool RPF7IndexFile::Write(const std::filesystem::path& indexPath, const Key& key, std::span<const RPF7Entry> entries, std::span<const char> nameHeap,
+                          const EntryIndex& entryIndex)
+{
+    if (key.m_ArchiveSize == 0)
+        return false;
+
+    Header header = {};
+    header.m_Magic = IDENT;
+    header.m_Version = VERSION;
+    header.m_ArchiveSize = key.m_ArchiveSize;
+    header.m_ArchiveTime = key.m_ArchiveTime;
+    header.m_HeaderChecksum = key.m_HeaderChecksum;
+    header.m_EntryCount = static_cast<uint32_t>(entries.size());
+    header.m_NameHeapSize = static_cast<uint32_t>(nameHeap.size());
+    header.m_SlotCount = static_cast<uint32_t>(entryIndex.GetSlots().size());
+    header.m_ItemCount = entryIndex.GetSize();
+    header.m_PathDataSize = static_cast<uint32_t>(entryIndex.GetPathData().size());
+
+    Layout layout = GetLayout(header);
+
+    // the whole file is assembled in memory, it is a fraction of the size of the archive's table of contents
+    std::vector<uint8_t> fileData(layout.m_FileSize, 0);
+    std::memcpy(fileData.data() + layout.m_EntriesOffset, entries.data(), entries.size_bytes());
+    std::memcpy(fileData.data() + layout.m_SlotsOffset, entryIndex.GetSlots().data(), entryIndex.GetSlots().size() * sizeof(EntryIndex::Slot));
+    std::memcpy(fileData.data() + layout.m_ItemsOffset, entryIndex.GetItems().data(), entryIndex.GetItems().size() * sizeof(EntryIndex::Item));
+    std::memcpy(fileData.data() + layout.m_NameHeapOffset, nameHeap.data(), nameHeap.size());
+    std::memcpy(fileData.data() + layout.m_PathDataOffset, entryIndex.GetPathData().data(), entryIndex.GetPathData().size());
+
+    header.m_DataChecksum = GetDataChecksum(fileData);
+    header.m_Checksum = GetHeaderChecksum(header);
+    std::memcpy(fileData.data(), &header, sizeof(header));
+
+    std::error_code errorCode;
+    std::filesystem::create_directories(indexPath.parent_path(), errorCode);
+
+    std::filesystem::path temporaryPath = indexPath;
+    temporaryPath += ".tmp";
+
+    {
+        std::ofstream indexFile(temporaryPath, std::ios::binary | std::ios::out | std::ios::trunc);
+        if (!indexFile.is_open())
+        {
+            printf("WARNING: Failed to write index file %s\n", indexPath.string().c_str());
+            return false;
+        }
+
+        indexFile.write(reinterpret_cast<const char*>(fileData.data()), fileData.size());
+        if (!indexFile.good())
+        {
+            indexFile.close();
+            std::filesystem::remove(temporaryPath, errorCode);
+            printf("WARNING: Failed to write index file %s\n", indexPath.string().c_str());
+            return false;
+        }
+    }
+
+    std::filesystem::rename(temporaryPath, indexPath, errorCode);
+    if (errorCode)
+    {
+        std::filesystem::remove(temporaryPath, errorCode);
+        printf("WARNING: Failed to write index file %s\n", indexPath.string().c_str());
+        return false;
+    }
+
+    return true;
+}
+
+std::unique_ptr<RPF7IndexFile> RPF7IndexFile::Open(const std::filesystem::path& indexPath, const Key& key)
+{
+    if (key.m_ArchiveSize == 0)
+        return nullptr;
+
+    std::error_code errorCode;
+    if (!std::filesystem::is_regular_file(indexPath, errorCode))
+        return nullptr;
+
+    std::unique_ptr<RPF7IndexFile> indexFile(new RPF7IndexFile());
+    indexFile->m_File = ArchiveFile::Open(indexPath, true);
+    if (indexFile->m_File == nullptr || indexFile->m_File->GetSize() < sizeof(Header))
+        return nullptr;
+
+    if (!indexFile->m_File->Read(0, &indexFile->m_Header, sizeof(Header)))
+        return nullptr;
+
+    const Header& header = indexFile->m_Header;
+    if (header.m_Magic != IDENT || header.m_Version != VERSION || header.m_Checksum != GetHeaderChecksum(header))
+        return nullptr;
+
+    if (header.m_ArchiveSize != key.m_ArchiveSize || header.m_ArchiveTime != key.m_ArchiveTime || header.m_HeaderChecksum != key.m_HeaderChecksum)
+        return nullptr;
+
+    indexFile->m_Layout = GetLayout(header);
+    if (indexFile->m_Layout.m_FileSize != indexFile->m_File->GetSize())
+        return nullptr;
+
+    if (indexFile->m_File->IsMapped())
+    {
+        indexFile->m_Data = indexFile->m_File->GetView(0, indexFile->m_Layout.m_FileSize);
+    }
+    else
+    {
+        indexFile->m_FileData.resize(indexFile->m_Layout.m_FileSize);
+        if (!indexFile->m_File->Read(0, indexFile->m_FileData.data(), indexFile->m_FileData.size()))
+            return nullptr;
+
+        indexFile->m_Data = indexFile->m_FileData;
+    }
+
+    if (indexFile->m_Data.size() != indexFile->m_Layout.m_FileSize)
+        return nullptr;
+
+    if (header.m_DataChecksum != GetDataChecksum(indexFile->m_Data))
+        return nullptr;
+
+    return indexFile;
+}
+
+std::span<const RPF7Entry> RPF7IndexFile::GetEntries() const
+{
+    return {reinterpret_cast<const RPF7Entry*>(m_Data.data() + m_Layout.m_EntriesOffset), m_Header.m_EntryCount};
+}
+
+std::span<const char> RPF7IndexFile::GetNameHeap() const
+{
+    return {reinterpret_cast<const char*>(m_Data.data() + m_Layout.m_NameHeapOffset), m_Header.m_NameHeapSize};
+}
+
+std::span<const EntryIndex::Slot> RPF7IndexFile::GetSlots() const
+{
+    return {reinterpret_cast<const EntryIndex::Slot*>(m_Data.data() + m_Layout.m_SlotsOffset), m_Header.m_SlotCount};
+}
+
+std::span<const EntryIndex::Item> RPF7IndexFile::GetItems() const
+{
+    return {reinterpret_cast<const EntryIndex::Item*>(m_Data.data() + m_Layout.m_ItemsOffset), m_Header.m_ItemCount};
+}
+
+std::string_view RPF7IndexFile::GetPathData() const
+{
+    return {reinterpret_cast<const char*>(m_Data.data() + m_Layout.m_PathDataOffset), m_Header.m_PathDataSize};
+}
+
+RPF7IndexFile::Layout RPF7IndexFile::GetLayout(const Header& header)
+{
+    // fixed size records first so every section stays aligned to its record type
+    Layout layout;
+    layout.m_EntriesOffset = AlignSection(sizeof(Header));
+    layout.m_SlotsOffset = AlignSection(layout.m_EntriesOffset + (uint64_t)header.m_EntryCount * sizeof(RPF7Entry));
+    layout.m_ItemsOffset = AlignSection(layout.m_SlotsOffset + (uint64_t)header.m_SlotCount * sizeof(EntryIndex::Slot));
+    layout.m_NameHeapOffset = AlignSection(layout.m_ItemsOffset + (uint64_t)header.m_ItemCount * sizeof(EntryIndex::Item));
+    layout.m_PathDataOffset = AlignSection(layout.m_NameHeapOffset + header.m_NameHeapSize);
+    layout.m_FileSize = AlignSection(layout.m_PathDataOffset + header.m_PathDataSize);
+
+    return layout;
+}
+
+uint32_t RPF7IndexFile::GetHeaderChecksum(Header header)
+{
+    header.m_Checksum = 0;
+    return crc32(0, reinterpret_cast<const Bytef*>(&header), sizeof(header));
+}
+
+uint32_t RPF7IndexFile::GetDataChecksum(std::span<const uint8_t> fileData)
+{
+    uLong checksum = crc32(0, nullptr, 0);
+    for (std::span<const uint8_t> data = fileData.subspan(sizeof(Header)); !data.empty();)
+    {
+        // crc32 takes 32 bit lengths
+        uInt chunkSize = static_cast<uInt>(std::min<uint64_t>(data.size(), 0x40000000));
+        checksum = crc32(checksum, data.data(), chunkSize);
+        data = data.subspan(chunkSize);
+    }
+
+    return static_cast<uint32_t>(checksum);
+}
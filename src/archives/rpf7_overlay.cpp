@@ -0,0 +1,261 @@
+#include <rpflib/archives/rpf7_overlay.h>
+#include <rpflib/thread_pool.h>
+#include <algorithm>
+#include <numeric>
+
+using namespace rpflib;
+
+RPF7Overlay::RPF7Overlay(const RPF7OverlayOptions& options) : m_Options(options), m_Index(std::make_shared<MergedIndex>())
+{
+}
+
+std::vector<uint32_t> RPF7Overlay::Mount(const std::vector<RPF7MountRequest>& requests)
+{
+    std::vector<uint32_t> mountIds(requests.size(), INVALID_MOUNT);
+    if (requests.empty())
+        return mountIds;
+
+    std::vector<std::shared_ptr<RPF7Archive>> archives(requests.size());
+    {
+        ThreadPool threadPool(std::min<uint32_t>(m_Options.m_ThreadCount != 0 ? m_Options.m_ThreadCount : std::thread::hardware_concurrency(),
+                                                 static_cast<uint32_t>(requests.size())));
+        for (size_t i = 0; i < requests.size(); i++)
+        {
+            threadPool.Submit(
+                [&, i](uint32_t)
+                {
+                    std::shared_ptr<RPF7Archive> archive = RPF7Archive::OpenArchive(requests[i].m_ArchivePath, m_Options.m_OpenOptions);
+                    if (archive->GetEntries().empty())
+                    {
+                        printf("WARNING: Failed to mount %s\n", requests[i].m_ArchivePath.string().c_str());
+                        return;
+                    }
+
+                    // the per-archive index is what gets merged, building it here keeps that work parallel as well
+                    (void)archive->GetEntryIndex();
+                    archives[i] = std::move(archive);
+                });
+        }
+        threadPool.Wait();
+    }
+
+    std::lock_guard lock(m_MountMutex);
+
+    std::vector<MountedArchive> mounts;
+    {
+        std::shared_lock indexLock(m_IndexMutex);
+        mounts = m_Index->m_Mounts;
+    }
+
+    for (size_t i = 0; i < requests.size(); i++)
+    {
+        if (archives[i] == nullptr)
+            continue;
+
+        mountIds[i] = m_NextMountId++;
+        mounts.push_back({mountIds[i], std::move(archives[i]), GetMountPoint(requests[i].m_MountPoint), requests[i].m_Priority});
+    }
+
+    RebuildIndex(std::move(mounts));
+
+    return mountIds;
+}
+
+uint32_t RPF7Overlay::Mount(const RPF7MountRequest& request)
+{
+    return Mount(std::vector<RPF7MountRequest>{request})[0];
+}
+
+uint32_t RPF7Overlay::Mount(std::shared_ptr<RPF7Archive> archive, std::string_view mountPoint, int32_t priority)
+{
+    if (archive == nullptr || archive->GetEntries().empty())
+        return INVALID_MOUNT;
+
+    // builds the index outside the mount lock, it is merged below
+    (void)archive->GetEntryIndex();
+
+    std::lock_guard lock(m_MountMutex);
+
+    std::vector<MountedArchive> mounts;
+    {
+        std::shared_lock indexLock(m_IndexMutex);
+        mounts = m_Index->m_Mounts;
+    }
+
+    uint32_t mountId = m_NextMountId++;
+    mounts.push_back({mountId, std::move(archive), GetMountPoint(mountPoint), priority});
+
+    RebuildIndex(std::move(mounts));
+
+    return mountId;
+}
+
+bool RPF7Overlay::Unmount(uint32_t mountId)
+{
+    std::lock_guard lock(m_MountMutex);
+
+    std::vector<MountedArchive> mounts;
+    {
+        std::shared_lock indexLock(m_IndexMutex);
+        mounts = m_Index->m_Mounts;
+    }
+
+    auto mountIt = std::find_if(mounts.begin(), mounts.end(), [mountId](const MountedArchive& mount) { return mount.m_MountId == mountId; });
+    if (mountIt == mounts.end())
+        return false;
+
+    mounts.erase(mountIt);
+    RebuildIndex(std::move(mounts));
+
+    return true;
+}
+
+void RPF7Overlay::UnmountAll()
+{
+    std::lock_guard lock(m_MountMutex);
+    RebuildIndex({});
+}
+
+RPF7OverlayEntry RPF7Overlay::FindEntry(std::string_view entryPath) const
+{
+    std::shared_lock lock(m_IndexMutex);
+    return GetOverlayEntry(*m_Index, m_Index->m_EntryIndex.Find(entryPath));
+}
+
+RPF7OverlayEntry RPF7Overlay::FindEntry(uint32_t entryPathHash) const
+{
+    std::shared_lock lock(m_IndexMutex);
+    return GetOverlayEntry(*m_Index, m_Index->m_EntryIndex.Find(entryPathHash));
+}
+
+bool RPF7Overlay::DoesEntryExists(std::string_view entryPath) const
+{
+    std::shared_lock lock(m_IndexMutex);
+    return m_Index->m_EntryIndex.Find(entryPath) != EntryIndex::INVALID_INDEX;
+}
+
+RPF7Overlay::EntryDataBuffer RPF7Overlay::GetEntryData(std::string_view entryPath) const
+{
+    RPF7OverlayEntry entry = FindEntry(entryPath);
+    if (!entry)
+        return {};
+
+    return entry.m_Archive->GetEntryData(*entry.m_Entry);
+}
+
+RPF7Overlay::EntryPathList RPF7Overlay::GetEntryList() const
+{
+    std::shared_ptr<const MergedIndex> index;
+    {
+        std::shared_lock lock(m_IndexMutex);
+        index = m_Index;
+    }
+
+    EntryPathList pathList;
+    pathList.reserve(index->m_EntryIndex.GetSize());
+    for (const EntryIndex::Item& item : index->m_EntryIndex.GetItems())
+        pathList.emplace_back(index->m_EntryIndex.GetPath(item));
+
+    std::sort(pathList.begin(), pathList.end());
+
+    return pathList;
+}
+
+uint32_t RPF7Overlay::GetMountCount() const
+{
+    std::shared_lock lock(m_IndexMutex);
+    return static_cast<uint32_t>(m_Index->m_Mounts.size());
+}
+
+uint32_t RPF7Overlay::GetEntryCount() const
+{
+    std::shared_lock lock(m_IndexMutex);
+    return m_Index->m_EntryIndex.GetSize();
+}
+
+std::shared_ptr<RPF7Archive> RPF7Overlay::GetMountedArchive(uint32_t mountId) const
+{
+    std::shared_lock lock(m_IndexMutex);
+    for (const MountedArchive& mount : m_Index->m_Mounts)
+    {
+        if (mount.m_MountId == mountId)
+            return mount.m_Archive;
+    }
+
+    return nullptr;
+}
+
+std::string RPF7Overlay::GetMountPoint(std::string_view mountPoint)
+{
+    // the mount point takes the form of indexed paths, one leading '/' and forward slashes, and entry paths start
+    // with '/' so it is joined without a trailing separator. The root mounts as an empty string.
+    std::string path(mountPoint);
+    std::replace(path.begin(), path.end(), '\\', '/');
+
+    std::string buffer;
+    return std::string(EntryIndex::NormalizePath(path, buffer));
+}
+
+void RPF7Overlay::RebuildIndex(std::vector<MountedArchive> mounts)
+{
+    auto index = std::make_shared<MergedIndex>();
+    index->m_Mounts = std::move(mounts);
+
+    uint32_t totalEntryCount = 0;
+    for (const MountedArchive& mount : index->m_Mounts)
+        totalEntryCount += mount.m_Archive->GetEntryIndex().GetSize();
+
+    index->m_EntryIndex.Reserve(totalEntryCount);
+    index->m_Targets.reserve(totalEntryCount);
+
+    // the index keeps the first insert of a path, so mounts are merged from the highest priority down and the most
+    // recent mount goes first among equal priorities
+    std::vector<uint32_t> mountOrder(index->m_Mounts.size());
+    std::iota(mountOrder.begin(), mountOrder.end(), 0);
+    std::sort(mountOrder.begin(), mountOrder.end(),
+              [&](uint32_t a, uint32_t b)
+              {
+                  const MountedArchive& mountA = index->m_Mounts[a];
+                  const MountedArchive& mountB = index->m_Mounts[b];
+                  if (mountA.m_Priority != mountB.m_Priority)
+                      return mountA.m_Priority > mountB.m_Priority;
+
+                  return mountA.m_MountId > mountB.m_MountId;
+              });
+
+    std::string overlayPath;
+    for (uint32_t mountIndex : mountOrder)
+    {
+        const MountedArchive& mount = index->m_Mounts[mountIndex];
+        const EntryIndex& archiveIndex = mount.m_Archive->GetEntryIndex();
+
+        for (const EntryIndex::Item& item : archiveIndex.GetItems())
+        {
+            overlayPath.assign(mount.m_MountPoint);
+            overlayPath += archiveIndex.GetPath(item);
+
+            uint32_t itemCount = index->m_EntryIndex.GetSize();
+            index->m_EntryIndex.Insert(overlayPath, itemCount);
+            if (index->m_EntryIndex.GetSize() != itemCount)
+                index->m_Targets.push_back({mountIndex, item.m_EntryIndex});
+        }
+    }
+
+    // the previous index and the archives only it referenced are released outside the lock
+    std::shared_ptr<const MergedIndex> previousIndex = std::move(index);
+    {
+        std::unique_lock lock(m_IndexMutex);
+        m_Index.swap(previousIndex);
+    }
+}
+
+RPF7OverlayEntry RPF7Overlay::GetOverlayEntry(const MergedIndex& index, uint32_t targetIndex)
+{
+    if (targetIndex == EntryIndex::INVALID_INDEX)
+        return {};
+
+    const OverlayTarget& target = index.m_Targets[targetIndex];
+    const MountedArchive& mount = index.m_Mounts[target.m_MountIndex];
+
+    return {mount.m_Archive, &mount.m_Archive->GetEntries()[target.m_EntryIndex], mount.m_MountId};
+}
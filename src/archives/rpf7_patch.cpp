@@ -0,0 +1,469 @@
+#include <rpflib/archives/rpf7_patch.h>
+#include <rpflib/entry_index.h>
+#include <rpflib/thread_pool.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+using namespace rpflib;
+
+// longest entry path a patch may carry, anything above it is treated as a damaged patch
+static const uint32_t MAX_PATH_LENGTH = 4096;
+
+static ContentHash GetEntryContentHash(RPF7Archive& archive, const RPF7Entry& entry)
+{
+    IRPFArchive::EntryDataBuffer entryData = archive.GetEntryData(entry);
+    return ContentHash::Compute(entryData);
+}
+
+bool RPF7Patch::Create(RPF7Archive& oldArchive, RPF7Archive& newArchive, const std::filesystem::path& patchPath, const RPF7PatchCreateOptions& options,
+                       RPF7PatchSummary* summary)
+{
+    if (oldArchive.GetEntries().empty() || newArchive.GetEntries().empty())
+    {
+        printf("ERROR! Can not create a patch from archives that are not open\n");
+        return false;
+    }
+
+    IRPFArchive::EntryPathList oldPaths = oldArchive.GetEntryList();
+    IRPFArchive::EntryPathList newPaths = newArchive.GetEntryList();
+
+    struct Comparison
+    {
+        std::string m_Path;
+        const RPF7Entry* m_OldEntry;
+        const RPF7Entry* m_NewEntry;
+        ContentHash m_BaseHash;
+        ContentHash m_ContentHash;
+    };
+
+    // removed entries first so applying the patch frees their blocks before anything is added
+    std::vector<Comparison> comparisons;
+    comparisons.reserve(newPaths.size());
+    for (const std::string& oldPath : oldPaths)
+    {
+        if (newArchive.FindEntry(oldPath) == nullptr)
+            comparisons.push_back({oldPath, oldArchive.FindEntry(oldPath), nullptr, {}, {}});
+    }
+
+    for (const std::string& newPath : newPaths)
+        comparisons.push_back({newPath, oldArchive.FindEntry(newPath), newArchive.FindEntry(newPath), {}, {}});
+
+    ThreadPool threadPool(options.m_ThreadCount);
+    for (Comparison& comparison : comparisons)
+    {
+        threadPool.Submit(
+            [&oldArchive, &newArchive, &comparison](uint32_t)
+            {
+                if (comparison.m_OldEntry != nullptr)
+                    comparison.m_BaseHash = GetEntryContentHash(oldArchive, *comparison.m_OldEntry);
+                if (comparison.m_NewEntry != nullptr)
+                    comparison.m_ContentHash = GetEntryContentHash(newArchive, *comparison.m_NewEntry);
+            });
+    }
+    threadPool.Wait();
+
+    std::vector<Operation> operations;
+    for (const Comparison& comparison : comparisons)
+    {
+        Operation operation = {};
+        operation.m_Path = comparison.m_Path;
+        operation.m_Header.m_PathLength = static_cast<uint32_t>(comparison.m_Path.size());
+
+        if (comparison.m_NewEntry == nullptr)
+        {
+            operation.m_Header.m_Type = OPERATION_REMOVE;
+            operation.m_Header.m_BaseHash = comparison.m_BaseHash;
+        }
+        else if (comparison.m_OldEntry == nullptr)
+        {
+            operation.m_Header.m_Type = OPERATION_ADD;
+            operation.m_Header.m_ContentHash = comparison.m_ContentHash;
+        }
+        else
+        {
+            if (comparison.m_BaseHash == comparison.m_ContentHash)
+                continue;
+
+            operation.m_Header.m_Type = OPERATION_CHANGE;
+            operation.m_Header.m_BaseHash = comparison.m_BaseHash;
+            operation.m_Header.m_ContentHash = comparison.m_ContentHash;
+        }
+
+        operations.push_back(std::move(operation));
+    }
+
+    std::filesystem::path temporaryPath = patchPath;
+    temporaryPath += ".tmp";
+
+    std::ofstream patchFile(temporaryPath, std::ios::binary | std::ios::out | std::ios::trunc);
+    if (!patchFile.is_open())
+    {
+        printf("ERROR! Failed to create patch %s\n", patchPath.string().c_str());
+        return false;
+    }
+
+    Header header = {};
+    header.m_Magic = IDENT;
+    header.m_Version = VERSION;
+    header.m_OperationCount = static_cast<uint32_t>(operations.size());
+    header.m_NameShift = newArchive.GetNameShift();
+    patchFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    RPF7PatchSummary patchSummary;
+
+    struct PayloadJob
+    {
+        Operation* m_Operation;
+        IRPFArchive::EntryDataBuffer m_Payload;
+    };
+
+    // payloads are read and deflated in parallel a window at a time and written in operation order
+    uint64_t nextOperation = 0;
+    while (nextOperation < operations.size())
+    {
+        std::vector<PayloadJob> jobs;
+        uint64_t windowBytes = 0;
+        while (nextOperation < operations.size() && (jobs.empty() || windowBytes < options.m_MaxInFlightBytes))
+        {
+            Operation& operation = operations[nextOperation++];
+            if (operation.m_Header.m_Type != OPERATION_REMOVE)
+                windowBytes += newArchive.GetEntryStoredSize(*newArchive.FindEntry(operation.m_Path));
+
+            jobs.push_back({&operation, {}});
+        }
+
+        for (PayloadJob& job : jobs)
+        {
+            if (job.m_Operation->m_Header.m_Type == OPERATION_REMOVE)
+                continue;
+
+            threadPool.Submit(
+                [&newArchive, &options, &job](uint32_t)
+                {
+                    OperationHeader& operationHeader = job.m_Operation->m_Header;
+                    const RPF7Entry* entry = newArchive.FindEntry(job.m_Operation->m_Path);
+
+                    job.m_Payload = newArchive.GetEntryData(*entry);
+                    operationHeader.m_Size = job.m_Payload.size();
+
+                    // resources are stored, their bodies are compressed already
+                    CompressionSettings compressionSettings = options.m_CompressionPolicy.GetSettings(job.m_Operation->m_Path);
+                    if (entry->IsResource() || compressionSettings.m_Level == CompressionPolicy::STORE_LEVEL)
+                        return;
+
+                    if (job.m_Payload.empty() || !options.m_CompressionPolicy.IsWorthCompressing(job.m_Payload))
+                        return;
+
+                    IRPFArchive::EntryDataBuffer compressedPayload =
+                        RPF7Archive::CompressData(job.m_Payload, compressionSettings.m_Level, compressionSettings.m_Strategy);
+                    if (!compressedPayload.empty() && compressedPayload.size() < job.m_Payload.size())
+                    {
+                        job.m_Payload = std::move(compressedPayload);
+                        operationHeader.m_IsCompressed = 1;
+                    }
+                });
+        }
+        threadPool.Wait();
+
+        for (PayloadJob& job : jobs)
+        {
+            OperationHeader& operationHeader = job.m_Operation->m_Header;
+            operationHeader.m_PayloadSize = job.m_Payload.size();
+
+            patchFile.write(reinterpret_cast<const char*>(&operationHeader), sizeof(operationHeader));
+            patchFile.write(job.m_Operation->m_Path.data(), job.m_Operation->m_Path.size());
+            patchFile.write(reinterpret_cast<const char*>(job.m_Payload.data()), job.m_Payload.size());
+
+            if (operationHeader.m_Type == OPERATION_ADD)
+                patchSummary.m_AddedCount++;
+            else if (operationHeader.m_Type == OPERATION_CHANGE)
+                patchSummary.m_ChangedCount++;
+            else
+                patchSummary.m_RemovedCount++;
+
+            patchSummary.m_PayloadBytes += operationHeader.m_Size;
+        }
+    }
+
+    bool isWritten = patchFile.good();
+    patchFile.close();
+
+    std::error_code errorCode;
+    if (isWritten)
+        std::filesystem::rename(temporaryPath, patchPath, errorCode);
+
+    if (!isWritten || errorCode)
+    {
+        std::filesystem::remove(temporaryPath, errorCode);
+        printf("ERROR! Failed to write patch %s\n", patchPath.string().c_str());
+        return false;
+    }
+
+    if (summary != nullptr)
+        *summary = patchSummary;
+
+    return true;
+}
+
+bool RPF7Patch::Apply(const std::filesystem::path& archivePath, const std::filesystem::path& patchPath, const RPF7PatchApplyOptions& options,
+                      RPF7PatchSummary* summary)
+{
+    std::shared_ptr<ArchiveFile> patchFile = ArchiveFile::Open(patchPath);
+    if (patchFile == nullptr)
+    {
+        printf("ERROR! Failed to open patch %s\n", patchPath.string().c_str());
+        return false;
+    }
+
+    Header header;
+    std::vector<Operation> operations;
+    if (!ReadOperations(*patchFile, header, operations))
+    {
+        printf("ERROR! %s is not a valid patch\n", patchPath.string().c_str());
+        return false;
+    }
+
+    std::unique_ptr<RPF7Archive> archive = RPF7Archive::OpenArchive(archivePath, options.m_OpenOptions);
+    if (archive->GetEntries().empty())
+    {
+        printf("ERROR! Failed to open archive %s\n", archivePath.string().c_str());
+        return false;
+    }
+
+    enum class OperationState : uint8_t
+    {
+        PENDING = 0,
+        SKIPPED,
+        MISMATCHED
+    };
+
+    // only the entries the patch touches are read, an entry that already has the patched content is left alone so a
+    // patch can be applied again after an interrupted run
+    std::vector<OperationState> operationStates(operations.size(), OperationState::PENDING);
+    {
+        ThreadPool threadPool(options.m_WriteOptions.m_ThreadCount);
+        for (uint64_t i = 0; i < operations.size(); i++)
+        {
+            threadPool.Submit(
+                [&archive, &operations, &operationStates, i](uint32_t)
+                {
+                    const OperationHeader& operationHeader = operations[i].m_Header;
+                    const RPF7Entry* entry = archive->FindEntry(operations[i].m_Path);
+                    if (entry == nullptr)
+                    {
+                        if (operationHeader.m_Type == OPERATION_CHANGE)
+                            operationStates[i] = OperationState::MISMATCHED;
+                        else if (operationHeader.m_Type == OPERATION_REMOVE)
+                            operationStates[i] = OperationState::SKIPPED;
+
+                        return;
+                    }
+
+                    ContentHash contentHash = GetEntryContentHash(*archive, *entry);
+                    if (operationHeader.m_Type != OPERATION_ADD && contentHash == operationHeader.m_BaseHash)
+                        operationStates[i] = OperationState::PENDING;
+                    else if (operationHeader.m_Type != OPERATION_REMOVE && contentHash == operationHeader.m_ContentHash)
+                        operationStates[i] = OperationState::SKIPPED;
+                    else
+                        operationStates[i] = OperationState::MISMATCHED;
+                });
+        }
+        threadPool.Wait();
+    }
+
+    RPF7PatchSummary patchSummary;
+    std::vector<const Operation*> pendingOperations;
+    for (uint64_t i = 0; i < operations.size(); i++)
+    {
+        const Operation& operation = operations[i];
+        if (operationStates[i] == OperationState::MISMATCHED)
+        {
+            printf("ERROR! %s in %s does not match the archive the patch was created from\n", operation.m_Path.c_str(), archivePath.string().c_str());
+            return false;
+        }
+
+        if (operationStates[i] == OperationState::SKIPPED)
+        {
+            patchSummary.m_SkippedCount++;
+            continue;
+        }
+
+        if (operation.m_Header.m_Type == OPERATION_ADD)
+            patchSummary.m_AddedCount++;
+        else if (operation.m_Header.m_Type == OPERATION_CHANGE)
+            patchSummary.m_ChangedCount++;
+        else
+            patchSummary.m_RemovedCount++;
+
+        patchSummary.m_PayloadBytes += operation.m_Header.m_Size;
+        pendingOperations.push_back(&operation);
+    }
+
+    if (!pendingOperations.empty())
+    {
+        patchSummary.m_IsRewritten = options.m_ForceRewrite || archive->GetEncryption() != ENCRYPTION_OPEN;
+        if (patchSummary.m_IsRewritten)
+        {
+            if (!RewriteArchive(archivePath, std::move(archive), header.m_NameShift, patchFile, pendingOperations, options))
+                return false;
+        }
+        else
+        {
+            archive.reset();
+
+            std::unique_ptr<RPF7Archive> updatedArchive = RPF7Archive::UpdateArchive(archivePath, options.m_WriteOptions);
+            if (updatedArchive->GetEntries().empty())
+            {
+                printf("ERROR! Failed to open archive %s for updating\n", archivePath.string().c_str());
+                return false;
+            }
+
+            for (const Operation* operation : pendingOperations)
+            {
+                if (operation->m_Header.m_Type == OPERATION_REMOVE)
+                    updatedArchive->RemoveEntry(operation->m_Path);
+                else
+                    updatedArchive->AddEntry(operation->m_Path, OpenPayloadSource(patchFile, *operation));
+            }
+
+            // a failed update, a damaged payload included, leaves the archive as it was
+            if (!updatedArchive->CloseArchive())
+            {
+                printf("ERROR! Failed to update archive %s\n", archivePath.string().c_str());
+                return false;
+            }
+        }
+    }
+
+    if (summary != nullptr)
+        *summary = patchSummary;
+
+    return true;
+}
+
+bool RPF7Patch::ReadOperations(const ArchiveFile& patchFile, Header& header, std::vector<Operation>& operations)
+{
+    if (!patchFile.Read(0, &header, sizeof(header)))
+        return false;
+
+    if (header.m_Magic != IDENT || header.m_Version != VERSION)
+        return false;
+
+    uint64_t patchSize = patchFile.GetSize();
+    uint64_t offset = sizeof(header);
+
+    operations.reserve(std::min<uint64_t>(header.m_OperationCount, patchSize / sizeof(OperationHeader)));
+    for (uint32_t i = 0; i < header.m_OperationCount; i++)
+    {
+        Operation operation;
+        if (!patchFile.Read(offset, &operation.m_Header, sizeof(operation.m_Header)))
+            return false;
+
+        const OperationHeader& operationHeader = operation.m_Header;
+        if (operationHeader.m_Type > OPERATION_REMOVE || operationHeader.m_PathLength == 0 || operationHeader.m_PathLength > MAX_PATH_LENGTH)
+            return false;
+
+        offset += sizeof(operationHeader);
+        operation.m_Path.resize(operationHeader.m_PathLength);
+        if (!patchFile.Read(offset, operation.m_Path.data(), operation.m_Path.size()))
+            return false;
+
+        offset += operationHeader.m_PathLength;
+        operation.m_PayloadOffset = offset;
+        if (operationHeader.m_PayloadSize > patchSize - offset)
+            return false;
+
+        offset += operationHeader.m_PayloadSize;
+        operations.push_back(std::move(operation));
+    }
+
+    return true;
+}
+
+EntrySource RPF7Patch::OpenPayloadSource(const std::shared_ptr<ArchiveFile>& patchFile, const Operation& operation)
+{
+    struct StreamState
+    {
+        std::unique_ptr<EntryReader> m_Reader;
+        uint64_t m_Position = 0;
+        ContentHasher m_Hasher;
+    };
+
+    const OperationHeader& operationHeader = operation.m_Header;
+
+    return EntrySource::FromStream(operationHeader.m_Size,
+                                   [patchFile, operationHeader, path = operation.m_Path, payloadOffset = operation.m_PayloadOffset]() -> EntrySource::ReadCallback
+                                   {
+                                       std::shared_ptr<StreamState> state = std::make_shared<StreamState>();
+                                       state->m_Reader = std::make_unique<EntryReader>(patchFile, payloadOffset, operationHeader.m_PayloadSize, operationHeader.m_Size,
+                                                                                       operationHeader.m_IsCompressed != 0);
+
+                                       return [operationHeader, path, state](uint8_t* buffer, uint64_t size) -> uint64_t
+                                       {
+                                           uint64_t readBytes = state->m_Reader->Read(buffer, size);
+                                           state->m_Position += readBytes;
+
+                                           // the last piece is only handed out if the whole payload decodes to the expected
+                                           // content, a damaged one ends the source early and fails the write
+                                           state->m_Hasher.Update({buffer, readBytes});
+                                           if (readBytes != 0 && state->m_Position == operationHeader.m_Size &&
+                                               state->m_Hasher.Finish() != operationHeader.m_ContentHash)
+                                           {
+                                               printf("ERROR! The payload of %s does not match its content hash\n", path.c_str());
+                                               return 0;
+                                           }
+
+                                           return readBytes;
+                                       };
+                                   });
+}
+
+bool RPF7Patch::RewriteArchive(const std::filesystem::path& archivePath, std::unique_ptr<RPF7Archive> archive, int nameShift,
+                               const std::shared_ptr<ArchiveFile>& patchFile, const std::vector<const Operation*>& operations, const RPF7PatchApplyOptions& options)
+{
+    EntryIndex patchedPaths;
+    patchedPaths.Reserve(static_cast<uint32_t>(operations.size()));
+    for (uint32_t i = 0; i < operations.size(); i++)
+        patchedPaths.Insert(operations[i]->m_Path, i);
+
+    std::filesystem::path temporaryPath = archivePath;
+    temporaryPath += ".tmp";
+
+    // every entry is streamed from the old archive or the patch while the new archive is written, neither is held
+    // in memory as a whole
+    std::unique_ptr<RPF7Archive> rewrittenArchive = RPF7Archive::CreateArchive(temporaryPath, nameShift, options.m_WriteOptions);
+    for (const std::string& entryPath : archive->GetEntryList())
+    {
+        if (patchedPaths.Find(entryPath) == EntryIndex::INVALID_INDEX)
+            rewrittenArchive->AddEntry(entryPath, archive->OpenEntrySource(entryPath));
+    }
+
+    for (const Operation* operation : operations)
+    {
+        if (operation->m_Header.m_Type != OPERATION_REMOVE)
+            rewrittenArchive->AddEntry(operation->m_Path, OpenPayloadSource(patchFile, *operation));
+    }
+
+    bool isWritten = rewrittenArchive->CloseArchive();
+    rewrittenArchive.reset();
+    archive.reset();
+
+    std::error_code errorCode;
+    if (!isWritten)
+    {
+        std::filesystem::remove(temporaryPath, errorCode);
+        printf("ERROR! Failed to rewrite archive %s\n", archivePath.string().c_str());
+        return false;
+    }
+
+    std::filesystem::rename(temporaryPath, archivePath, errorCode);
+    if (errorCode)
+    {
+        std::filesystem::remove(temporaryPath, errorCode);
+        printf("ERROR! Failed to replace archive %s\n", archivePath.string().c_str());
+        return false;
+    }
+
+    return true;
+}
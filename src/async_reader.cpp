@@ -0,0 +1,423 @@
+#include <rpflib/async_reader.h>
+#include <algorithm>
+#include <cstdio>
+
+#if defined(RPFLIB_ENABLE_IO_URING) && defined(__linux__)
+#define RPFLIB_HAS_IO_URING
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace rpflib;
+
+struct AsyncReader::Request
+{
+    std::shared_ptr<ArchiveFile> m_File;
+    uint64_t m_Offset = 0;
+    uint8_t* m_Buffer = nullptr;
+    uint64_t m_Size = 0;
+    ReadCallback m_Callback;
+
+    Request* m_Previous = nullptr;
+    Request* m_Next = nullptr;
+};
+
+#ifdef RPFLIB_HAS_IO_URING
+// Raw io_uring setup without liburing, only plain reads and no-ops are ever submitted.
+struct AsyncReader::IoUring
+{
+    int m_RingDescriptor = -1;
+
+    void* m_SubmitRing = MAP_FAILED;
+    size_t m_SubmitRingSize = 0;
+    void* m_CompletionRing = MAP_FAILED;
+    size_t m_CompletionRingSize = 0;
+    io_uring_sqe* m_SubmitEntries = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t m_SubmitEntriesSize = 0;
+
+    uint32_t* m_SubmitHead = nullptr;
+    uint32_t* m_SubmitTail = nullptr;
+    uint32_t* m_SubmitArray = nullptr;
+    uint32_t m_SubmitMask = 0;
+    uint32_t m_SubmitEntryCount = 0;
+
+    uint32_t* m_CompletionHead = nullptr;
+    uint32_t* m_CompletionTail = nullptr;
+    io_uring_cqe* m_Completions = nullptr;
+    uint32_t m_CompletionMask = 0;
+
+    ~IoUring()
+    {
+        if (m_SubmitEntries != MAP_FAILED)
+            munmap(m_SubmitEntries, m_SubmitEntriesSize);
+
+        if (m_CompletionRing != MAP_FAILED && m_CompletionRing != m_SubmitRing)
+            munmap(m_CompletionRing, m_CompletionRingSize);
+
+        if (m_SubmitRing != MAP_FAILED)
+            munmap(m_SubmitRing, m_SubmitRingSize);
+
+        if (m_RingDescriptor != -1)
+            close(m_RingDescriptor);
+    }
+
+    int Enter(uint32_t submitCount, uint32_t waitCount, uint32_t flags)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_enter, m_RingDescriptor, submitCount, waitCount, flags, nullptr, 0));
+    }
+};
+#else
+struct AsyncReader::IoUring
+{
+};
+#endif
+
+AsyncReader::AsyncReader(uint32_t queueDepth, uint32_t workerThreadCount) : m_WorkerPool(workerThreadCount)
+{
+    if (SetupRing(std::max(1u, queueDepth)))
+        m_CompletionThread = std::thread(&AsyncReader::CompletionLoop, this);
+}
+
+AsyncReader::~AsyncReader()
+{
+    {
+        std::unique_lock lock(m_StateMutex);
+        m_StateChanged.wait(lock, [this] { return m_PendingCount == 0; });
+
+        // a ring that failed has no completion thread left to stop
+        if (m_Ring != nullptr && !m_IsRingFailed && !PushSubmission(nullptr))
+            printf("ERROR! Could not stop the io_uring completion thread\n");
+    }
+
+    if (m_CompletionThread.joinable())
+        m_CompletionThread.join();
+
+    m_WorkerPool.Wait();
+}
+
+AsyncReader& AsyncReader::GetDefault()
+{
+    static AsyncReader reader;
+    return reader;
+}
+
+void AsyncReader::Read(std::shared_ptr<ArchiveFile> file, uint64_t offset, void* buffer, uint64_t size, ReadCallback callback)
+{
+    Request* request = new Request();
+    request->m_File = std::move(file);
+    request->m_Offset = offset;
+    request->m_Buffer = static_cast<uint8_t*>(buffer);
+    request->m_Size = size;
+    request->m_Callback = std::move(callback);
+
+    std::unique_lock lock(m_StateMutex);
+    m_PendingCount++;
+
+    // mapped files are a plain copy and empty reads have nothing to submit
+    if (m_Ring == nullptr || m_IsRingFailed || request->m_File == nullptr || request->m_File->IsMapped() || size == 0 || offset > request->m_File->GetSize() ||
+        size > request->m_File->GetSize() - offset)
+    {
+        lock.unlock();
+        ReadOnWorker(request);
+        return;
+    }
+
+    m_StateChanged.wait(lock, [this] { return m_InFlightCount < m_QueueDepth || m_IsRingFailed; });
+    if (m_IsRingFailed || !PushSubmission(request))
+    {
+        lock.unlock();
+        ReadOnWorker(request);
+        return;
+    }
+
+    m_InFlightCount++;
+    request->m_Next = m_InFlightRequests;
+    if (m_InFlightRequests != nullptr)
+        m_InFlightRequests->m_Previous = request;
+
+    m_InFlightRequests = request;
+}
+
+void AsyncReader::Submit(Task task)
+{
+    {
+        std::lock_guard lock(m_StateMutex);
+        m_PendingCount++;
+    }
+
+    m_WorkerPool.Submit([this, task = std::move(task)](uint32_t) {
+        task();
+
+        std::lock_guard lock(m_StateMutex);
+        m_PendingCount--;
+        m_StateChanged.notify_all();
+    });
+}
+
+void AsyncReader::ReleaseQueueSlot(Request* request)
+{
+    std::lock_guard lock(m_StateMutex);
+    if (request->m_Previous != nullptr)
+        request->m_Previous->m_Next = request->m_Next;
+    else
+        m_InFlightRequests = request->m_Next;
+
+    if (request->m_Next != nullptr)
+        request->m_Next->m_Previous = request->m_Previous;
+
+    request->m_Previous = nullptr;
+    request->m_Next = nullptr;
+
+    m_InFlightCount--;
+    m_StateChanged.notify_all();
+}
+
+void AsyncReader::AbandonRing()
+{
+    Request* request = nullptr;
+    {
+        std::lock_guard lock(m_StateMutex);
+        m_IsRingFailed = true;
+        request = m_InFlightRequests;
+        m_InFlightRequests = nullptr;
+        m_InFlightCount = 0;
+        m_StateChanged.notify_all();
+    }
+
+    // requests only advance when their completion is handled, so the blocking read picks up where the ring stopped
+    while (request != nullptr)
+    {
+        Request* nextRequest = request->m_Next;
+        request->m_Previous = nullptr;
+        request->m_Next = nullptr;
+        ReadOnWorker(request);
+        request = nextRequest;
+    }
+}
+
+void AsyncReader::ReadOnWorker(Request* request)
+{
+    m_WorkerPool.Submit([this, request](uint32_t) {
+        bool isSuccess = request->m_File != nullptr && request->m_File->Read(request->m_Offset, request->m_Buffer, request->m_Size);
+        request->m_Callback(isSuccess);
+        delete request;
+
+        std::lock_guard lock(m_StateMutex);
+        m_PendingCount--;
+        m_StateChanged.notify_all();
+    });
+}
+
+void AsyncReader::FinishRequest(Request* request, bool isSuccess)
+{
+    m_WorkerPool.Submit([this, request, isSuccess](uint32_t) {
+        request->m_Callback(isSuccess);
+        delete request;
+
+        std::lock_guard lock(m_StateMutex);
+        m_PendingCount--;
+        m_StateChanged.notify_all();
+    });
+}
+
+#ifdef RPFLIB_HAS_IO_URING
+bool AsyncReader::SetupRing(uint32_t queueDepth)
+{
+    io_uring_params params {};
+    int ringDescriptor = static_cast<int>(syscall(__NR_io_uring_setup, queueDepth, &params));
+    if (ringDescriptor < 0)
+        return false;
+
+    std::unique_ptr<IoUring> ring = std::make_unique<IoUring>();
+    ring->m_RingDescriptor = ringDescriptor;
+
+    ring->m_SubmitRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    ring->m_CompletionRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+    // newer kernels map both rings with a single mapping
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        ring->m_SubmitRingSize = std::max(ring->m_SubmitRingSize, ring->m_CompletionRingSize);
+        ring->m_CompletionRingSize = ring->m_SubmitRingSize;
+    }
+
+    ring->m_SubmitRing = mmap(nullptr, ring->m_SubmitRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringDescriptor, IORING_OFF_SQ_RING);
+    if (ring->m_SubmitRing == MAP_FAILED)
+        return false;
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        ring->m_CompletionRing = ring->m_SubmitRing;
+    }
+    else
+    {
+        ring->m_CompletionRing = mmap(nullptr, ring->m_CompletionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringDescriptor, IORING_OFF_CQ_RING);
+        if (ring->m_CompletionRing == MAP_FAILED)
+            return false;
+    }
+
+    ring->m_SubmitEntriesSize = params.sq_entries * sizeof(io_uring_sqe);
+    ring->m_SubmitEntries = static_cast<io_uring_sqe*>(
+        mmap(nullptr, ring->m_SubmitEntriesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringDescriptor, IORING_OFF_SQES));
+    if (ring->m_SubmitEntries == MAP_FAILED)
+        return false;
+
+    uint8_t* submitRing = static_cast<uint8_t*>(ring->m_SubmitRing);
+    ring->m_SubmitHead = reinterpret_cast<uint32_t*>(submitRing + params.sq_off.head);
+    ring->m_SubmitTail = reinterpret_cast<uint32_t*>(submitRing + params.sq_off.tail);
+    ring->m_SubmitArray = reinterpret_cast<uint32_t*>(submitRing + params.sq_off.array);
+    ring->m_SubmitMask = *reinterpret_cast<uint32_t*>(submitRing + params.sq_off.ring_mask);
+    ring->m_SubmitEntryCount = params.sq_entries;
+
+    uint8_t* completionRing = static_cast<uint8_t*>(ring->m_CompletionRing);
+    ring->m_CompletionHead = reinterpret_cast<uint32_t*>(completionRing + params.cq_off.head);
+    ring->m_CompletionTail = reinterpret_cast<uint32_t*>(completionRing + params.cq_off.tail);
+    ring->m_Completions = reinterpret_cast<io_uring_cqe*>(completionRing + params.cq_off.cqes);
+    ring->m_CompletionMask = *reinterpret_cast<uint32_t*>(completionRing + params.cq_off.ring_mask);
+
+    // the completion queue is at least twice as large, so it can never overflow while in flight reads are bounded
+    // by the submission queue and one slot is left for the stop no-op
+    m_QueueDepth = std::max(1u, std::min(queueDepth, params.sq_entries - 1));
+    m_Ring = std::move(ring);
+
+    return true;
+}
+
+bool AsyncReader::PushSubmission(Request* request)
+{
+    IoUring& ring = *m_Ring;
+
+    // only this function writes the tail and it is always called with m_StateMutex held
+    uint32_t tail = *ring.m_SubmitTail;
+    if (tail - std::atomic_ref<uint32_t>(*ring.m_SubmitHead).load(std::memory_order_acquire) >= ring.m_SubmitEntryCount)
+        return false;
+
+    uint32_t index = tail & ring.m_SubmitMask;
+    io_uring_sqe& entry = ring.m_SubmitEntries[index];
+    std::memset(&entry, 0, sizeof(entry));
+
+    if (request == nullptr)
+    {
+        entry.opcode = IORING_OP_NOP;
+    }
+    else
+    {
+        entry.opcode = IORING_OP_READ;
+        entry.fd = request->m_File->GetFileDescriptor();
+        entry.off = request->m_Offset;
+        entry.addr = reinterpret_cast<uint64_t>(request->m_Buffer);
+        entry.len = static_cast<uint32_t>(std::min<uint64_t>(request->m_Size, 0x40000000));
+    }
+    entry.user_data = reinterpret_cast<uint64_t>(request);
+
+    ring.m_SubmitArray[index] = index;
+    std::atomic_ref<uint32_t>(*ring.m_SubmitTail).store(tail + 1, std::memory_order_release);
+
+    while (true)
+    {
+        int result = ring.Enter(1, 0, 0);
+        if (result >= 0)
+            return true;
+
+        if (errno != EINTR && errno != EAGAIN)
+            break;
+    }
+
+    // the kernel only consumes entries inside io_uring_enter, so the entry can still be taken back
+    std::atomic_ref<uint32_t>(*ring.m_SubmitTail).store(tail, std::memory_order_release);
+    return false;
+}
+
+void AsyncReader::CompletionLoop()
+{
+    IoUring& ring = *m_Ring;
+
+    bool isStopping = false;
+    while (!isStopping)
+    {
+        if (ring.Enter(0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+        {
+            printf("ERROR! io_uring_enter failed with errno %d, reads fall back to blocking reads\n", errno);
+            AbandonRing();
+            return;
+        }
+
+        uint32_t head = *ring.m_CompletionHead;
+        uint32_t tail = std::atomic_ref<uint32_t>(*ring.m_CompletionTail).load(std::memory_order_acquire);
+        for (; head != tail; head++)
+        {
+            const io_uring_cqe& completion = ring.m_Completions[head & ring.m_CompletionMask];
+            Request* request = reinterpret_cast<Request*>(completion.user_data);
+            int32_t result = completion.res;
+
+            std::atomic_ref<uint32_t>(*ring.m_CompletionHead).store(head + 1, std::memory_order_release);
+
+            if (request == nullptr)
+            {
+                isStopping = true;
+                continue;
+            }
+
+            if (result == -EINTR || result == -EAGAIN)
+            {
+                result = 0;
+            }
+            else if (result <= 0)
+            {
+                ReleaseQueueSlot(request);
+
+                // kernels before 5.6 do not know IORING_OP_READ, fall back to a blocking read for those
+                if (result == -EINVAL || result == -EOPNOTSUPP)
+                    ReadOnWorker(request);
+                else
+                    FinishRequest(request, false);
+
+                continue;
+            }
+
+            request->m_Offset += result;
+            request->m_Buffer += result;
+            request->m_Size -= result;
+
+            if (request->m_Size == 0)
+            {
+                ReleaseQueueSlot(request);
+                FinishRequest(request, true);
+                continue;
+            }
+
+            // short read or retry, the request keeps its queue slot
+            bool isQueued = false;
+            {
+                std::lock_guard lock(m_StateMutex);
+                isQueued = PushSubmission(request);
+            }
+
+            if (!isQueued)
+            {
+                ReleaseQueueSlot(request);
+                ReadOnWorker(request);
+            }
+        }
+    }
+}
+#else
+bool AsyncReader::SetupRing(uint32_t)
+{
+    return false;
+}
+
+bool AsyncReader::PushSubmission(Request*)
+{
+    return false;
+}
+
+void AsyncReader::CompletionLoop()
+{
+}
+#endif
@@ -0,0 +1,143 @@
+#include <rpflib/compression_policy.h>
+#include <algorithm>
+#include <cmath>
+
+using namespace rpflib;
+
+// entropy in bits per byte above which deflate rarely saves enough to be worth the time
+static const double INCOMPRESSIBLE_ENTROPY = 7.8;
+static const uint64_t PROBE_SAMPLE_SIZE = 4096;
+static const uint64_t PROBE_SAMPLE_COUNT = 4;
+
+CompressionPolicy CompressionPolicy::Default()
+{
+    CompressionPolicy policy;
+    policy.SetDefaultSettings({BEST_LEVEL, 0});
+    policy.SetExtensionSettings(".rpf", {STORE_LEVEL, 0});
+    policy.SetExtensionSettings(".bik", {STORE_LEVEL, 0});
+    policy.SetExtensionSettings(".awc", {STORE_LEVEL, 0});
+
+    return policy;
+}
+
+CompressionPolicy CompressionPolicy::Fast()
+{
+    CompressionPolicy policy = Default();
+    policy.SetDefaultSettings({FAST_LEVEL, 0});
+
+    return policy;
+}
+
+void CompressionPolicy::SetExtensionSettings(std::string_view extension, const CompressionSettings& settings)
+{
+    std::string pattern = NormalizePattern(extension);
+    auto ruleIt = std::find_if(m_ExtensionRules.begin(), m_ExtensionRules.end(), [&pattern](const Rule& rule) { return rule.m_Pattern == pattern; });
+    if (ruleIt != m_ExtensionRules.end())
+    {
+        ruleIt->m_Settings = settings;
+        return;
+    }
+
+    m_ExtensionRules.push_back({std::move(pattern), settings});
+}
+
+void CompressionPolicy::SetPathSettings(std::string_view entryPath, const CompressionSettings& settings)
+{
+    std::string pattern = NormalizePattern(entryPath);
+    if (!pattern.starts_with('/'))
+        pattern.insert(pattern.begin(), '/');
+
+    while (pattern.size() > 1 && pattern.back() == '/')
+        pattern.pop_back();
+
+    auto ruleIt = std::find_if(m_PathRules.begin(), m_PathRules.end(), [&pattern](const Rule& rule) { return rule.m_Pattern == pattern; });
+    if (ruleIt != m_PathRules.end())
+    {
+        ruleIt->m_Settings = settings;
+        return;
+    }
+
+    m_PathRules.push_back({std::move(pattern), settings});
+}
+
+CompressionSettings CompressionPolicy::GetSettings(std::string_view entryPath) const
+{
+    // entries can be added with or without a leading separator
+    std::string path = NormalizePattern(entryPath);
+    if (!path.starts_with('/'))
+        path.insert(path.begin(), '/');
+
+    const Rule* bestPathRule = nullptr;
+    for (const Rule& rule : m_PathRules)
+    {
+        if (!path.starts_with(rule.m_Pattern))
+            continue;
+
+        // "/audio" matches "/audio/x.awc" and "/audio" but not "/audiobank.rpf"
+        bool isBoundary = path.size() == rule.m_Pattern.size() || path[rule.m_Pattern.size()] == '/' || rule.m_Pattern.back() == '/';
+        if (isBoundary && (bestPathRule == nullptr || rule.m_Pattern.size() > bestPathRule->m_Pattern.size()))
+            bestPathRule = &rule;
+    }
+
+    if (bestPathRule != nullptr)
+        return bestPathRule->m_Settings;
+
+    size_t namePosition = path.rfind('/');
+    size_t extensionPosition = path.rfind('.');
+    if (extensionPosition != std::string::npos && (namePosition == std::string::npos || extensionPosition > namePosition + 1))
+    {
+        std::string_view extension = std::string_view(path).substr(extensionPosition);
+        for (const Rule& rule : m_ExtensionRules)
+        {
+            if (rule.m_Pattern == extension)
+                return rule.m_Settings;
+        }
+    }
+
+    return m_DefaultSettings;
+}
+
+bool CompressionPolicy::IsWorthCompressing(std::span<const uint8_t> data) const
+{
+    if (!m_IsIncompressibleDetectionEnabled || data.size() < PROBE_SAMPLE_SIZE)
+        return true;
+
+    // samples spread evenly across the data so headers alone do not decide for the whole entry
+    uint32_t histogram[256] = {};
+    uint64_t sampleCount = std::min<uint64_t>(PROBE_SAMPLE_COUNT, data.size() / PROBE_SAMPLE_SIZE);
+    uint64_t sampleStride = (data.size() - PROBE_SAMPLE_SIZE) / std::max<uint64_t>(sampleCount - 1, 1);
+
+    for (uint64_t sample = 0; sample < sampleCount; sample++)
+    {
+        const uint8_t* sampleData = data.data() + sample * sampleStride;
+        for (uint64_t i = 0; i < PROBE_SAMPLE_SIZE; i++)
+            histogram[sampleData[i]]++;
+    }
+
+    double totalBytes = (double)(sampleCount * PROBE_SAMPLE_SIZE);
+    double entropy = 0.0;
+    for (uint32_t count : histogram)
+    {
+        if (count == 0)
+            continue;
+
+        double probability = count / totalBytes;
+        entropy -= probability * std::log2(probability);
+    }
+
+    return entropy < INCOMPRESSIBLE_ENTROPY;
+}
+
+std::string CompressionPolicy::NormalizePattern(std::string_view pattern)
+{
+    std::string normalized(pattern);
+    for (char& c : normalized)
+    {
+        if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+        else if (c == '\\')
+            c = '/';
+    }
+
+    return normalized;
+}
@@ -0,0 +1,145 @@
+#include <rpflib/content_hash.h>
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+using namespace rpflib;
+
+static const uint64_t C1 = 0x87C37B91114253D5ull;
+static const uint64_t C2 = 0x4CF5AD432745937Full;
+
+static inline uint64_t ReadBlock(const uint8_t* data)
+{
+    uint64_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static inline uint64_t FinalMix(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xFF51AFD7ED558CCDull;
+    k ^= k >> 33;
+    k *= 0xC4CEB9FE1A85EC53ull;
+    k ^= k >> 33;
+
+    return k;
+}
+
+static inline void MixBlocks(uint64_t& h1, uint64_t& h2, const uint8_t* bytes, uint64_t blockCount)
+{
+    for (uint64_t i = 0; i < blockCount; i++)
+    {
+        uint64_t k1 = ReadBlock(bytes + i * 16);
+        uint64_t k2 = ReadBlock(bytes + i * 16 + 8);
+
+        k1 *= C1;
+        k1 = std::rotl(k1, 31);
+        k1 *= C2;
+        h1 ^= k1;
+
+        h1 = std::rotl(h1, 27);
+        h1 += h2;
+        h1 = h1 * 5 + 0x52DCE729;
+
+        k2 *= C2;
+        k2 = std::rotl(k2, 33);
+        k2 *= C1;
+        h2 ^= k2;
+
+        h2 = std::rotl(h2, 31);
+        h2 += h1;
+        h2 = h2 * 5 + 0x38495AB5;
+    }
+}
+
+static ContentHash Finalize(uint64_t h1, uint64_t h2, const uint8_t* tail, uint64_t tailLength, uint64_t length)
+{
+    // the tail bytes are loaded little-endian, the same as the reference implementation
+    uint64_t k1 = 0;
+    uint64_t k2 = 0;
+    for (uint64_t i = tailLength; i > 8; i--)
+        k2 ^= (uint64_t)tail[i - 1] << ((i - 9) * 8);
+
+    if (tailLength > 8)
+    {
+        k2 *= C2;
+        k2 = std::rotl(k2, 33);
+        k2 *= C1;
+        h2 ^= k2;
+    }
+
+    for (uint64_t i = std::min<uint64_t>(tailLength, 8); i > 0; i--)
+        k1 ^= (uint64_t)tail[i - 1] << ((i - 1) * 8);
+
+    if (tailLength > 0)
+    {
+        k1 *= C1;
+        k1 = std::rotl(k1, 31);
+        k1 *= C2;
+        h1 ^= k1;
+    }
+
+    h1 ^= length;
+    h2 ^= length;
+
+    h1 += h2;
+    h2 += h1;
+
+    h1 = FinalMix(h1);
+    h2 = FinalMix(h2);
+
+    h1 += h2;
+    h2 += h1;
+
+    return {h1, h2};
+}
+
+ContentHash ContentHash::Compute(std::span<const uint8_t> data, uint64_t seed)
+{
+    uint64_t h1 = seed;
+    uint64_t h2 = seed;
+
+    uint64_t blockCount = data.size() / 16;
+    MixBlocks(h1, h2, data.data(), blockCount);
+
+    return Finalize(h1, h2, data.data() + blockCount * 16, data.size() & 15, data.size());
+}
+
+ContentHasher::ContentHasher(uint64_t seed) : m_H1(seed), m_H2(seed)
+{
+}
+
+void ContentHasher::Update(std::span<const uint8_t> data)
+{
+    if (data.empty())
+        return;
+
+    m_Length += data.size();
+
+    // completes the block left over from the previous piece first
+    if (m_TailLength != 0)
+    {
+        uint64_t copySize = std::min<uint64_t>(data.size(), sizeof(m_Tail) - m_TailLength);
+        std::memcpy(m_Tail + m_TailLength, data.data(), copySize);
+        m_TailLength += copySize;
+        data = data.subspan(copySize);
+
+        if (m_TailLength < sizeof(m_Tail))
+            return;
+
+        MixBlocks(m_H1, m_H2, m_Tail, 1);
+        m_TailLength = 0;
+    }
+
+    uint64_t blockCount = data.size() / 16;
+    MixBlocks(m_H1, m_H2, data.data(), blockCount);
+
+    m_TailLength = data.size() & 15;
+    std::memcpy(m_Tail, data.data() + blockCount * 16, m_TailLength);
+}
+
+ContentHash ContentHasher::Finish() const
+{
+    return Finalize(m_H1, m_H2, m_Tail, m_TailLength, m_Length);
+}
@@ -0,0 +1,333 @@
+#include <rpflib/crypto.h>
+#include <rpflib/entry_index.h>
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define RPFLIB_HAS_AES_NI
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include <immintrin.h>
+#endif
+
+#if defined(RPFLIB_HAS_AES_NI) && (defined(__GNUC__) || defined(__clang__))
+#define RPFLIB_TARGET_AES __attribute__((target("aes,sse2")))
+#else
+#define RPFLIB_TARGET_AES
+#endif
+
+using namespace rpflib;
+
+namespace
+{
+    uint8_t Multiply(uint8_t a, uint8_t b)
+    {
+        uint8_t result = 0;
+        while (b != 0)
+        {
+            if (b & 1)
+                result ^= a;
+
+            a = static_cast<uint8_t>((a << 1) ^ ((a & 0x80) ? 0x1B : 0));
+            b >>= 1;
+        }
+
+        return result;
+    }
+
+    uint32_t RotateRight(uint32_t value, uint32_t shift)
+    {
+        return (value >> shift) | (value << (32 - shift));
+    }
+
+    uint32_t LoadBigEndian(const uint8_t* data)
+    {
+        return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+    }
+
+    void StoreBigEndian(uint8_t* data, uint32_t value)
+    {
+        data[0] = (uint8_t)(value >> 24);
+        data[1] = (uint8_t)(value >> 16);
+        data[2] = (uint8_t)(value >> 8);
+        data[3] = (uint8_t)value;
+    }
+
+    // the S-box and decryption T-tables are derived once instead of being spelled out
+    struct AesTables
+    {
+        uint8_t m_Sbox[256];
+        uint8_t m_InverseSbox[256];
+        uint32_t m_Td[4][256];
+
+        AesTables()
+        {
+            uint8_t p = 1;
+            uint8_t q = 1;
+            do
+            {
+                // p walks the multiplicative group by 3, q tracks its inverse by 1/3
+                p = static_cast<uint8_t>(p ^ (p << 1) ^ ((p & 0x80) ? 0x1B : 0));
+
+                q ^= q << 1;
+                q ^= q << 2;
+                q ^= q << 4;
+                if (q & 0x80)
+                    q ^= 0x09;
+
+                uint8_t affine = q ^ (uint8_t)((q << 1) | (q >> 7)) ^ (uint8_t)((q << 2) | (q >> 6)) ^ (uint8_t)((q << 3) | (q >> 5)) ^
+                                 (uint8_t)((q << 4) | (q >> 4));
+                m_Sbox[p] = affine ^ 0x63;
+            } while (p != 1);
+            m_Sbox[0] = 0x63;
+
+            for (uint32_t i = 0; i < 256; i++)
+                m_InverseSbox[m_Sbox[i]] = static_cast<uint8_t>(i);
+
+            for (uint32_t i = 0; i < 256; i++)
+            {
+                uint8_t s = m_InverseSbox[i];
+                m_Td[0][i] = ((uint32_t)Multiply(s, 0x0E) << 24) | ((uint32_t)Multiply(s, 0x09) << 16) | ((uint32_t)Multiply(s, 0x0D) << 8) | Multiply(s, 0x0B);
+                m_Td[1][i] = RotateRight(m_Td[0][i], 8);
+                m_Td[2][i] = RotateRight(m_Td[0][i], 16);
+                m_Td[3][i] = RotateRight(m_Td[0][i], 24);
+            }
+        }
+    };
+
+    const AesTables& GetAesTables()
+    {
+        static const AesTables tables;
+        return tables;
+    }
+
+    void DecryptAesBlock(uint8_t* block, const uint32_t* roundKeys, uint32_t roundCount)
+    {
+        const AesTables& tables = GetAesTables();
+        const uint32_t(&td)[4][256] = tables.m_Td;
+        const uint8_t* inverseSbox = tables.m_InverseSbox;
+
+        uint32_t s0 = LoadBigEndian(block + 0) ^ roundKeys[0];
+        uint32_t s1 = LoadBigEndian(block + 4) ^ roundKeys[1];
+        uint32_t s2 = LoadBigEndian(block + 8) ^ roundKeys[2];
+        uint32_t s3 = LoadBigEndian(block + 12) ^ roundKeys[3];
+
+        for (uint32_t round = 1; round < roundCount; round++)
+        {
+            const uint32_t* roundKey = roundKeys + round * 4;
+            uint32_t t0 = td[0][s0 >> 24] ^ td[1][(s3 >> 16) & 0xFF] ^ td[2][(s2 >> 8) & 0xFF] ^ td[3][s1 & 0xFF] ^ roundKey[0];
+            uint32_t t1 = td[0][s1 >> 24] ^ td[1][(s0 >> 16) & 0xFF] ^ td[2][(s3 >> 8) & 0xFF] ^ td[3][s2 & 0xFF] ^ roundKey[1];
+            uint32_t t2 = td[0][s2 >> 24] ^ td[1][(s1 >> 16) & 0xFF] ^ td[2][(s0 >> 8) & 0xFF] ^ td[3][s3 & 0xFF] ^ roundKey[2];
+            uint32_t t3 = td[0][s3 >> 24] ^ td[1][(s2 >> 16) & 0xFF] ^ td[2][(s1 >> 8) & 0xFF] ^ td[3][s0 & 0xFF] ^ roundKey[3];
+
+            s0 = t0;
+            s1 = t1;
+            s2 = t2;
+            s3 = t3;
+        }
+
+        const uint32_t* roundKey = roundKeys + roundCount * 4;
+        StoreBigEndian(block + 0, ((uint32_t)inverseSbox[s0 >> 24] << 24) ^ ((uint32_t)inverseSbox[(s3 >> 16) & 0xFF] << 16) ^
+                                      ((uint32_t)inverseSbox[(s2 >> 8) & 0xFF] << 8) ^ inverseSbox[s1 & 0xFF] ^ roundKey[0]);
+        StoreBigEndian(block + 4, ((uint32_t)inverseSbox[s1 >> 24] << 24) ^ ((uint32_t)inverseSbox[(s0 >> 16) & 0xFF] << 16) ^
+                                      ((uint32_t)inverseSbox[(s3 >> 8) & 0xFF] << 8) ^ inverseSbox[s2 & 0xFF] ^ roundKey[1]);
+        StoreBigEndian(block + 8, ((uint32_t)inverseSbox[s2 >> 24] << 24) ^ ((uint32_t)inverseSbox[(s1 >> 16) & 0xFF] << 16) ^
+                                      ((uint32_t)inverseSbox[(s0 >> 8) & 0xFF] << 8) ^ inverseSbox[s3 & 0xFF] ^ roundKey[2]);
+        StoreBigEndian(block + 12, ((uint32_t)inverseSbox[s3 >> 24] << 24) ^ ((uint32_t)inverseSbox[(s2 >> 16) & 0xFF] << 16) ^
+                                       ((uint32_t)inverseSbox[(s1 >> 8) & 0xFF] << 8) ^ inverseSbox[s0 & 0xFF] ^ roundKey[3]);
+    }
+
+#ifdef RPFLIB_HAS_AES_NI
+    // eight independent blocks keep the AES units busy, aesdec has a latency of several cycles
+    RPFLIB_TARGET_AES void DecryptAesBlocksHardware(uint8_t* data, uint64_t blockCount, const uint8_t* roundKeyBytes, uint32_t roundCount)
+    {
+        __m128i roundKeys[15];
+        for (uint32_t round = 0; round <= roundCount; round++)
+            roundKeys[round] = _mm_load_si128(reinterpret_cast<const __m128i*>(roundKeyBytes + round * 16));
+
+        const uint64_t laneCount = 8;
+        uint64_t block = 0;
+        for (; block + laneCount <= blockCount; block += laneCount)
+        {
+            __m128i* blocks = reinterpret_cast<__m128i*>(data + block * 16);
+
+            __m128i lanes[laneCount];
+            for (uint64_t lane = 0; lane < laneCount; lane++)
+                lanes[lane] = _mm_xor_si128(_mm_loadu_si128(blocks + lane), roundKeys[0]);
+
+            for (uint32_t round = 1; round < roundCount; round++)
+            {
+                for (uint64_t lane = 0; lane < laneCount; lane++)
+                    lanes[lane] = _mm_aesdec_si128(lanes[lane], roundKeys[round]);
+            }
+
+            for (uint64_t lane = 0; lane < laneCount; lane++)
+                _mm_storeu_si128(blocks + lane, _mm_aesdeclast_si128(lanes[lane], roundKeys[roundCount]));
+        }
+
+        for (; block < blockCount; block++)
+        {
+            __m128i* blockData = reinterpret_cast<__m128i*>(data + block * 16);
+
+            __m128i state = _mm_xor_si128(_mm_loadu_si128(blockData), roundKeys[0]);
+            for (uint32_t round = 1; round < roundCount; round++)
+                state = _mm_aesdec_si128(state, roundKeys[round]);
+
+            _mm_storeu_si128(blockData, _mm_aesdeclast_si128(state, roundKeys[roundCount]));
+        }
+    }
+
+    bool HasAesInstructions()
+    {
+#ifdef _MSC_VER
+        int cpuInfo[4] = {};
+        __cpuid(cpuInfo, 1);
+        return (cpuInfo[2] & (1 << 25)) != 0;
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("aes");
+#endif
+    }
+#endif
+}
+
+AesDecryptor::AesDecryptor(std::span<const uint8_t> key)
+{
+    const AesTables& tables = GetAesTables();
+
+    uint8_t keyBytes[RPF7Keys::AES_KEY_SIZE] = {};
+    std::copy_n(key.begin(), std::min<size_t>(key.size(), sizeof(keyBytes)), keyBytes);
+
+    // AES-256 encryption key schedule
+    uint32_t encryptionKeys[(ROUND_COUNT + 1) * 4];
+    for (uint32_t i = 0; i < 8; i++)
+        encryptionKeys[i] = LoadBigEndian(keyBytes + i * 4);
+
+    uint8_t roundConstant = 1;
+    for (uint32_t i = 8; i < (ROUND_COUNT + 1) * 4; i++)
+    {
+        uint32_t word = encryptionKeys[i - 1];
+        if (i % 8 == 0)
+        {
+            word = (word << 8) | (word >> 24);
+            word = ((uint32_t)tables.m_Sbox[word >> 24] << 24) | ((uint32_t)tables.m_Sbox[(word >> 16) & 0xFF] << 16) |
+                   ((uint32_t)tables.m_Sbox[(word >> 8) & 0xFF] << 8) | tables.m_Sbox[word & 0xFF];
+            word ^= (uint32_t)roundConstant << 24;
+            roundConstant = Multiply(roundConstant, 2);
+        }
+        else if (i % 8 == 4)
+        {
+            word = ((uint32_t)tables.m_Sbox[word >> 24] << 24) | ((uint32_t)tables.m_Sbox[(word >> 16) & 0xFF] << 16) |
+                   ((uint32_t)tables.m_Sbox[(word >> 8) & 0xFF] << 8) | tables.m_Sbox[word & 0xFF];
+        }
+
+        encryptionKeys[i] = encryptionKeys[i - 8] ^ word;
+    }
+
+    // the equivalent inverse cipher runs the round keys backwards with InvMixColumns applied to all but the outer
+    // two, which is also the form aesdec expects
+    for (uint32_t round = 0; round <= ROUND_COUNT; round++)
+    {
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            uint32_t word = encryptionKeys[(ROUND_COUNT - round) * 4 + i];
+            if (round != 0 && round != ROUND_COUNT)
+            {
+                word = tables.m_Td[0][tables.m_Sbox[word >> 24]] ^ tables.m_Td[1][tables.m_Sbox[(word >> 16) & 0xFF]] ^
+                       tables.m_Td[2][tables.m_Sbox[(word >> 8) & 0xFF]] ^ tables.m_Td[3][tables.m_Sbox[word & 0xFF]];
+            }
+
+            m_RoundKeys[round * 4 + i] = word;
+            StoreBigEndian(m_RoundKeyBytes + round * 16 + i * 4, word);
+        }
+    }
+}
+
+void AesDecryptor::Decrypt(uint8_t* data, uint64_t size) const
+{
+    uint64_t blockCount = size / BLOCK_SIZE;
+
+#ifdef RPFLIB_HAS_AES_NI
+    if (IsHardwareAccelerated())
+    {
+        DecryptAesBlocksHardware(data, blockCount, m_RoundKeyBytes, ROUND_COUNT);
+        return;
+    }
+#endif
+
+    for (uint64_t block = 0; block < blockCount; block++)
+        DecryptAesBlock(data + block * BLOCK_SIZE, m_RoundKeys, ROUND_COUNT);
+}
+
+bool AesDecryptor::IsHardwareAccelerated()
+{
+#ifdef RPFLIB_HAS_AES_NI
+    static const bool hasAesInstructions = HasAesInstructions();
+    return hasAesInstructions;
+#else
+    return false;
+#endif
+}
+
+NgDecryptor::NgDecryptor(std::shared_ptr<const RPF7Keys> keys) : m_Keys(std::move(keys))
+{
+}
+
+uint32_t NgDecryptor::GetKeyIndex(std::string_view name, uint64_t length)
+{
+    return (EntryIndex::GetPathHash(name) + static_cast<uint32_t>(length) + NG_KEY_INDEX_OFFSET) % RPF7Keys::NG_KEY_COUNT;
+}
+
+void NgDecryptor::Decrypt(uint8_t* data, uint64_t size, std::string_view name, uint64_t length) const
+{
+    if (m_Keys == nullptr || !m_Keys->HasNgKeys())
+        return;
+
+    uint32_t roundKeys[RPF7Keys::NG_ROUND_COUNT * 4];
+    std::memcpy(roundKeys, m_Keys->m_NgKeys.data() + GetKeyIndex(name, length) * RPF7Keys::NG_KEY_SIZE, sizeof(roundKeys));
+
+    const uint32_t* tables = m_Keys->m_NgDecryptTables.data();
+
+    // rounds run over a batch of blocks at a time so the table lookups of independent blocks overlap
+    const uint64_t batchSize = 8;
+    uint64_t blockCount = size / 16;
+    for (uint64_t firstBlock = 0; firstBlock < blockCount; firstBlock += batchSize)
+    {
+        uint64_t batchBlocks = std::min(batchSize, blockCount - firstBlock);
+
+        uint32_t state[batchSize][4];
+        std::memcpy(state, data + firstBlock * 16, batchBlocks * 16);
+
+        for (uint32_t round = 0; round < RPF7Keys::NG_ROUND_COUNT; round++)
+        {
+            const uint32_t* table = tables + round * 16 * 256;
+            const uint32_t* roundKey = roundKeys + round * 4;
+
+            // the first two and the last round mix bytes within each word, the rounds in between across words
+            bool isWordRound = round < 2 || round == RPF7Keys::NG_ROUND_COUNT - 1;
+            for (uint64_t block = 0; block < batchBlocks; block++)
+            {
+                uint8_t bytes[16];
+                std::memcpy(bytes, state[block], sizeof(bytes));
+
+                if (isWordRound)
+                {
+                    state[block][0] = table[0 * 256 + bytes[0]] ^ table[1 * 256 + bytes[1]] ^ table[2 * 256 + bytes[2]] ^ table[3 * 256 + bytes[3]] ^ roundKey[0];
+                    state[block][1] = table[4 * 256 + bytes[4]] ^ table[5 * 256 + bytes[5]] ^ table[6 * 256 + bytes[6]] ^ table[7 * 256 + bytes[7]] ^ roundKey[1];
+                    state[block][2] = table[8 * 256 + bytes[8]] ^ table[9 * 256 + bytes[9]] ^ table[10 * 256 + bytes[10]] ^ table[11 * 256 + bytes[11]] ^ roundKey[2];
+                    state[block][3] = table[12 * 256 + bytes[12]] ^ table[13 * 256 + bytes[13]] ^ table[14 * 256 + bytes[14]] ^ table[15 * 256 + bytes[15]] ^ roundKey[3];
+                }
+                else
+                {
+                    state[block][0] = table[0 * 256 + bytes[0]] ^ table[7 * 256 + bytes[7]] ^ table[10 * 256 + bytes[10]] ^ table[13 * 256 + bytes[13]] ^ roundKey[0];
+                    state[block][1] = table[1 * 256 + bytes[1]] ^ table[4 * 256 + bytes[4]] ^ table[11 * 256 + bytes[11]] ^ table[14 * 256 + bytes[14]] ^ roundKey[1];
+                    state[block][2] = table[2 * 256 + bytes[2]] ^ table[5 * 256 + bytes[5]] ^ table[8 * 256 + bytes[8]] ^ table[15 * 256 + bytes[15]] ^ roundKey[2];
+                    state[block][3] = table[3 * 256 + bytes[3]] ^ table[6 * 256 + bytes[6]] ^ table[9 * 256 + bytes[9]] ^ table[12 * 256 + bytes[12]] ^ roundKey[3];
+                }
+            }
+        }
+
+        std::memcpy(data + firstBlock * 16, state, batchBlocks * 16);
+    }
+}
@@ -0,0 +1,87 @@
+#include <rpflib/entry_cache.h>
+#include <algorithm>
+
+using namespace rpflib;
+
+EntryCache::EntryCache(uint64_t byteBudget, uint32_t shardCount) : m_ByteBudget(byteBudget), m_ShardCount(std::max<uint32_t>(shardCount, 1))
+{
+    m_ShardBudget = m_ByteBudget / m_ShardCount;
+    m_Shards = std::make_unique<Shard[]>(m_ShardCount);
+}
+
+EntryCache::EntryDataPointer EntryCache::Find(uint32_t key)
+{
+    Shard& shard = GetShard(key);
+    std::lock_guard lock(shard.m_Mutex);
+
+    auto itemIt = shard.m_Lookup.find(key);
+    if (itemIt == shard.m_Lookup.end())
+    {
+        m_Misses++;
+        return nullptr;
+    }
+
+    shard.m_Items.splice(shard.m_Items.begin(), shard.m_Items, itemIt->second);
+    m_Hits++;
+
+    return itemIt->second->m_Data;
+}
+
+EntryCache::EntryDataPointer EntryCache::Insert(uint32_t key, std::vector<uint8_t>&& data)
+{
+    EntryDataPointer entryData = std::make_shared<const std::vector<uint8_t>>(std::move(data));
+
+    uint64_t dataSize = entryData->size();
+    if (dataSize > m_ShardBudget)
+        return entryData;
+
+    Shard& shard = GetShard(key);
+    std::lock_guard lock(shard.m_Mutex);
+
+    auto itemIt = shard.m_Lookup.find(key);
+    if (itemIt != shard.m_Lookup.end())
+        return itemIt->second->m_Data;
+
+    while (!shard.m_Items.empty() && shard.m_CachedBytes + dataSize > m_ShardBudget)
+    {
+        CacheItem& evictedItem = shard.m_Items.back();
+        shard.m_CachedBytes -= evictedItem.m_Data->size();
+        shard.m_Lookup.erase(evictedItem.m_Key);
+        shard.m_Items.pop_back();
+        m_Evictions++;
+    }
+
+    shard.m_Items.push_front({key, entryData});
+    shard.m_Lookup[key] = shard.m_Items.begin();
+    shard.m_CachedBytes += dataSize;
+
+    return entryData;
+}
+
+void EntryCache::Clear()
+{
+    for (uint32_t i = 0; i < m_ShardCount; i++)
+    {
+        std::lock_guard lock(m_Shards[i].m_Mutex);
+        m_Shards[i].m_Items.clear();
+        m_Shards[i].m_Lookup.clear();
+        m_Shards[i].m_CachedBytes = 0;
+    }
+}
+
+EntryCache::Stats EntryCache::GetStats() const
+{
+    Stats stats;
+    stats.m_Hits = m_Hits;
+    stats.m_Misses = m_Misses;
+    stats.m_Evictions = m_Evictions;
+
+    for (uint32_t i = 0; i < m_ShardCount; i++)
+    {
+        std::lock_guard lock(m_Shards[i].m_Mutex);
+        stats.m_CachedBytes += m_Shards[i].m_CachedBytes;
+        stats.m_CachedEntries += m_Shards[i].m_Items.size();
+    }
+
+    return stats;
+}
@@ -0,0 +1,195 @@
+#include <rpflib/entry_index.h>
+#include <algorithm>
+#include <bit>
+
+using namespace rpflib;
+
+static inline char NormalizePathChar(char c)
+{
+    if (c >= 'A' && c <= 'Z')
+        return c + ('a' - 'A');
+
+    if (c == '\\')
+        return '/';
+
+    return c;
+}
+
+uint32_t EntryIndex::GetPathHash(std::string_view path)
+{
+    uint32_t hash = 0;
+    for (char c : path)
+    {
+        hash += static_cast<uint8_t>(NormalizePathChar(c));
+        hash += hash << 10;
+        hash ^= hash >> 6;
+    }
+
+    hash += hash << 3;
+    hash ^= hash >> 11;
+    hash += hash << 15;
+
+    return hash;
+}
+
+void EntryIndex::Reserve(uint32_t count)
+{
+    m_Items.reserve(count);
+
+    uint32_t slotCount = std::bit_ceil(std::max<uint32_t>(count * 2, 16));
+    if (slotCount > m_Slots.size())
+        Rehash(slotCount);
+}
+
+void EntryIndex::Insert(std::string_view path, uint32_t entryIndex)
+{
+    // keep the load factor at or below one half so probe chains stay short
+    if ((m_Items.size() + 1) * 2 > m_Slots.size())
+        Rehash(std::bit_ceil(std::max<uint32_t>(static_cast<uint32_t>(m_Slots.size()) * 2, 16)));
+
+    uint32_t pathHash = GetPathHash(path);
+    if (FindItem(path, pathHash) != INVALID_INDEX)
+        return;
+
+    uint32_t itemIndex = static_cast<uint32_t>(m_Items.size());
+    m_Items.push_back({pathHash, entryIndex, static_cast<uint32_t>(m_PathData.size()), static_cast<uint32_t>(path.size())});
+    m_PathData.append(path);
+
+    uint32_t mask = static_cast<uint32_t>(m_Slots.size()) - 1;
+    uint32_t slotIndex = pathHash & mask;
+    while (m_Slots[slotIndex].m_ItemIndex != INVALID_INDEX)
+        slotIndex = (slotIndex + 1) & mask;
+
+    m_Slots[slotIndex] = {pathHash, itemIndex};
+}
+
+void EntryIndex::Clear()
+{
+    m_Slots.clear();
+    m_Items.clear();
+    m_PathData.clear();
+}
+
+bool EntryIndex::Assign(std::span<const Slot> slots, std::span<const Item> items, std::string_view pathData)
+{
+    // probing needs a power of two slot count and at least one free slot, and no lookup may leave the tables
+    if (!slots.empty() && !std::has_single_bit(slots.size()))
+        return false;
+
+    if (!items.empty() && items.size() * 2 > slots.size())
+        return false;
+
+    for (const Item& item : items)
+    {
+        if (item.m_PathOffset > pathData.size() || item.m_PathLength > pathData.size() - item.m_PathOffset)
+            return false;
+    }
+
+    for (const Slot& slot : slots)
+    {
+        if (slot.m_ItemIndex != INVALID_INDEX && slot.m_ItemIndex >= items.size())
+            return false;
+    }
+
+    m_Slots.assign(slots.begin(), slots.end());
+    m_Items.assign(items.begin(), items.end());
+    m_PathData.assign(pathData);
+
+    return true;
+}
+
+uint32_t EntryIndex::Find(std::string_view path) const
+{
+    uint32_t itemIndex = FindItem(path, GetPathHash(path));
+    if (itemIndex == INVALID_INDEX)
+        return INVALID_INDEX;
+
+    return m_Items[itemIndex].m_EntryIndex;
+}
+
+uint32_t EntryIndex::Find(uint32_t pathHash) const
+{
+    if (m_Slots.empty())
+        return INVALID_INDEX;
+
+    uint32_t mask = static_cast<uint32_t>(m_Slots.size()) - 1;
+    for (uint32_t slotIndex = pathHash & mask; m_Slots[slotIndex].m_ItemIndex != INVALID_INDEX; slotIndex = (slotIndex + 1) & mask)
+    {
+        if (m_Slots[slotIndex].m_PathHash == pathHash)
+            return m_Items[m_Slots[slotIndex].m_ItemIndex].m_EntryIndex;
+    }
+
+    return INVALID_INDEX;
+}
+
+bool EntryIndex::IsSamePath(std::string_view a, std::string_view b)
+{
+    if (a.size() != b.size())
+        return false;
+
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        if (NormalizePathChar(a[i]) != NormalizePathChar(b[i]))
+            return false;
+    }
+
+    return true;
+}
+
+std::string_view EntryIndex::NormalizePath(std::string_view path, std::string& buffer)
+{
+    bool isNormalized = !path.empty() && NormalizePathChar(path.front()) == '/' && NormalizePathChar(path.back()) != '/';
+    for (size_t i = 1; isNormalized && i < path.size(); i++)
+        isNormalized = NormalizePathChar(path[i]) != '/' || NormalizePathChar(path[i - 1]) != '/';
+
+    if (isNormalized)
+        return path;
+
+    buffer.clear();
+    buffer.reserve(path.size() + 1);
+    while (!path.empty())
+    {
+        size_t separator = path.find_first_of("/\\");
+        std::string_view segment = path.substr(0, separator);
+        path.remove_prefix(separator == std::string_view::npos ? path.size() : separator + 1);
+
+        if (segment.empty())
+            continue;
+
+        buffer += '/';
+        buffer += segment;
+    }
+
+    return buffer;
+}
+
+void EntryIndex::Rehash(uint32_t slotCount)
+{
+    m_Slots.assign(slotCount, {0, INVALID_INDEX});
+
+    uint32_t mask = slotCount - 1;
+    for (uint32_t itemIndex = 0; itemIndex < m_Items.size(); itemIndex++)
+    {
+        uint32_t slotIndex = m_Items[itemIndex].m_PathHash & mask;
+        while (m_Slots[slotIndex].m_ItemIndex != INVALID_INDEX)
+            slotIndex = (slotIndex + 1) & mask;
+
+        m_Slots[slotIndex] = {m_Items[itemIndex].m_PathHash, itemIndex};
+    }
+}
+
+uint32_t EntryIndex::FindItem(std::string_view path, uint32_t pathHash) const
+{
+    if (m_Slots.empty())
+        return INVALID_INDEX;
+
+    uint32_t mask = static_cast<uint32_t>(m_Slots.size()) - 1;
+    for (uint32_t slotIndex = pathHash & mask; m_Slots[slotIndex].m_ItemIndex != INVALID_INDEX; slotIndex = (slotIndex + 1) & mask)
+    {
+        const Slot& slot = m_Slots[slotIndex];
+        if (slot.m_PathHash == pathHash && IsSamePath(GetPath(m_Items[slot.m_ItemIndex]), path))
+            return slot.m_ItemIndex;
+    }
+
+    return INVALID_INDEX;
+}
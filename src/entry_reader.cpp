@@ -0,0 +1,185 @@
+#include <rpflib/entry_reader.h>
+#include <zlib.h>
+#include <algorithm>
+#include <cstring>
+
+using namespace rpflib;
+
+EntryReader::EntryReader(std::shared_ptr<ArchiveFile> archiveFile, uint64_t storedOffset, uint64_t storedSize, uint64_t size, bool isCompressed,
+                         DecryptCallback decrypt) :
+    m_ArchiveFile(std::move(archiveFile)), m_StoredOffset(storedOffset), m_StoredSize(storedSize), m_Size(size), m_IsCompressed(isCompressed),
+    m_Decrypt(std::move(decrypt))
+{
+    if (m_Decrypt)
+        m_InputWindow.resize(WINDOW_SIZE);
+
+    if (!m_IsCompressed)
+        return;
+
+    m_InflateStream = std::make_unique<z_stream>();
+    if (inflateInit2(m_InflateStream.get(), -15) != Z_OK)
+    {
+        m_InflateStream.reset();
+        m_HasFailed = true;
+        return;
+    }
+
+    m_InputWindow.resize(WINDOW_SIZE);
+}
+
+EntryReader::~EntryReader()
+{
+    if (m_InflateStream)
+        inflateEnd(m_InflateStream.get());
+}
+
+uint64_t EntryReader::Read(void* buffer, uint64_t size)
+{
+    if (IsEndOfEntry())
+        return 0;
+
+    size = std::min(size, m_Size - m_Position);
+
+    uint8_t* output = static_cast<uint8_t*>(buffer);
+    uint64_t readBytes = m_IsCompressed ? ReadCompressed(output, size) : ReadStored(output, size);
+
+    if (m_Position < m_LeadingBytes.size())
+        std::memcpy(output, m_LeadingBytes.data() + m_Position, std::min<uint64_t>(readBytes, m_LeadingBytes.size() - m_Position));
+
+    m_Position += readBytes;
+    return readBytes;
+}
+
+uint64_t EntryReader::Skip(uint64_t size)
+{
+    if (IsEndOfEntry())
+        return 0;
+
+    size = std::min(size, m_Size - m_Position);
+
+    if (!m_IsCompressed && !m_Decrypt)
+    {
+        m_Position += size;
+        m_StoredPosition += size;
+        return size;
+    }
+
+    // deflate streams can only be skipped by decoding them
+    if (m_SkipWindow.empty())
+        m_SkipWindow.resize(WINDOW_SIZE);
+
+    uint64_t skippedBytes = 0;
+    while (skippedBytes < size)
+    {
+        uint64_t readBytes = Read(m_SkipWindow.data(), std::min<uint64_t>(size - skippedBytes, m_SkipWindow.size()));
+        if (readBytes == 0)
+            break;
+
+        skippedBytes += readBytes;
+    }
+
+    return skippedBytes;
+}
+
+void EntryReader::SetLeadingBytes(std::span<const uint8_t> data)
+{
+    m_LeadingBytes.assign(data.begin(), data.end());
+}
+
+uint64_t EntryReader::ReadStored(uint8_t* buffer, uint64_t size)
+{
+    if (!m_Decrypt)
+    {
+        if (!m_ArchiveFile->Read(m_StoredOffset + m_StoredPosition, buffer, size))
+        {
+            m_HasFailed = true;
+            return 0;
+        }
+
+        m_StoredPosition += size;
+        return size;
+    }
+
+    // encrypted data can only be decrypted in whole blocks, so it goes through the window like compressed data
+    uint64_t readBytes = 0;
+    while (readBytes < size)
+    {
+        if (m_WindowPosition == m_WindowSize && !FillInputWindow())
+            break;
+
+        uint64_t chunkSize = std::min(size - readBytes, m_WindowSize - m_WindowPosition);
+        std::memcpy(buffer + readBytes, m_InputWindow.data() + m_WindowPosition, chunkSize);
+
+        m_WindowPosition += chunkSize;
+        readBytes += chunkSize;
+    }
+
+    return readBytes;
+}
+
+uint64_t EntryReader::ReadCompressed(uint8_t* buffer, uint64_t size)
+{
+    z_stream* stream = m_InflateStream.get();
+
+    uint64_t readBytes = 0;
+    while (readBytes < size)
+    {
+        // inflate can still hold output once all input is consumed, so it keeps running without input until the stream ends
+        if (stream->avail_in == 0 && !FillInputWindow() && m_HasFailed)
+            break;
+
+        uInt chunkSize = static_cast<uInt>(std::min<uint64_t>(size - readBytes, 0x40000000));
+        stream->next_out = buffer + readBytes;
+        stream->avail_out = chunkSize;
+
+        uInt inputSize = stream->avail_in;
+        int ret = inflate(stream, Z_NO_FLUSH);
+        uint64_t inflatedBytes = chunkSize - stream->avail_out;
+        readBytes += inflatedBytes;
+
+        // the entry is clamped to its real size, a stream that ends short of it is corrupt
+        if (ret == Z_STREAM_END)
+        {
+            m_HasFailed = readBytes < size;
+            break;
+        }
+
+        // no progress with room for output means the input ran out before the stream ended
+        bool isStalled = ret == Z_BUF_ERROR && inflatedBytes == 0 && stream->avail_in == inputSize;
+        if (isStalled || (ret != Z_OK && ret != Z_BUF_ERROR))
+        {
+            m_HasFailed = true;
+            break;
+        }
+    }
+
+    return readBytes;
+}
+
+bool EntryReader::FillInputWindow()
+{
+    uint64_t windowSize = std::min<uint64_t>(m_InputWindow.size(), m_StoredSize - m_StoredPosition);
+    if (windowSize == 0)
+        return false;
+
+    if (!m_ArchiveFile->Read(m_StoredOffset + m_StoredPosition, m_InputWindow.data(), windowSize))
+    {
+        m_HasFailed = true;
+        return false;
+    }
+
+    if (m_Decrypt)
+        m_Decrypt(m_InputWindow.data(), m_StoredPosition, windowSize);
+
+    m_StoredPosition += windowSize;
+    m_WindowPosition = 0;
+    m_WindowSize = windowSize;
+
+    if (m_InflateStream)
+    {
+        m_InflateStream->next_in = m_InputWindow.data();
+        m_InflateStream->avail_in = static_cast<uInt>(windowSize);
+    }
+
+    return true;
+}
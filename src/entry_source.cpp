@@ -0,0 +1,212 @@
+#include <rpflib/entry_source.h>
+#include <rpflib/archives/rpf7.h>
+#include <cstring>
+#include <fstream>
+
+using namespace rpflib;
+
+// Reads until size bytes are produced or the reader ends, returns the number of bytes read.
+static uint64_t ReadFully(const EntrySource::ReadCallback& reader, uint8_t* buffer, uint64_t size)
+{
+    uint64_t readBytes = 0;
+    while (reader && readBytes < size)
+    {
+        uint64_t chunkBytes = reader(buffer + readBytes, size - readBytes);
+        if (chunkBytes == 0)
+            break;
+
+        readBytes += chunkBytes;
+    }
+
+    return readBytes;
+}
+
+EntrySource EntrySource::FromFile(const std::filesystem::path& filePath)
+{
+    EntrySource source;
+    source.m_State = std::make_shared<SourceState>();
+    source.m_State->m_Type = SourceType::SOURCE_TYPE_FILE;
+    source.m_State->m_FilePath = filePath;
+    source.m_State->m_Size = RPF7Archive::GetFileSize(filePath);
+
+    return source;
+}
+
+EntrySource EntrySource::FromBuffer(std::vector<uint8_t>&& buffer)
+{
+    EntrySource source;
+    source.m_State = std::make_shared<SourceState>();
+    source.m_State->m_Type = SourceType::SOURCE_TYPE_BUFFER;
+    source.m_State->m_Size = buffer.size();
+    source.m_State->m_Buffer = std::move(buffer);
+
+    return source;
+}
+
+EntrySource EntrySource::FromSpan(std::span<const uint8_t> data)
+{
+    EntrySource source;
+    source.m_State = std::make_shared<SourceState>();
+    source.m_State->m_Type = SourceType::SOURCE_TYPE_SPAN;
+    source.m_State->m_Size = data.size();
+    source.m_State->m_Span = data;
+
+    return source;
+}
+
+EntrySource EntrySource::FromReader(uint64_t size, ReadCallback reader)
+{
+    EntrySource source;
+    source.m_State = std::make_shared<SourceState>();
+    source.m_State->m_Type = SourceType::SOURCE_TYPE_READER;
+    source.m_State->m_Size = size;
+    source.m_State->m_Reader = std::move(reader);
+
+    return source;
+}
+
+EntrySource EntrySource::FromStream(uint64_t size, OpenCallback openReader)
+{
+    EntrySource source;
+    source.m_State = std::make_shared<SourceState>();
+    source.m_State->m_Type = SourceType::SOURCE_TYPE_STREAM;
+    source.m_State->m_Size = size;
+    source.m_State->m_OpenReader = std::move(openReader);
+
+    return source;
+}
+
+uint64_t EntrySource::GetSize() const
+{
+    if (!m_State)
+        return 0;
+
+    return m_State->m_Size;
+}
+
+bool EntrySource::PeekData(void* buffer, uint64_t size) const
+{
+    if (!m_State || size > m_State->m_Size)
+        return false;
+
+    switch (m_State->m_Type)
+    {
+    case SourceType::SOURCE_TYPE_FILE:
+    {
+        std::fstream fileStream(m_State->m_FilePath, std::ios::in | std::ios::binary);
+        if (!fileStream.is_open())
+            return false;
+
+        fileStream.read(reinterpret_cast<char*>(buffer), size);
+        return fileStream.gcount() == (std::streamsize)size;
+    }
+    case SourceType::SOURCE_TYPE_BUFFER:
+        std::memcpy(buffer, m_State->m_Buffer.data(), size);
+        return true;
+    case SourceType::SOURCE_TYPE_SPAN:
+        std::memcpy(buffer, m_State->m_Span.data(), size);
+        return true;
+    case SourceType::SOURCE_TYPE_READER:
+    {
+        std::lock_guard lock(m_State->m_ReaderMutex);
+
+        std::vector<uint8_t>& prefix = m_State->m_ReaderPrefix;
+        while (prefix.size() < size)
+        {
+            uint64_t prefixSize = prefix.size();
+            prefix.resize(size);
+
+            uint64_t readBytes = m_State->m_Reader ? m_State->m_Reader(prefix.data() + prefixSize, size - prefixSize) : 0;
+            prefix.resize(prefixSize + readBytes);
+
+            if (readBytes == 0)
+                return false;
+        }
+
+        std::memcpy(buffer, prefix.data(), size);
+        return true;
+    }
+    case SourceType::SOURCE_TYPE_STREAM:
+    {
+        std::lock_guard lock(m_State->m_ReaderMutex);
+
+        // the reader opened for the peek is closed again right away, only the bytes it read are kept
+        std::vector<uint8_t>& prefix = m_State->m_ReaderPrefix;
+        if (prefix.size() < size)
+        {
+            ReadCallback reader = m_State->m_OpenReader ? m_State->m_OpenReader() : nullptr;
+            prefix.resize(size);
+            prefix.resize(ReadFully(reader, prefix.data(), size));
+
+            if (prefix.size() < size)
+                return false;
+        }
+
+        std::memcpy(buffer, prefix.data(), size);
+        return true;
+    }
+    }
+
+    return false;
+}
+
+bool EntrySource::GetData(std::vector<uint8_t>& data) const
+{
+    if (!m_State)
+        return false;
+
+    switch (m_State->m_Type)
+    {
+    case SourceType::SOURCE_TYPE_FILE:
+        data = RPF7Archive::GetFileData(m_State->m_FilePath);
+        break;
+    case SourceType::SOURCE_TYPE_BUFFER:
+        data = m_State->m_Buffer;
+        break;
+    case SourceType::SOURCE_TYPE_SPAN:
+        data.assign(m_State->m_Span.begin(), m_State->m_Span.end());
+        break;
+    case SourceType::SOURCE_TYPE_READER:
+    {
+        std::lock_guard lock(m_State->m_ReaderMutex);
+
+        data = std::move(m_State->m_ReaderPrefix);
+        uint64_t dataSize = data.size();
+        data.resize(m_State->m_Size);
+        dataSize += ReadFully(m_State->m_Reader, data.data() + dataSize, data.size() - dataSize);
+
+        m_State->m_Reader = nullptr;
+        data.resize(dataSize);
+        break;
+    }
+    case SourceType::SOURCE_TYPE_STREAM:
+    {
+        std::lock_guard lock(m_State->m_ReaderMutex);
+
+        ReadCallback reader = m_State->m_OpenReader ? m_State->m_OpenReader() : nullptr;
+        m_State->m_OpenReader = nullptr;
+        m_State->m_ReaderPrefix.clear();
+
+        data.resize(m_State->m_Size);
+        data.resize(ReadFully(reader, data.data(), data.size()));
+        break;
+    }
+    }
+
+    // a reader that stops early or a file that changed since it was added would be stored truncated
+    return data.size() == m_State->m_Size;
+}
+
+std::span<const uint8_t> EntrySource::GetView() const
+{
+    if (!m_State)
+        return {};
+
+    if (m_State->m_Type == SourceType::SOURCE_TYPE_BUFFER)
+        return m_State->m_Buffer;
+
+    if (m_State->m_Type == SourceType::SOURCE_TYPE_SPAN)
+        return m_State->m_Span;
+
+    return {};
+}
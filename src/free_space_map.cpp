@@ -0,0 +1,63 @@
+#include <rpflib/free_space_map.h>
+#include <iterator>
+
+using namespace rpflib;
+
+void FreeSpaceMap::AddFreeBlocks(uint64_t firstBlock, uint64_t blockCount)
+{
+    if (blockCount == 0)
+        return;
+
+    auto runIt = m_FreeRuns.emplace(firstBlock, blockCount).first;
+
+    auto nextIt = std::next(runIt);
+    if (nextIt != m_FreeRuns.end() && runIt->first + runIt->second == nextIt->first)
+    {
+        runIt->second += nextIt->second;
+        m_FreeRuns.erase(nextIt);
+    }
+
+    if (runIt != m_FreeRuns.begin())
+    {
+        auto previousIt = std::prev(runIt);
+        if (previousIt->first + previousIt->second == runIt->first)
+        {
+            previousIt->second += runIt->second;
+            m_FreeRuns.erase(runIt);
+        }
+    }
+}
+
+uint64_t FreeSpaceMap::Allocate(uint64_t blockCount)
+{
+    if (blockCount == 0)
+        return m_EndBlock;
+
+    for (auto runIt = m_FreeRuns.begin(); runIt != m_FreeRuns.end(); ++runIt)
+    {
+        if (runIt->second < blockCount)
+            continue;
+
+        uint64_t firstBlock = runIt->first;
+        uint64_t remainingBlocks = runIt->second - blockCount;
+        m_FreeRuns.erase(runIt);
+
+        if (remainingBlocks != 0)
+            m_FreeRuns.emplace(firstBlock + blockCount, remainingBlocks);
+
+        return firstBlock;
+    }
+
+    uint64_t firstBlock = m_EndBlock;
+    m_EndBlock += blockCount;
+    return firstBlock;
+}
+
+uint64_t FreeSpaceMap::GetFreeBlockCount() const
+{
+    uint64_t freeBlockCount = 0;
+    for (auto& run : m_FreeRuns)
+        freeBlockCount += run.second;
+
+    return freeBlockCount;
+}
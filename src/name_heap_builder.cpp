@@ -0,0 +1,97 @@
+#include <rpflib/name_heap_builder.h>
+#include <algorithm>
+#include <cstring>
+
+using namespace rpflib;
+
+NameHeapBuilder::NameHeapBuilder()
+{
+    Clear();
+}
+
+void NameHeapBuilder::Reserve(uint32_t count)
+{
+    m_Names.reserve(count);
+    m_NameLookup.reserve(count);
+}
+
+void NameHeapBuilder::Add(std::string_view name)
+{
+    auto [nameIt, isInserted] = m_NameLookup.try_emplace(name, static_cast<uint32_t>(m_Names.size()));
+    if (isInserted)
+        m_Names.push_back({name, INVALID_OFFSET});
+}
+
+void NameHeapBuilder::Clear()
+{
+    m_Names.clear();
+    m_NameLookup.clear();
+    m_Heap.clear();
+    m_NameShift = 0;
+
+    // the root entry always uses the empty name at offset 0
+    Add("");
+}
+
+int NameHeapBuilder::Build(int minNameShift)
+{
+    m_Heap.clear();
+
+    // names are laid out in sorted order so the heap does not depend on the order entries were added in
+    std::vector<uint32_t> sortedNames(m_Names.size());
+    for (uint32_t i = 0; i < sortedNames.size(); i++)
+        sortedNames[i] = i;
+
+    std::sort(sortedNames.begin(), sortedNames.end(), [this](uint32_t a, uint32_t b) { return m_Names[a].m_Name < m_Names[b].m_Name; });
+
+    uint64_t totalNameBytes = 0;
+    for (const NameItem& item : m_Names)
+        totalNameBytes += item.m_Name.size() + 1;
+
+    for (m_NameShift = std::clamp(minNameShift, 0, MAX_NAME_SHIFT); m_NameShift <= MAX_NAME_SHIFT; m_NameShift++)
+    {
+        // every name is padded to the shift alignment, which costs at most that many bytes per name
+        uint64_t nameMask = (1ull << m_NameShift) - 1;
+        uint64_t heapSize = totalNameBytes;
+        if (nameMask != 0)
+        {
+            heapSize = 0;
+            for (const NameItem& item : m_Names)
+                heapSize += (item.m_Name.size() + 1 + nameMask) & ~nameMask;
+        }
+
+        if (heapSize <= GetHeapMaxSize(m_NameShift))
+        {
+            m_Heap.resize(heapSize);
+            break;
+        }
+    }
+
+    if (m_NameShift > MAX_NAME_SHIFT)
+    {
+        m_NameShift = MAX_NAME_SHIFT;
+        return -1;
+    }
+
+    uint64_t nameMask = (1ull << m_NameShift) - 1;
+    uint64_t byteOffset = 0;
+    for (uint32_t nameIndex : sortedNames)
+    {
+        NameItem& item = m_Names[nameIndex];
+        item.m_Offset = static_cast<uint32_t>(byteOffset >> m_NameShift);
+
+        std::memcpy(m_Heap.data() + byteOffset, item.m_Name.data(), item.m_Name.size());
+        byteOffset += (item.m_Name.size() + 1 + nameMask) & ~nameMask;
+    }
+
+    return m_NameShift;
+}
+
+uint32_t NameHeapBuilder::GetOffset(std::string_view name) const
+{
+    auto nameIt = m_NameLookup.find(name);
+    if (nameIt == m_NameLookup.end())
+        return INVALID_OFFSET;
+
+    return m_Names[nameIt->second].m_Offset;
+}
@@ -0,0 +1,248 @@
+#include <rpflib/output_file.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+using namespace rpflib;
+
+#ifndef _WIN32
+// lowest IOV_MAX of the supported platforms
+static const size_t MAX_WRITE_VECTORS = 1024;
+#endif
+
+static const uint8_t ZERO_BLOCK[4096] = {};
+
+OutputFile::~OutputFile()
+{
+#ifdef _WIN32
+    if (m_FileHandle != nullptr && m_FileHandle != INVALID_HANDLE_VALUE)
+        CloseHandle(m_FileHandle);
+#else
+    if (m_FileDescriptor != -1)
+        close(m_FileDescriptor);
+#endif
+}
+
+std::unique_ptr<OutputFile> OutputFile::Create(const std::filesystem::path& path)
+{
+    std::unique_ptr<OutputFile> file(new OutputFile());
+
+#ifdef _WIN32
+    file->m_FileHandle = CreateFileW(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file->m_FileHandle == INVALID_HANDLE_VALUE)
+        return nullptr;
+#else
+    file->m_FileDescriptor = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (file->m_FileDescriptor == -1)
+        return nullptr;
+#endif
+
+    return file;
+}
+
+std::unique_ptr<OutputFile> OutputFile::Open(const std::filesystem::path& path)
+{
+    std::unique_ptr<OutputFile> file(new OutputFile());
+
+#ifdef _WIN32
+    file->m_FileHandle = CreateFileW(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file->m_FileHandle == INVALID_HANDLE_VALUE)
+        return nullptr;
+#else
+    file->m_FileDescriptor = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (file->m_FileDescriptor == -1)
+        return nullptr;
+#endif
+
+    return file;
+}
+
+bool OutputFile::Write(uint64_t offset, const void* data, uint64_t size)
+{
+    const uint8_t* input = static_cast<const uint8_t*>(data);
+    while (size > 0)
+    {
+#ifdef _WIN32
+        OVERLAPPED overlapped {};
+        overlapped.Offset = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+        DWORD chunkSize = static_cast<DWORD>(std::min<uint64_t>(size, 0x40000000));
+        DWORD bytesWritten = 0;
+        if (!WriteFile(m_FileHandle, input, chunkSize, &bytesWritten, &overlapped) || bytesWritten == 0)
+            return false;
+#else
+        ssize_t bytesWritten = pwrite(m_FileDescriptor, input, std::min<uint64_t>(size, 0x40000000), static_cast<off_t>(offset));
+        if (bytesWritten < 0 && errno == EINTR)
+            continue;
+
+        if (bytesWritten <= 0)
+            return false;
+#endif
+
+        input += bytesWritten;
+        offset += bytesWritten;
+        size -= bytesWritten;
+    }
+
+    return true;
+}
+
+bool OutputFile::Write(uint64_t offset, std::span<const std::span<const uint8_t>> buffers)
+{
+#ifdef _WIN32
+    for (std::span<const uint8_t> buffer : buffers)
+    {
+        if (!Write(offset, buffer.data(), buffer.size()))
+            return false;
+
+        offset += buffer.size();
+    }
+
+    return true;
+#else
+    std::vector<iovec> vectors;
+    vectors.reserve(buffers.size());
+    for (std::span<const uint8_t> buffer : buffers)
+    {
+        if (!buffer.empty())
+            vectors.push_back({const_cast<uint8_t*>(buffer.data()), buffer.size()});
+    }
+
+    size_t firstVector = 0;
+    while (firstVector < vectors.size())
+    {
+        int vectorCount = static_cast<int>(std::min(vectors.size() - firstVector, MAX_WRITE_VECTORS));
+        ssize_t bytesWritten = pwritev(m_FileDescriptor, vectors.data() + firstVector, vectorCount, static_cast<off_t>(offset));
+        if (bytesWritten < 0 && errno == EINTR)
+            continue;
+
+        if (bytesWritten <= 0)
+            return false;
+
+        offset += bytesWritten;
+
+        // a short write continues inside the buffer it stopped in
+        uint64_t remainingBytes = bytesWritten;
+        while (remainingBytes > 0)
+        {
+            iovec& vector = vectors[firstVector];
+            if (remainingBytes >= vector.iov_len)
+            {
+                remainingBytes -= vector.iov_len;
+                firstVector++;
+                continue;
+            }
+
+            vector.iov_base = static_cast<uint8_t*>(vector.iov_base) + remainingBytes;
+            vector.iov_len -= remainingBytes;
+            remainingBytes = 0;
+        }
+    }
+
+    return true;
+#endif
+}
+
+void OutputFile::Reserve(uint64_t size)
+{
+    if (size == 0)
+        return;
+
+#ifdef _WIN32
+    FILE_ALLOCATION_INFO allocationInfo {};
+    allocationInfo.AllocationSize.QuadPart = static_cast<LONGLONG>(size);
+    SetFileInformationByHandle(m_FileHandle, FileAllocationInfo, &allocationInfo, sizeof(allocationInfo));
+#elif defined(__linux__)
+    // failing is fine, the file system then allocates as the data is written
+    fallocate(m_FileDescriptor, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(size));
+#endif
+}
+
+bool OutputFile::Resize(uint64_t size)
+{
+#ifdef _WIN32
+    FILE_END_OF_FILE_INFO endOfFileInfo {};
+    endOfFileInfo.EndOfFile.QuadPart = static_cast<LONGLONG>(size);
+    return SetFileInformationByHandle(m_FileHandle, FileEndOfFileInfo, &endOfFileInfo, sizeof(endOfFileInfo)) != 0;
+#else
+    return ftruncate(m_FileDescriptor, static_cast<off_t>(size)) == 0;
+#endif
+}
+
+OutputBuffer::OutputBuffer(OutputFile& file, uint64_t capacity) : m_File(file)
+{
+    m_Capacity = std::max<uint64_t>((capacity + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT, ALIGNMENT);
+    m_Buffer = static_cast<uint8_t*>(::operator new(m_Capacity, std::align_val_t(ALIGNMENT)));
+}
+
+OutputBuffer::~OutputBuffer()
+{
+    ::operator delete(m_Buffer, std::align_val_t(ALIGNMENT));
+}
+
+bool OutputBuffer::Write(uint64_t offset, std::span<const uint8_t> data, uint64_t paddingSize)
+{
+    if (m_BufferSize != 0 && offset != m_BufferOffset + m_BufferSize)
+    {
+        if (!Flush())
+            return false;
+    }
+
+    if (m_BufferSize == 0)
+        m_BufferOffset = offset;
+
+    uint64_t size = data.size() + paddingSize;
+    if (size <= m_Capacity - m_BufferSize)
+    {
+        if (!data.empty())
+            std::memcpy(m_Buffer + m_BufferSize, data.data(), data.size());
+
+        std::memset(m_Buffer + m_BufferSize + data.size(), 0, paddingSize);
+        m_BufferSize += size;
+
+        return m_BufferSize < m_Capacity || Flush();
+    }
+
+    // data that does not fit is not copied, it leaves together with the buffered bytes in one vectored write
+    std::vector<std::span<const uint8_t>> buffers;
+    buffers.emplace_back(m_Buffer, m_BufferSize);
+    buffers.push_back(data);
+    for (uint64_t remainingPadding = paddingSize; remainingPadding > 0;)
+    {
+        uint64_t zeroSize = std::min<uint64_t>(remainingPadding, sizeof(ZERO_BLOCK));
+        buffers.emplace_back(ZERO_BLOCK, zeroSize);
+        remainingPadding -= zeroSize;
+    }
+
+    bool isWritten = m_File.Write(m_BufferOffset, buffers);
+    m_BufferOffset += m_BufferSize + size;
+    m_BufferSize = 0;
+
+    return isWritten;
+}
+
+bool OutputBuffer::Flush()
+{
+    if (m_BufferSize == 0)
+        return true;
+
+    bool isWritten = m_File.Write(m_BufferOffset, m_Buffer, m_BufferSize);
+    m_BufferOffset += m_BufferSize;
+    m_BufferSize = 0;
+
+    return isWritten;
+}
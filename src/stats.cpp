@@ -0,0 +1,218 @@
+#include <rpflib/stats.h>
+#include <algorithm>
+#include <bit>
+
+using namespace rpflib;
+
+static std::atomic<TraceCallback> g_TraceCallback = nullptr;
+static std::atomic<void*> g_TraceUserData = nullptr;
+
+void LatencyHistogram::Record(uint64_t nanoseconds)
+{
+    uint32_t bucket = std::min<uint32_t>(std::bit_width(nanoseconds), BUCKET_COUNT - 1);
+    m_Buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    m_TotalNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+
+    uint64_t maxNanoseconds = m_MaxNanoseconds.load(std::memory_order_relaxed);
+    while (nanoseconds > maxNanoseconds && !m_MaxNanoseconds.compare_exchange_weak(maxNanoseconds, nanoseconds, std::memory_order_relaxed))
+    {
+    }
+}
+
+void LatencyHistogram::Reset()
+{
+    for (std::atomic<uint64_t>& bucket : m_Buckets)
+        bucket.store(0, std::memory_order_relaxed);
+
+    m_TotalNanoseconds.store(0, std::memory_order_relaxed);
+    m_MaxNanoseconds.store(0, std::memory_order_relaxed);
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::GetSnapshot() const
+{
+    Snapshot snapshot;
+    for (uint32_t i = 0; i < BUCKET_COUNT; i++)
+    {
+        snapshot.m_Buckets[i] = m_Buckets[i].load(std::memory_order_relaxed);
+        snapshot.m_Count += snapshot.m_Buckets[i];
+    }
+
+    snapshot.m_TotalNanoseconds = m_TotalNanoseconds.load(std::memory_order_relaxed);
+    snapshot.m_MaxNanoseconds = m_MaxNanoseconds.load(std::memory_order_relaxed);
+
+    return snapshot;
+}
+
+uint64_t LatencyHistogram::Snapshot::GetPercentile(double percentile) const
+{
+    uint64_t bucketTotal = 0;
+    for (uint64_t bucketCount : m_Buckets)
+        bucketTotal += bucketCount;
+
+    if (bucketTotal == 0)
+        return 0;
+
+    uint64_t targetCount = std::max<uint64_t>((uint64_t)(std::clamp(percentile, 0.0, 1.0) * bucketTotal), 1);
+    uint64_t seenCount = 0;
+    for (uint32_t i = 0; i < BUCKET_COUNT; i++)
+    {
+        seenCount += m_Buckets[i];
+        if (seenCount >= targetCount)
+            return std::min<uint64_t>(1ull << i, m_MaxNanoseconds);
+    }
+
+    return m_MaxNanoseconds;
+}
+
+ArchiveStats& ArchiveStats::GetGlobal()
+{
+    static ArchiveStats globalStats(GlobalTag {});
+    return globalStats;
+}
+
+std::array<ArchiveStats::Values, ArchiveStats::GLOBAL_SHARD_COUNT>& ArchiveStats::GetGlobalShards()
+{
+    static std::array<Values, GLOBAL_SHARD_COUNT> globalShards;
+    return globalShards;
+}
+
+ArchiveStats::Values& ArchiveStats::GetGlobalShard()
+{
+    // threads take the shards in turn, so up to GLOBAL_SHARD_COUNT threads each have one to themselves
+    static std::atomic<uint32_t> nextShardIndex = 0;
+    static thread_local uint32_t shardIndex = nextShardIndex.fetch_add(1, std::memory_order_relaxed) % GLOBAL_SHARD_COUNT;
+
+    return GetGlobalShards()[shardIndex];
+}
+
+void ArchiveStats::Reset()
+{
+    auto resetValues = [](Values& values)
+    {
+        for (std::atomic<uint64_t>& counter : values.m_Counters)
+            counter.store(0, std::memory_order_relaxed);
+
+        for (LatencyHistogram& timer : values.m_Timers)
+            timer.Reset();
+    };
+
+    if (!m_IsGlobal)
+    {
+        resetValues(m_Values);
+        return;
+    }
+
+    for (Values& shard : GetGlobalShards())
+        resetValues(shard);
+}
+
+uint64_t ArchiveStats::GetCounter(StatCounter counter) const
+{
+    if (!m_IsGlobal)
+        return m_Values.m_Counters[static_cast<uint32_t>(counter)].load(std::memory_order_relaxed);
+
+    uint64_t value = 0;
+    for (const Values& shard : GetGlobalShards())
+        value += shard.m_Counters[static_cast<uint32_t>(counter)].load(std::memory_order_relaxed);
+
+    return value;
+}
+
+LatencyHistogram::Snapshot ArchiveStats::GetTimer(StatTimer timer) const
+{
+    if (!m_IsGlobal)
+        return m_Values.m_Timers[static_cast<uint32_t>(timer)].GetSnapshot();
+
+    LatencyHistogram::Snapshot snapshot;
+    for (const Values& shard : GetGlobalShards())
+    {
+        LatencyHistogram::Snapshot shardSnapshot = shard.m_Timers[static_cast<uint32_t>(timer)].GetSnapshot();
+        for (uint32_t i = 0; i < LatencyHistogram::BUCKET_COUNT; i++)
+            snapshot.m_Buckets[i] += shardSnapshot.m_Buckets[i];
+
+        snapshot.m_Count += shardSnapshot.m_Count;
+        snapshot.m_TotalNanoseconds += shardSnapshot.m_TotalNanoseconds;
+        snapshot.m_MaxNanoseconds = std::max(snapshot.m_MaxNanoseconds, shardSnapshot.m_MaxNanoseconds);
+    }
+
+    return snapshot;
+}
+
+const char* ArchiveStats::GetCounterName(StatCounter counter)
+{
+    switch (counter)
+    {
+    case StatCounter::STAT_COUNTER_READ_CALLS:
+        return "read_calls";
+    case StatCounter::STAT_COUNTER_BYTES_READ:
+        return "bytes_read";
+    case StatCounter::STAT_COUNTER_SEEKS:
+        return "seeks";
+    case StatCounter::STAT_COUNTER_ENTRIES_READ:
+        return "entries_read";
+    case StatCounter::STAT_COUNTER_INFLATE_BYTES_IN:
+        return "inflate_bytes_in";
+    case StatCounter::STAT_COUNTER_INFLATE_BYTES_OUT:
+        return "inflate_bytes_out";
+    case StatCounter::STAT_COUNTER_ENTRIES_WRITTEN:
+        return "entries_written";
+    case StatCounter::STAT_COUNTER_BYTES_WRITTEN:
+        return "bytes_written";
+    case StatCounter::STAT_COUNTER_DEFLATE_BYTES_IN:
+        return "deflate_bytes_in";
+    case StatCounter::STAT_COUNTER_DEFLATE_BYTES_OUT:
+        return "deflate_bytes_out";
+    case StatCounter::STAT_COUNTER_DEDUP_ENTRIES:
+        return "dedup_entries";
+    case StatCounter::STAT_COUNTER_DEDUP_BYTES:
+        return "dedup_bytes";
+    default:
+        return "unknown";
+    }
+}
+
+const char* ArchiveStats::GetTimerName(StatTimer timer)
+{
+    switch (timer)
+    {
+    case StatTimer::STAT_TIMER_OPEN:
+        return "open";
+    case StatTimer::STAT_TIMER_READ_NAMES:
+        return "read_names";
+    case StatTimer::STAT_TIMER_READ_ENTRIES:
+        return "read_entries";
+    case StatTimer::STAT_TIMER_BUILD_INDEX:
+        return "build_index";
+    case StatTimer::STAT_TIMER_READ_ENTRY:
+        return "read_entry";
+    case StatTimer::STAT_TIMER_INFLATE:
+        return "inflate";
+    case StatTimer::STAT_TIMER_DEFLATE:
+        return "deflate";
+    case StatTimer::STAT_TIMER_WRITE_ARCHIVE:
+        return "write_archive";
+    case StatTimer::STAT_TIMER_EXTRACT_ALL:
+        return "extract_all";
+    case StatTimer::STAT_TIMER_READ_BATCH:
+        return "read_batch";
+    case StatTimer::STAT_TIMER_DECRYPT:
+        return "decrypt";
+    default:
+        return "unknown";
+    }
+}
+
+void rpflib::SetTraceCallback(TraceCallback callback, void* userData)
+{
+    g_TraceUserData.store(userData, std::memory_order_release);
+    g_TraceCallback.store(callback, std::memory_order_release);
+}
+
+void rpflib::EmitTraceEvent(TraceEventType type, const char* name)
+{
+    TraceCallback callback = g_TraceCallback.load(std::memory_order_acquire);
+    if (callback == nullptr)
+        return;
+
+    callback(type, name, GetTimestampNanoseconds(), g_TraceUserData.load(std::memory_order_acquire));
+}
@@ -0,0 +1,115 @@
+#include <rpflib/thread_pool.h>
+#include <algorithm>
+
+using namespace rpflib;
+
+ThreadPool::ThreadPool(uint32_t threadCount)
+{
+    if (threadCount == 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    m_Queues.reserve(threadCount);
+    for (uint32_t i = 0; i < threadCount; i++)
+        m_Queues.push_back(std::make_unique<WorkerQueue>());
+
+    m_Threads.reserve(threadCount);
+    for (uint32_t i = 0; i < threadCount; i++)
+        m_Threads.emplace_back(&ThreadPool::WorkerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard lock(m_StateMutex);
+        m_Stopping = true;
+    }
+    m_WorkAvailable.notify_all();
+
+    for (auto& thread : m_Threads)
+    {
+        if (thread.joinable())
+            thread.join();
+    }
+}
+
+void ThreadPool::Submit(Task task, int32_t workerHint)
+{
+    uint32_t queueIndex = workerHint >= 0 ? static_cast<uint32_t>(workerHint) : m_NextQueue++;
+    WorkerQueue& queue = *m_Queues[queueIndex % m_Queues.size()];
+
+    m_PendingTasks++;
+    {
+        std::lock_guard lock(queue.m_Mutex);
+        queue.m_Tasks.push_back(std::move(task));
+        m_QueuedTasks++;
+    }
+
+    // taking the state mutex orders the notification after a sleeping worker has checked m_QueuedTasks
+    {
+        std::lock_guard lock(m_StateMutex);
+    }
+    m_WorkAvailable.notify_one();
+}
+
+void ThreadPool::Wait()
+{
+    std::unique_lock lock(m_StateMutex);
+    m_WorkDone.wait(lock, [this] { return m_PendingTasks == 0; });
+}
+
+void ThreadPool::WorkerLoop(uint32_t workerIndex)
+{
+    while (true)
+    {
+        Task task;
+        if (PopTask(workerIndex, task))
+        {
+            task(workerIndex);
+
+            if (--m_PendingTasks == 0)
+            {
+                std::lock_guard lock(m_StateMutex);
+                m_WorkDone.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock lock(m_StateMutex);
+        m_WorkAvailable.wait(lock, [this] { return m_Stopping || m_QueuedTasks > 0; });
+
+        if (m_Stopping && m_QueuedTasks == 0)
+            return;
+    }
+}
+
+bool ThreadPool::PopTask(uint32_t workerIndex, Task& task)
+{
+    // own queue first, in submission order
+    {
+        WorkerQueue& queue = *m_Queues[workerIndex];
+        std::lock_guard lock(queue.m_Mutex);
+        if (!queue.m_Tasks.empty())
+        {
+            task = std::move(queue.m_Tasks.front());
+            queue.m_Tasks.pop_front();
+            m_QueuedTasks--;
+            return true;
+        }
+    }
+
+    // steal the work furthest away from what the victim is currently processing
+    for (uint32_t i = 1; i < m_Queues.size(); i++)
+    {
+        WorkerQueue& queue = *m_Queues[(workerIndex + i) % m_Queues.size()];
+        std::lock_guard lock(queue.m_Mutex);
+        if (!queue.m_Tasks.empty())
+        {
+            task = std::move(queue.m_Tasks.back());
+            queue.m_Tasks.pop_back();
+            m_QueuedTasks--;
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,82 @@
+#include <rpflib/archives/rpf7_patch.h>
+
+#include <cstdio>
+#include <string>
+
+using namespace rpflib;
+
+static void PrintUsage()
+{
+    printf("usage: rpflib_patch create OLD.rpf NEW.rpf PATCH [--threads N]\n"
+           "       rpflib_patch apply ARCHIVE.rpf PATCH [--threads N] [--rewrite]\n"
+           "  --threads N         worker threads, 0 for all cores (default 0)\n"
+           "  --rewrite           rewrite the whole archive instead of updating it in place\n");
+}
+
+static void PrintSummary(const char* action, const RPF7PatchSummary& summary)
+{
+    printf("%s: %u added, %u changed, %u removed, %u skipped, %llu payload bytes%s\n", action, summary.m_AddedCount, summary.m_ChangedCount,
+           summary.m_RemovedCount, summary.m_SkippedCount, (unsigned long long)summary.m_PayloadBytes, summary.m_IsRewritten ? ", rewritten" : "");
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    std::string command = argv[1];
+    uint32_t positionalCount = command == "create" ? 3 : 2;
+    if ((command != "create" && command != "apply") || argc < 2 + (int)positionalCount)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    uint32_t threadCount = 0;
+    bool forceRewrite = false;
+    for (int i = 2 + positionalCount; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--rewrite")
+        {
+            forceRewrite = true;
+        }
+        else if (argument == "--threads" && i + 1 < argc)
+        {
+            threadCount = std::stoul(argv[++i]);
+        }
+        else
+        {
+            printf("ERROR! Unknown option %s\n", argument.c_str());
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    RPF7PatchSummary summary;
+    if (command == "create")
+    {
+        std::unique_ptr<RPF7Archive> oldArchive = RPF7Archive::OpenArchive(argv[2]);
+        std::unique_ptr<RPF7Archive> newArchive = RPF7Archive::OpenArchive(argv[3]);
+
+        RPF7PatchCreateOptions options;
+        options.m_ThreadCount = threadCount;
+        if (!RPF7Patch::Create(*oldArchive, *newArchive, argv[4], options, &summary))
+            return 1;
+
+        PrintSummary("created", summary);
+        return 0;
+    }
+
+    RPF7PatchApplyOptions options;
+    options.m_WriteOptions.m_ThreadCount = threadCount;
+    options.m_ForceRewrite = forceRewrite;
+    if (!RPF7Patch::Apply(argv[2], argv[3], options, &summary))
+        return 1;
+
+    PrintSummary("applied", summary);
+    return 0;
+}